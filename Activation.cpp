@@ -1,8 +1,9 @@
 #include "Activation.h"
-#include <cmath>
+#include "Kernels.h"
+#include "Trace.h"
 
 #define INVALID_ACTIVATION_TYPE "Error: Invalid Activation_type, must be " \
-                                "RELU/SOFTMAX.\n"
+                                "RELU/SOFTMAX/LINEAR.\n"
 
 /**
  * the relu function, perform the relu operation on a given matrix
@@ -12,40 +13,57 @@
 Matrix Activation::relu (const Matrix &m)
 {
   Matrix new_mat (m);
-  int vec_size = new_mat.get_cols() * new_mat.get_rows();
-  for (int i = 0; i < vec_size; i++)
-    if (new_mat[i] < 0)
-      new_mat[i] = 0;
-  return new_mat;
+  return relu_inplace (new_mat);
 }
 
 /**
- * the softmax function, perform the softmax operation on a given matrix
+ * the softmax function, perform the softmax operation on a given matrix.
+ * every column is treated as a separate vector, so a batch of N inputs
+ * (rows x N) is normalized column by column.
  * @param m a given matrix
  * @return new matrix = softmax(m)
  */
 Matrix Activation::softmax (const Matrix &m)
 {
-  Matrix new_mat = Matrix(m);
-  int vec_size = new_mat.get_cols() * new_mat.get_rows();
-  float sum = 0;
+  Matrix new_mat (m);
+  return softmax_inplace (new_mat);
+}
+
+/**
+ * the relu function, in place: m = relu(m)
+ * @param m a given matrix
+ * @return reference of the updated matrix
+ */
+Matrix &Activation::relu_inplace (Matrix &m)
+{
+  TRACE_SCOPE ("relu");
+  float *vec = m.data();
+  int vec_size = m.get_cols() * m.get_rows();
   for (int i = 0; i < vec_size; i++)
-    {
-      float exp_val = std::exp (new_mat[i]);
-      new_mat[i] = exp_val;
-      sum += exp_val;
-    }
-  float factor = 1 / sum;
-  return new_mat * factor;
+    if (vec[i] < 0)
+      vec[i] = 0;
+  return m;
+}
+
+/**
+ * the softmax function, in place on every column of m: m = softmax(m)
+ * @param m a given matrix
+ * @return reference of the updated matrix
+ */
+Matrix &Activation::softmax_inplace (Matrix &m)
+{
+  TRACE_SCOPE ("softmax");
+  softmax_columns (m.data(), m.get_cols(), m.get_rows(), m.get_cols());
+  return m;
 }
 
 /**
  * the Activation constructor
- * @param act_type holds the enum: RELU/SOFTMAX
+ * @param act_type holds the enum: RELU/SOFTMAX/LINEAR
  */
 Activation::Activation (ActivationType act_type)
 {
-  if (act_type != RELU && act_type != SOFTMAX)
+  if (act_type != RELU && act_type != SOFTMAX && act_type != LINEAR)
     {
       std::cerr << INVALID_ACTIVATION_TYPE << std::endl;
       exit (EXIT_FAILURE);
@@ -54,14 +72,31 @@ Activation::Activation (ActivationType act_type)
 }
 
 /**
- * activates one of the ActivationType functions: RELU/SOFTMAX on a given
- * matrix
+ * activates one of the ActivationType functions: RELU/SOFTMAX/LINEAR on a
+ * given matrix
  * @param m a given matrix
- * @return new matrix = relu/softmax(m)
+ * @return new matrix = relu/softmax(m), or a copy of m
  */
 Matrix Activation::operator() (const Matrix &m) const
 {
   if (_act_type == RELU)
     return relu(m);
+  if (_act_type == LINEAR)
+    return m;
   return softmax(m);
 }
+
+/**
+ * activates one of the ActivationType functions: RELU/SOFTMAX/LINEAR on a
+ * given matrix, in place
+ * @param m a given matrix
+ * @return reference of the updated matrix = relu/softmax(m), or m
+ */
+Matrix &Activation::apply_inplace (Matrix &m) const
+{
+  if (_act_type == RELU)
+    return relu_inplace(m);
+  if (_act_type == LINEAR)
+    return m;
+  return softmax_inplace(m);
+}
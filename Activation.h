@@ -11,7 +11,8 @@
 enum ActivationType
 {
     RELU,
-    SOFTMAX
+    SOFTMAX,
+    LINEAR      // the identity, e.g. the first factor of a low-rank layer
 };
 
 class Activation
@@ -27,7 +28,8 @@ class Activation
   static Matrix relu(const Matrix &m);
 
 /**
- * the softmax function, perform the softmax operation on a given matrix
+ * the softmax function, perform the softmax operation on every column of a
+ * given matrix
  * @param m a given matrix
  * @return new matrix = softmax(m)
  */
@@ -35,9 +37,23 @@ class Activation
 
  public:
 
+/**
+ * the relu function, in place: m = relu(m)
+ * @param m a given matrix
+ * @return reference of the updated matrix
+ */
+  static Matrix &relu_inplace(Matrix &m);
+
+/**
+ * the softmax function, in place on every column of m: m = softmax(m)
+ * @param m a given matrix
+ * @return reference of the updated matrix
+ */
+  static Matrix &softmax_inplace(Matrix &m);
+
 /**
  * the Activation constructor
- * @param act_type holds the enum: RELU/SOFTMAX
+ * @param act_type holds the enum: RELU/SOFTMAX/LINEAR
  */
   Activation(ActivationType act_type);
 
@@ -48,12 +64,20 @@ class Activation
   }
 
 /**
- * activates one of the ActivationType functions: RELU/SOFTMAX on a given
- * matrix
+ * activates one of the ActivationType functions: RELU/SOFTMAX/LINEAR on a
+ * given matrix
  * @param m a given matrix
- * @return new matrix = relu/softmax(m)
+ * @return new matrix = relu/softmax(m), or a copy of m
  */
   Matrix operator() (const Matrix &m) const;
+
+/**
+ * activates one of the ActivationType functions: RELU/SOFTMAX/LINEAR on a
+ * given matrix, in place
+ * @param m a given matrix
+ * @return reference of the updated matrix = relu/softmax(m), or m
+ */
+  Matrix &apply_inplace (Matrix &m) const;
 };
 
 #endif //ACTIVATION_H
@@ -0,0 +1,77 @@
+// BoundedQueue.h
+
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+/**
+ * A blocking first-in first-out queue of a bounded capacity, joining two
+ * pipeline stages: the producer blocks while the queue is full, and the
+ * consumer blocks while it is empty, until the producer closes it.
+ */
+template <typename T>
+class BoundedQueue
+{
+  std::deque<T> _items;
+  std::size_t _capacity;
+  bool _closed;
+  std::mutex _lock;
+  std::condition_variable _not_full, _not_empty;
+
+ public:
+/**
+ * the BoundedQueue constructor
+ * @param capacity the largest number of queued items, at least 1
+ */
+  explicit BoundedQueue (std::size_t capacity)
+      : _capacity(capacity ? capacity : 1), _closed(false) {}
+
+/**
+ * queue an item, blocking while the queue is full
+ * @param item the item
+ */
+  void push (T item)
+  {
+    std::unique_lock<std::mutex> guard (_lock);
+    _not_full.wait (guard, [this] () { return _items.size() < _capacity; });
+    _items.push_back (std::move (item));
+    guard.unlock();
+    _not_empty.notify_one();
+  }
+
+/**
+ * take the oldest item, blocking while the queue is empty and open
+ * @param item set to the taken item
+ * @return false if the queue is closed and drained, true otherwise
+ */
+  bool pop (T &item)
+  {
+    std::unique_lock<std::mutex> guard (_lock);
+    _not_empty.wait (guard, [this] () { return _closed || !_items.empty(); });
+    if (_items.empty())
+      return false;
+    item = std::move (_items.front());
+    _items.pop_front();
+    guard.unlock();
+    _not_full.notify_one();
+    return true;
+  }
+
+/**
+ * mark the end of the items: once the queued items are taken, pop returns
+ * false
+ */
+  void close ()
+  {
+    {
+      std::lock_guard<std::mutex> guard (_lock);
+      _closed = true;
+    }
+    _not_empty.notify_all();
+  }
+};
+
+#endif //BOUNDEDQUEUE_H
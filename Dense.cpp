@@ -1,23 +1,104 @@
 #include "Dense.h"
+#include "Kernels.h"
+#include "Trace.h"
+
+#include <utility>
 
 #define INVALID_ACTIVATION_TYPE "Error: Invalid Activation_type, must be " \
-                                "RELU/SOFTMAX.\n"
+                                "RELU/SOFTMAX/LINEAR.\n"
+#define INVALID_INPUT_SIZE "Error: Dense input rows must match the weights " \
+                           "cols.\n"
+#define HALF_WEIGHTS_ERROR "Error: the Dense weights are stored in half " \
+                           "precision.\n"
+#define TRACE_NAME_PREFIX "dense "
+#define TRACE_NAME_SPARSE "sparse"
+// the sparse kernels replace the dense ones at a blocks density up to
+// SPARSE_MAX_DENSITY (measured: the gemv breaks even near 0.35 on
+// 128x784, and the gemm near 0.4), for matrices of SPARSE_MIN_SIZE
+// elements at least - smaller ones stay in the cache anyway.
+#define SPARSE_MAX_DENSITY 0.3f
+#define SPARSE_MIN_SIZE 4096
+#define INVALID_BIAS_SIZE "Error: Dense bias must be a (#weights rows x 1) " \
+                          "vector.\n"
+
 
+/**
+ * the Dense constructor, copies the given parameters
+ * @param w the Dense weight matrix
+ * @param bias the Dense bias matrix
+ * @param act_type the Dense Activation-function-type
+ */
+Dense::Dense (const Matrix &w, const Matrix &bias, ActivationType act_type)
+    : Dense (std::make_shared<const Matrix> (w),
+             std::make_shared<const Matrix> (bias), act_type) {}
 
 /**
- * the Dense constructor
+ * the Dense constructor, shares the given read-only parameters
  * @param w the Dense weight matrix
  * @param bias the Dense bias matrix
  * @param act_type the Dense Activation-function-type
  */
-Dense::Dense (const Matrix &w, const Matrix &bias, ActivationType
-act_type): _w(w), _bias(bias), _act(act_type)
+Dense::Dense (SharedMatrix w, SharedMatrix bias, ActivationType act_type)
+    : _w(std::move (w)), _bias(std::move (bias)), _gemv(GEMV_ROWS),
+      _act(act_type)
 {
-  if (act_type != RELU && act_type != SOFTMAX)
+  if (act_type != RELU && act_type != SOFTMAX && act_type != LINEAR)
     {
       std::cerr << INVALID_ACTIVATION_TYPE << std::endl;
       exit (EXIT_FAILURE);
     }
+  if (!_w || !_bias || _bias->get_rows() != _w->get_rows()
+      || _bias->get_cols() != 1)
+    {
+      std::cerr << INVALID_BIAS_SIZE << std::endl;
+      exit (EXIT_FAILURE);
+    }
+  int rows = get_output_size(), cols = get_input_size();
+  if ((long) rows * cols >= SPARSE_MIN_SIZE
+      && SparseMatrix::block_density (*_w) <= SPARSE_MAX_DENSITY)
+    {
+      _w_sparse = std::make_shared<const SparseMatrix> (*_w);
+      _trace_name = TRACE_NAME_PREFIX + std::to_string (cols) + "->"
+                    + std::to_string (rows) + " " + TRACE_NAME_SPARSE;
+      return;
+    }
+  _gemv = select_gemv (rows, cols);
+  if (_gemv == GEMV_SMALL)
+    {
+      // packed once, and shared by the copies of the layer.
+      std::shared_ptr<Matrix> packed =
+          std::make_shared<Matrix> (cols, gemv_small_ld (rows));
+      gemv_small_pack (_w->data(), cols, rows, cols, packed->data());
+      _w_small = packed;
+    }
+  _trace_name = TRACE_NAME_PREFIX + std::to_string (cols) + "->"
+                + std::to_string (rows) + " " + gemv_variant_name (_gemv);
+}
+
+/**
+ * the half precision Dense constructor, shares the given read-only
+ * parameters
+ * @param w the Dense weight matrix, in f16 or bf16
+ * @param bias the Dense bias matrix
+ * @param act_type the Dense Activation-function-type
+ */
+Dense::Dense (SharedHalfMatrix w, SharedMatrix bias, ActivationType act_type)
+    : _bias(std::move (bias)), _w_half(std::move (w)), _gemv(GEMV_ROWS),
+      _act(act_type)
+{
+  if (act_type != RELU && act_type != SOFTMAX && act_type != LINEAR)
+    {
+      std::cerr << INVALID_ACTIVATION_TYPE << std::endl;
+      exit (EXIT_FAILURE);
+    }
+  if (!_w_half || !_bias || _bias->get_rows() != _w_half->get_rows()
+      || _bias->get_cols() != 1)
+    {
+      std::cerr << INVALID_BIAS_SIZE << std::endl;
+      exit (EXIT_FAILURE);
+    }
+  _trace_name = TRACE_NAME_PREFIX + std::to_string (get_input_size()) + "->"
+                + std::to_string (get_output_size());
 }
 
 // Getters:
@@ -27,7 +108,12 @@ act_type): _w(w), _bias(bias), _act(act_type)
  */
 const Matrix& Dense::get_weights () const
 {
-  return _w;
+  if (!_w)
+    {
+      std::cerr << HALF_WEIGHTS_ERROR << std::endl;
+      exit (EXIT_FAILURE);
+    }
+  return *_w;
 }
 
 /**
@@ -36,7 +122,7 @@ const Matrix& Dense::get_weights () const
  */
 const Matrix& Dense::get_bias () const
 {
-  return _bias;
+  return *_bias;
 }
 
 /**
@@ -49,11 +135,90 @@ const Activation& Dense::get_activation () const
 }
 
 /**
- * the Dense operator, perform the Dense manipulations on a given matrix
+ * the Dense execution up to the softmax: the product, with the bias and
+ * the relu applied by the kernels epilogue.
+ * m may hold a batch of input vectors, one per column - the bias is added to
+ * every column of the product.
+ * @param m a given matrix
+ * @param out the output matrix, resized to (#weights rows x #m cols) - its
+ *        storage is reused when large enough
+ */
+void Dense::forward_logits (const Matrix &m, Matrix &out) const
+{
+  int rows = get_output_size(), cols = get_input_size();
+  if (m.get_rows() != cols)
+    {
+      std::cerr << INVALID_INPUT_SIZE << std::endl;
+      exit (EXIT_FAILURE);
+    }
+  out.resize (rows, m.get_cols());
+
+  // the relu is fused into the product, and timed with it.
+  TRACE_SCOPE (_trace_name.c_str());
+  bool relu = _act.get_activation_type() == RELU;
+  if (_w_half && m.get_cols() == 1)
+    gemv_half (_w_half->data(), _w_half->get_format(), cols, m.data(),
+               out.data(), rows, cols, _bias->data(), relu);
+  else if (_w_half)
+    gemm_half (_w_half->data(), _w_half->get_format(), cols, m.data(),
+               m.get_cols(), out.data(), out.get_cols(), rows, m.get_cols(),
+               cols, _bias->data(), relu);
+  else if (_w_sparse && m.get_cols() == 1)
+    gemv_sparse (_w_sparse->row_ptr(), _w_sparse->block_cols(),
+                 _w_sparse->values(), m.data(), out.data(), rows, cols,
+                 _bias->data(), relu);
+  else if (_w_sparse)
+    gemm_sparse (_w_sparse->row_ptr(), _w_sparse->block_cols(),
+                 _w_sparse->values(), m.data(), m.get_cols(), out.data(),
+                 out.get_cols(), rows, m.get_cols(), cols, _bias->data(),
+                 relu);
+  else if (m.get_cols() == 1)
+    switch (_gemv)
+      {
+        case GEMV_WIDE:
+          gemv_wide (_w->data(), cols, m.data(), out.data(), rows, cols,
+                     _bias->data(), relu);
+          break;
+        case GEMV_SKINNY:
+          gemv_skinny (_w->data(), cols, m.data(), out.data(), rows, cols,
+                       _bias->data(), relu);
+          break;
+        case GEMV_SMALL:
+          gemv_small (_w_small->data(), m.data(), out.data(), rows, cols,
+                      _bias->data(), relu);
+          break;
+        default:
+          gemv (_w->data(), cols, m.data(), out.data(), rows, cols,
+                _bias->data(), relu);
+      }
+  else
+    gemm (_w->data(), cols, m.data(), m.get_cols(), out.data(),
+          out.get_cols(), rows, m.get_cols(), cols, _bias->data(), relu);
+}
+
+/**
+ * the fused Dense execution: out = act(w * m + bias). softmax runs in place
+ * on the output of the product.
+ * @param m a given matrix
+ * @param out the output matrix, resized to (#weights rows x #m cols) - its
+ *        storage is reused when large enough
+ */
+void Dense::forward (const Matrix &m, Matrix &out) const
+{
+  forward_logits (m, out);
+  if (_act.get_activation_type() == SOFTMAX)
+    Activation::softmax_inplace (out);
+}
+
+/**
+ * the Dense operator, perform the Dense manipulations on a given matrix.
+ * a thin wrapper of forward(), which allocates the output matrix.
  * @param m a given matrix
  * @return the Dense manipulations output-matrix-result
  */
 Matrix Dense::operator() (const Matrix &m) const
 {
-  return _act((_w * m) += _bias);
+  Matrix out (get_output_size(), m.get_cols());
+  forward (m, out);
+  return out;
 }
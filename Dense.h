@@ -2,28 +2,118 @@
 #define C___PROJECT_DENSE_H
 
 #include "Activation.h"
+#include "HalfMatrix.h"
+#include "Kernels.h"
+#include "SparseMatrix.h"
+
+#include <string>
 
 class Dense
 {
-  Matrix _w, _bias;
+  SharedMatrix _w, _bias;
+  SharedHalfMatrix _w_half;
+  // the single vector kernel of the float weights shape, and for
+  // GEMV_SMALL the weights laid out by gemv_small_pack.
+  GemvVariant _gemv;
+  SharedMatrix _w_small;
+  // a block-sparse copy of sparse enough float weights, which then replaces
+  // them in the products.
+  SharedSparseMatrix _w_sparse;
   Activation _act;
+  std::string _trace_name;
 
  public:
 /**
- * the Dense constructor
+ * the Dense constructor, copies the given parameters
  * @param w the Dense weight matrix
  * @param bias the Dense bias matrix
  * @param act_type the Dense Activation-function-type
  */
   Dense(const Matrix &w, const Matrix &bias, ActivationType act_type);
 
+/**
+ * the Dense constructor, shares the given read-only parameters - copying the
+ * Dense, or building several Dense from the same parameters, does not copy
+ * the weights
+ * @param w the Dense weight matrix
+ * @param bias the Dense bias matrix
+ * @param act_type the Dense Activation-function-type
+ */
+  Dense(SharedMatrix w, SharedMatrix bias, ActivationType act_type);
+
+/**
+ * the half precision Dense constructor, shares the given read-only
+ * parameters. the weights are widened to float inside the kernels.
+ * @param w the Dense weight matrix, in f16 or bf16
+ * @param bias the Dense bias matrix
+ * @param act_type the Dense Activation-function-type
+ */
+  Dense(SharedHalfMatrix w, SharedMatrix bias, ActivationType act_type);
+
 // Getters:
 /**
- * the Dense weight-field getter
+ * the Dense weight-field getter, of a float32 Dense (exits if the weights
+ * are stored in half precision)
  * @return the weight matrix
  */
   const Matrix& get_weights () const;
 
+/**
+ * the Dense half precision weight-field getter
+ * @return the weight matrix, or nullptr if the weights are float32
+ */
+  const HalfMatrix *get_half_weights () const
+  {
+    return _w_half.get();
+  }
+
+/**
+ * the Dense sparse weights getter
+ * @return the block-sparse weights the products run on, or nullptr if the
+ *         weights are too dense for the sparse kernels to pay off
+ */
+  const SparseMatrix *get_sparse_weights () const
+  {
+    return _w_sparse.get();
+  }
+
+/**
+ * @return the input vectors size: the weights cols number
+ */
+  int get_input_size () const
+  {
+    return _w_half ? _w_half->get_cols() : _w->get_cols();
+  }
+
+/**
+ * @return the output vectors size: the weights rows number
+ */
+  int get_output_size () const
+  {
+    return _w_half ? _w_half->get_rows() : _w->get_rows();
+  }
+
+/**
+ * @return the number of bytes of the stored weights
+ */
+  std::size_t weights_bytes () const
+  {
+    if (_w_sparse)
+      return _w_sparse->bytes();
+    return (std::size_t) get_output_size() * get_input_size()
+           * (_w_half ? sizeof (uint16_t) : sizeof (float));
+  }
+
+/**
+ * @return the gemv variant a single input vector is computed by, picked
+ *         for the weights shape on construction (GEMV_ROWS for half
+ *         precision or sparse weights, which have their own kernels)
+ */
+  GemvVariant get_gemv_variant () const
+  {
+    return _gemv;
+  }
+
 /**
  * the Dense bias-field getter
  * @return the bias matrix
@@ -36,9 +126,29 @@ class Dense
  */
   const Activation& get_activation() const;
 
+/**
+ * the fused Dense execution: out = act(w * m + bias), computed in a single
+ * pass of the kernels straight into the given output matrix, with no
+ * temporaries.
+ * @param m a given matrix, a single vector or a batch of column vectors
+ * @param out the output matrix, resized to (#weights rows x #m cols) - its
+ *        storage is reused when large enough, so a reused output matrix
+ *        makes the layer allocation free
+ */
+  void forward (const Matrix &m, Matrix &out) const;
+
+/**
+ * the Dense execution up to the softmax: out = w * m + bias for a softmax
+ * layer (the logits, for the callers that only rank them), the same as
+ * forward() for a relu layer.
+ * @param m a given matrix, a single vector or a batch of column vectors
+ * @param out the output matrix, resized to (#weights rows x #m cols)
+ */
+  void forward_logits (const Matrix &m, Matrix &out) const;
+
 /**
  * the Dense operator, perform the Dense manipulations on a given matrix
- * @param m a given matrix
+ * @param m a given matrix, a single vector or a batch of column vectors
  * @return the Dense manipulations output-matrix-result
  */
   Matrix operator() (const Matrix &m) const;
@@ -0,0 +1,70 @@
+// FixedDense.h
+
+#ifndef FIXEDDENSE_H
+#define FIXEDDENSE_H
+
+#include <utility>
+
+#include "Activation.h"
+#include "FixedMatrix.h"
+#include "Kernels.h"
+
+#define FIXED_DENSE_SHAPE_ERROR "Error: FixedDense parameters do not match " \
+                                "the layer shape: "
+
+/**
+ * A Dense layer of a compile-time shape and activation. The weights are
+ * shared read-only (like a Dense), the layer input and output are fixed
+ * matrices, so the layer never checks a shape nor allocates. The product is
+ * the SIMD gemv kernel (with the fused bias and relu), called with constant
+ * bounds - a plain template loop is left scalar by the compiler, since it
+ * may not reorder a float reduction.
+ * @tparam In the input size (the weights cols number)
+ * @tparam Out the output size (the weights rows number)
+ * @tparam Act the activation, RELU or SOFTMAX
+ */
+template <int In, int Out, ActivationType Act>
+class FixedDense
+{
+  static_assert (Act == RELU || Act == SOFTMAX,
+                 "a FixedDense activation must be RELU/SOFTMAX");
+
+  SharedMatrix _w, _bias;
+
+ public:
+  static constexpr int input_size = In;
+  static constexpr int output_size = Out;
+
+/**
+ * the FixedDense constructor, shares the given read-only parameters.
+ * exits (code == 1) if they are not of the layer shape.
+ * @param w the weight matrix (Out x In)
+ * @param bias the bias matrix (Out x 1)
+ */
+  FixedDense (SharedMatrix w, SharedMatrix bias)
+      : _w(std::move (w)), _bias(std::move (bias))
+  {
+    if (!_w || !_bias || _w->get_rows() != Out || _w->get_cols() != In
+        || _bias->get_rows() != Out || _bias->get_cols() != 1)
+      {
+        std::cerr << FIXED_DENSE_SHAPE_ERROR << Out << "x" << In
+                  << std::endl;
+        exit (EXIT_FAILURE);
+      }
+  }
+
+/**
+ * compute the layer: y = act(w * x + bias)
+ * @param x the input vector
+ * @param y the output vector, overwritten
+ */
+  void forward (const FixedMatrix<In, 1> &x, FixedMatrix<Out, 1> &y) const
+  {
+    gemv (_w->data(), In, x.data(), y.data(), Out, In, _bias->data(),
+          Act == RELU);
+    if (Act == SOFTMAX)
+      softmax_columns (y.data(), 1, Out, 1);
+  }
+};
+
+#endif //FIXEDDENSE_H
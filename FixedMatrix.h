@@ -0,0 +1,105 @@
+// FixedMatrix.h
+
+#ifndef FIXEDMATRIX_H
+#define FIXEDMATRIX_H
+
+#include <cstring>
+
+#include "Matrix.h"
+
+/**
+ * A matrix of a compile-time shape. The elements live inside the object
+ * (on the stack for a local), 64-byte aligned, row-major - so it never
+ * allocates, and every loop over it has constant bounds. The element access
+ * is not checked: the shapes are checked by the compiler instead, wherever
+ * two fixed matrices meet.
+ * @tparam R rows number
+ * @tparam C cols number
+ */
+template <int R, int C>
+class FixedMatrix
+{
+  static_assert (R > 0 && C > 0, "a FixedMatrix must not be empty");
+
+  alignas(64) float _vec[R * C];
+
+ public:
+  static constexpr int rows = R;
+  static constexpr int cols = C;
+  static constexpr int size = R * C;
+
+/**
+ * the FixedMatrix constructor, the elements are left uninitialized
+ */
+  FixedMatrix () = default;
+
+/**
+ * copy the elements of a dynamic matrix of the same number of elements
+ * (read row by row, so a R*C vector fills a R x C matrix)
+ * @param m the matrix
+ * @return false, leaving this unchanged, if m is of another size
+ */
+  bool assign (const Matrix &m)
+  {
+    if (m.get_rows() * m.get_cols() != size)
+      return false;
+    std::memcpy (_vec, m.data(), sizeof (_vec));
+    return true;
+  }
+
+/**
+ * @return the first element
+ */
+  float *data ()
+  {
+    return _vec;
+  }
+
+/**
+ * @return the first element
+ */
+  const float *data () const
+  {
+    return _vec;
+  }
+
+/**
+ * @param i row index
+ * @param j col index
+ * @return reference of the (i,j) element
+ */
+  float &operator() (int i, int j)
+  {
+    return _vec[i * C + j];
+  }
+
+/**
+ * @param i row index
+ * @param j col index
+ * @return the (i,j) element
+ */
+  float operator() (int i, int j) const
+  {
+    return _vec[i * C + j];
+  }
+
+/**
+ * @param i index, in row-major order
+ * @return reference of the i'th element
+ */
+  float &operator[] (int i)
+  {
+    return _vec[i];
+  }
+
+/**
+ * @param i index, in row-major order
+ * @return the i'th element
+ */
+  float operator[] (int i) const
+  {
+    return _vec[i];
+  }
+};
+
+#endif //FIXEDMATRIX_H
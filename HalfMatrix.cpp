@@ -0,0 +1,28 @@
+#include "HalfMatrix.h"
+
+/**
+ * HalfMatrix constructor, converts a float matrix (rounding to nearest)
+ * @param m the float matrix
+ * @param format the half precision format to store in
+ */
+HalfMatrix::HalfMatrix (const Matrix &m, HalfFormat format)
+    : _rows(m.get_rows()), _cols(m.get_cols()), _format(format),
+      _vec((std::size_t) m.get_rows() * m.get_cols())
+{
+  const float *vec = m.data();
+  for (std::size_t i = 0; i < _vec.size(); i++)
+    _vec[i] = float_to_half (vec[i], format);
+}
+
+/**
+ * widen the matrix back to float
+ * @return new float matrix
+ */
+Matrix HalfMatrix::to_matrix () const
+{
+  Matrix m (_rows, _cols);
+  float *vec = m.data();
+  for (std::size_t i = 0; i < _vec.size(); i++)
+    vec[i] = half_to_float (_vec[i], _format);
+  return m;
+}
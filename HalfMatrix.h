@@ -0,0 +1,91 @@
+// HalfMatrix.h
+
+#ifndef HALFMATRIX_H
+#define HALFMATRIX_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Kernels.h"
+#include "Matrix.h"
+
+/**
+ * @enum WeightsPrecision
+ * @brief The storage precision of the network weights.
+ */
+enum WeightsPrecision
+{
+    PRECISION_F32,
+    PRECISION_F16,
+    PRECISION_BF16
+};
+
+/**
+ * A read-only matrix stored in a 16-bit floating point format (f16 or bf16),
+ * ordered row by row. Half the size of a float Matrix; the kernels widen its
+ * elements back to float on the fly.
+ */
+class HalfMatrix
+{
+  int _rows, _cols;
+  HalfFormat _format;
+  std::vector<uint16_t> _vec;
+
+ public:
+/**
+ * HalfMatrix constructor, converts a float matrix (rounding to nearest)
+ * @param m the float matrix
+ * @param format the half precision format to store in
+ */
+  HalfMatrix (const Matrix &m, HalfFormat format);
+
+/**
+ * the rows field getter
+ * @return HalfMatrix rows number
+ */
+  int get_rows () const
+  {
+    return _rows;
+  }
+
+/**
+ * the cols field getter
+ * @return HalfMatrix cols number
+ */
+  int get_cols () const
+  {
+    return _cols;
+  }
+
+/**
+ * the format field getter
+ * @return the half precision format of the elements
+ */
+  HalfFormat get_format () const
+  {
+    return _format;
+  }
+
+/**
+ * the raw elements getter, ordered row by row
+ * @return const pointer to the first element of the matrix
+ */
+  const uint16_t *data () const
+  {
+    return _vec.data();
+  }
+
+/**
+ * widen the matrix back to float
+ * @return new float matrix
+ */
+  Matrix to_matrix () const;
+};
+
+/**
+ * a read-only half precision matrix shared by many owners
+ */
+typedef std::shared_ptr<const HalfMatrix> SharedHalfMatrix;
+
+#endif //HALFMATRIX_H
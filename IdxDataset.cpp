@@ -0,0 +1,108 @@
+#include "IdxDataset.h"
+
+#include <climits>
+#include <utility>
+
+#include "Kernels.h"
+
+#define IDX_IMAGES_HEADER 16
+#define IDX_LABELS_HEADER 8
+
+/**
+ * read a big-endian 32 bits field of an IDX header
+ * @param p the field bytes
+ * @return the field value
+ */
+static uint32_t read_be32 (const uint8_t *p)
+{
+  return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16
+         | (uint32_t) p[2] << 8 | (uint32_t) p[3];
+}
+
+/**
+ * IdxImages constructor, of a validated mapping
+ */
+IdxImages::IdxImages (std::shared_ptr<MappedFile> file, int count, int rows,
+                      int cols)
+    : _file(std::move (file)), _count(count), _rows(rows), _cols(cols)
+{
+  _pixels = static_cast<const uint8_t *> (_file->data()) + IDX_IMAGES_HEADER;
+}
+
+/**
+ * map an IDX images file
+ * @param path the file path
+ * @return the images, or nullptr if the file is invalid
+ */
+std::shared_ptr<IdxImages> IdxImages::open (const std::string &path)
+{
+  std::shared_ptr<MappedFile> file = MappedFile::open (path);
+  if (!file || file->size() < IDX_IMAGES_HEADER)
+    return nullptr;
+
+  const uint8_t *header = static_cast<const uint8_t *> (file->data());
+  uint32_t count = read_be32 (header + 4);
+  uint32_t rows = read_be32 (header + 8), cols = read_be32 (header + 12);
+  if (read_be32 (header) != IDX_IMAGES_MAGIC || count > INT_MAX
+      || rows == 0 || cols == 0 || (uint64_t) rows * cols > INT_MAX
+      || (file->size() - IDX_IMAGES_HEADER) / ((uint64_t) rows * cols)
+         < count)
+    return nullptr;
+  return std::shared_ptr<IdxImages> (
+      new IdxImages (std::move (file), (int) count, (int) rows, (int) cols));
+}
+
+/**
+ * normalize images to floats in [0, 1]
+ * @param first the first image index
+ * @param n the images number
+ * @param dst n * image_size() floats: an image per row
+ */
+void IdxImages::read (int first, int n, float *dst) const
+{
+  // the images of the range are consecutive: a conversion per image keeps
+  // the count in range for any n.
+  for (int i = 0; i < n; i++)
+    u8_to_float (pixels (first + i), IDX_PIXEL_SCALE,
+                 dst + (std::size_t) i * image_size(), image_size());
+}
+
+/**
+ * drop the mapped pages of images that were read
+ * @param first the first image index
+ * @param n the images number
+ */
+void IdxImages::release (int first, int n) const
+{
+  _file->release (IDX_IMAGES_HEADER + (std::size_t) first * image_size(),
+                  (std::size_t) n * image_size());
+}
+
+/**
+ * IdxLabels constructor, of a validated mapping
+ */
+IdxLabels::IdxLabels (std::shared_ptr<MappedFile> file, int count)
+    : _file(std::move (file)), _count(count)
+{
+  _labels = static_cast<const uint8_t *> (_file->data()) + IDX_LABELS_HEADER;
+}
+
+/**
+ * map an IDX labels file
+ * @param path the file path
+ * @return the labels, or nullptr if the file is invalid
+ */
+std::shared_ptr<IdxLabels> IdxLabels::open (const std::string &path)
+{
+  std::shared_ptr<MappedFile> file = MappedFile::open (path);
+  if (!file || file->size() < IDX_LABELS_HEADER)
+    return nullptr;
+
+  const uint8_t *header = static_cast<const uint8_t *> (file->data());
+  uint32_t count = read_be32 (header + 4);
+  if (read_be32 (header) != IDX_LABELS_MAGIC || count > INT_MAX
+      || file->size() - IDX_LABELS_HEADER < count)
+    return nullptr;
+  return std::shared_ptr<IdxLabels> (
+      new IdxLabels (std::move (file), (int) count));
+}
@@ -0,0 +1,152 @@
+// IdxDataset.h
+
+#ifndef IDXDATASET_H
+#define IDXDATASET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "MappedFile.h"
+
+#define IDX_IMAGES_MAGIC 0x00000803  // uint8 data, 3 dimensions
+#define IDX_LABELS_MAGIC 0x00000801  // uint8 data, 1 dimension
+#define IDX_PIXEL_SCALE (1.0f / 255.0f)
+
+/**
+ * The images of an IDX file (the MNIST format): a big-endian header of the
+ * magic and the images, rows and cols numbers, then the uint8 pixels of
+ * every image, row by row. The file is memory mapped, so no image is read
+ * before it is asked for, and the pages of the images that were read can
+ * be dropped again (release) - a set larger than RAM is streamed through.
+ */
+class IdxImages
+{
+  std::shared_ptr<MappedFile> _file;
+  const uint8_t *_pixels;
+  int _count, _rows, _cols;
+
+/**
+ * IdxImages constructor, of a validated mapping
+ */
+  IdxImages (std::shared_ptr<MappedFile> file, int count, int rows,
+             int cols);
+
+ public:
+/**
+ * map an IDX images file
+ * @param path the file path
+ * @return the images, or nullptr if the file could not be mapped, is not an
+ *         IDX images file, or is truncated
+ */
+  static std::shared_ptr<IdxImages> open (const std::string &path);
+
+/**
+ * @return the images number
+ */
+  int size () const
+  {
+    return _count;
+  }
+
+/**
+ * @return the rows number of every image
+ */
+  int get_rows () const
+  {
+    return _rows;
+  }
+
+/**
+ * @return the cols number of every image
+ */
+  int get_cols () const
+  {
+    return _cols;
+  }
+
+/**
+ * @return the pixels number of every image
+ */
+  int image_size () const
+  {
+    return _rows * _cols;
+  }
+
+/**
+ * @param i an image index
+ * @return the uint8 pixels of image i, inside the mapping
+ */
+  const uint8_t *pixels (int i) const
+  {
+    return _pixels + (std::size_t) i * image_size();
+  }
+
+/**
+ * normalize images to floats in [0, 1], by the vectorized u8_to_float
+ * @param first the first image index
+ * @param n the images number
+ * @param dst n * image_size() floats: an image per row
+ */
+  void read (int first, int n, float *dst) const;
+
+/**
+ * hint that the images are read in order
+ */
+  void advise_sequential () const
+  {
+    _file->advise_sequential();
+  }
+
+/**
+ * drop the mapped pages of images that were read
+ * @param first the first image index
+ * @param n the images number
+ */
+  void release (int first, int n) const;
+};
+
+/**
+ * The labels of an IDX file: a big-endian header of the magic and the
+ * labels number, then a uint8 label per image. Memory mapped.
+ */
+class IdxLabels
+{
+  std::shared_ptr<MappedFile> _file;
+  const uint8_t *_labels;
+  int _count;
+
+/**
+ * IdxLabels constructor, of a validated mapping
+ */
+  IdxLabels (std::shared_ptr<MappedFile> file, int count);
+
+ public:
+/**
+ * map an IDX labels file
+ * @param path the file path
+ * @return the labels, or nullptr if the file could not be mapped, is not
+ *         an IDX labels file, or is truncated
+ */
+  static std::shared_ptr<IdxLabels> open (const std::string &path);
+
+/**
+ * @return the labels number
+ */
+  int size () const
+  {
+    return _count;
+  }
+
+/**
+ * @param i an image index
+ * @return the label of image i
+ */
+  unsigned int operator[] (int i) const
+  {
+    return _labels[i];
+  }
+};
+
+#endif //IDXDATASET_H
@@ -0,0 +1,662 @@
+#include "ImageDecoder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "Kernels.h"
+
+#define PNG_SIGNATURE_SIZE 8
+#define PNG_CHUNK_OVERHEAD 12  // length, type and crc
+#define PNG_IHDR_SIZE 13
+#define PNG_GRAY 0             // the grayscale color type
+#define PGM_MAX_VALUE 255
+
+#define INFLATE_MAX_BITS 15
+#define INFLATE_MAX_LCODES 286
+#define INFLATE_MAX_DCODES 30
+#define INFLATE_FIX_LCODES 288
+#define INFLATE_ADLER_MOD 65521
+
+static const uint8_t png_signature[PNG_SIGNATURE_SIZE] = {
+    0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+/**
+ * tell the format of an image file
+ * @param data the file bytes
+ * @param size the file size
+ * @return the format of its signature, IMAGE_RAW if none matches
+ */
+ImageFormat image_format (const uint8_t *data, std::size_t size)
+{
+  if (size >= PNG_SIGNATURE_SIZE
+      && std::memcmp (data, png_signature, PNG_SIGNATURE_SIZE) == 0)
+    return IMAGE_PNG;
+  if (size >= 3 && data[0] == 'P' && data[1] == '5'
+      && (data[2] == ' ' || data[2] == '\t' || data[2] == '\n'
+          || data[2] == '\r'))
+    return IMAGE_PGM;
+  return IMAGE_RAW;
+}
+
+/**
+ * @param c a character
+ * @return whether c is a pnm header white space
+ */
+static bool is_pnm_space (uint8_t c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v'
+         || c == '\f';
+}
+
+/**
+ * read a decimal field of a pnm header, after white space and comments
+ * @param data the file bytes
+ * @param size the file size
+ * @param pos the reading position, moved past the field
+ * @param value the field value
+ * @return whether a field in [1, IMAGE_MAX_PIXELS] was read
+ */
+static bool read_pnm_field (const uint8_t *data, std::size_t size,
+                            std::size_t &pos, int &value)
+{
+  while (pos < size && (is_pnm_space (data[pos]) || data[pos] == '#'))
+    {
+      if (data[pos] == '#')
+        while (pos < size && data[pos] != '\n' && data[pos] != '\r')
+          pos++;
+      else
+        pos++;
+    }
+  long v = 0;
+  std::size_t first = pos;
+  while (pos < size && data[pos] >= '0' && data[pos] <= '9'
+         && v <= IMAGE_MAX_PIXELS)
+    v = v * 10 + (data[pos++] - '0');
+  if (pos == first || v < 1 || v > IMAGE_MAX_PIXELS)
+    return false;
+  value = (int) v;
+  return true;
+}
+
+/**
+ * decode a binary pgm (P5) of a maxval up to 255
+ * @param data the file bytes
+ * @param size the file size
+ * @param img the decoded image, set on success
+ * @return whether the file is a valid pgm of 8 bits pixels
+ */
+bool decode_pgm (const uint8_t *data, std::size_t size, GrayImage &img)
+{
+  if (image_format (data, size) != IMAGE_PGM)
+    return false;
+  std::size_t pos = 2;
+  int width, height, max_value;
+  if (!read_pnm_field (data, size, pos, width)
+      || !read_pnm_field (data, size, pos, height)
+      || !read_pnm_field (data, size, pos, max_value)
+      || max_value > PGM_MAX_VALUE
+      || (long) width * height > IMAGE_MAX_PIXELS
+      || pos >= size || !is_pnm_space (data[pos]))
+    return false;
+  // a single white space separates the header from the pixels.
+  pos++;
+  if (size - pos < (std::size_t) width * height)
+    return false;
+  img = {data + pos, width, height, width, max_value};
+  return true;
+}
+
+/**
+ * read a big-endian 32 bits field of a png
+ * @param p the field bytes
+ * @return the field value
+ */
+static uint32_t read_be32 (const uint8_t *p)
+{
+  return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16
+         | (uint32_t) p[2] << 8 | (uint32_t) p[3];
+}
+
+/**
+ * the paeth predictor of a png row filter
+ * @param a the left pixel
+ * @param b the upper pixel
+ * @param c the upper left pixel
+ * @return the one of a, b, c nearest to a + b - c
+ */
+static uint8_t paeth (int a, int b, int c)
+{
+  int p = a + b - c;
+  int pa = std::abs (p - a), pb = std::abs (p - b), pc = std::abs (p - c);
+  if (pa <= pb && pa <= pc)
+    return (uint8_t) a;
+  return (uint8_t) (pb <= pc ? b : c);
+}
+
+/**
+ * undo the filters of inflated png rows, in place (a byte per pixel)
+ * @param rows the rows, each of its filter type byte and width pixels
+ * @param width the pixels number of a row
+ * @param height the rows number
+ * @return whether every filter type is valid
+ */
+static bool unfilter_png (uint8_t *rows, int width, int height)
+{
+  std::size_t stride = (std::size_t) width + 1;
+  const uint8_t *prior = nullptr;
+  for (int i = 0; i < height; i++)
+    {
+      uint8_t *row = rows + i * stride + 1;
+      uint8_t filter = row[-1];
+      switch (filter)
+        {
+          case 0:
+            break;
+          case 1:
+            for (int j = 1; j < width; j++)
+              row[j] += row[j - 1];
+            break;
+          case 2:
+            if (prior)
+              for (int j = 0; j < width; j++)
+                row[j] += prior[j];
+            break;
+          case 3:
+            for (int j = 0; j < width; j++)
+              row[j] += (uint8_t) (((j ? row[j - 1] : 0)
+                                    + (prior ? prior[j] : 0)) >> 1);
+            break;
+          case 4:
+            for (int j = 0; j < width; j++)
+              row[j] += paeth (j ? row[j - 1] : 0, prior ? prior[j] : 0,
+                               j && prior ? prior[j - 1] : 0);
+            break;
+          default:
+            return false;
+        }
+      prior = row;
+    }
+  return true;
+}
+
+/**
+ * decode a non-interlaced 8 bits grayscale png
+ * @param data the file bytes
+ * @param size the file size
+ * @param buffer the decoder buffer, grown as needed
+ * @param img the decoded image, set on success
+ * @return whether the file is a valid png of this kind
+ */
+bool decode_png (const uint8_t *data, std::size_t size,
+                 std::vector<uint8_t> &buffer, GrayImage &img)
+{
+  if (image_format (data, size) != IMAGE_PNG
+      || size < PNG_SIGNATURE_SIZE + PNG_CHUNK_OVERHEAD + PNG_IHDR_SIZE)
+    return false;
+
+  // the IHDR chunk comes first.
+  const uint8_t *ihdr = data + PNG_SIGNATURE_SIZE;
+  if (read_be32 (ihdr) != PNG_IHDR_SIZE
+      || std::memcmp (ihdr + 4, "IHDR", 4) != 0)
+    return false;
+  uint32_t width = read_be32 (ihdr + 8), height = read_be32 (ihdr + 12);
+  const uint8_t *fields = ihdr + 16;
+  if (width == 0 || height == 0
+      || (uint64_t) width * height > IMAGE_MAX_PIXELS || fields[0] != 8
+      || fields[1] != PNG_GRAY || fields[2] != 0 || fields[3] != 0
+      || fields[4] != 0)
+    return false;
+
+  // the rows (a filter byte each) are inflated in front of the buffer, from
+  // the concatenated IDAT data behind them.
+  std::size_t raw_size = ((std::size_t) width + 1) * height;
+  std::size_t idat_size = 0;
+  std::size_t pos = PNG_SIGNATURE_SIZE + PNG_CHUNK_OVERHEAD + PNG_IHDR_SIZE;
+  bool end = false;
+  while (!end)
+    {
+      if (size - pos < PNG_CHUNK_OVERHEAD)
+        return false;
+      uint32_t length = read_be32 (data + pos);
+      const uint8_t *type = data + pos + 4;
+      if (length > size - pos - PNG_CHUNK_OVERHEAD)
+        return false;
+      if (std::memcmp (type, "IDAT", 4) == 0)
+        {
+          if (buffer.size () < raw_size + idat_size + length)
+            buffer.resize (raw_size + idat_size + length);
+          std::memcpy (buffer.data () + raw_size + idat_size, type + 4,
+                       length);
+          idat_size += length;
+        }
+      else if (std::memcmp (type, "IEND", 4) == 0)
+        end = true;
+      else if (!(type[0] & 0x20))
+        return false;  // an unknown critical chunk (e.g. PLTE)
+      pos += PNG_CHUNK_OVERHEAD + length;
+    }
+
+  if (idat_size == 0
+      || !inflate_zlib (buffer.data () + raw_size, idat_size, buffer.data (),
+                        raw_size)
+      || !unfilter_png (buffer.data (), (int) width, (int) height))
+    return false;
+  img = {buffer.data () + 1, (int) width, (int) height, (int) width + 1,
+         PGM_MAX_VALUE};
+  return true;
+}
+
+namespace
+{
+/**
+ * The bit reader of a deflate stream: bits are read from the least
+ * significant bit of every byte. A read past the end sets failed, and
+ * returns zero bits.
+ */
+struct InflateState
+{
+  const uint8_t *src;
+  std::size_t size, pos;
+  uint32_t bit_buf;
+  int bit_count;
+  bool failed;
+  uint8_t *dst;
+  std::size_t dst_size, out;
+
+  /**
+   * @param n a bits number, up to 16
+   * @return the next n bits of the stream
+   */
+  int bits (int n)
+  {
+    while (bit_count < n)
+      {
+        if (pos == size)
+          {
+            failed = true;
+            return 0;
+          }
+        bit_buf |= (uint32_t) src[pos++] << bit_count;
+        bit_count += 8;
+      }
+    int value = (int) (bit_buf & ((1u << n) - 1));
+    bit_buf >>= n;
+    bit_count -= n;
+    return value;
+  }
+};
+
+/**
+ * A canonical Huffman code: the codes number of every length, and the
+ * symbols ordered by their codes.
+ */
+struct Huffman
+{
+  short count[INFLATE_MAX_BITS + 1];
+  short symbol[INFLATE_FIX_LCODES];
+};
+}
+
+/**
+ * build a canonical Huffman code of the code lengths of its symbols
+ * @param h the code
+ * @param lengths the code length of every symbol, 0 for an unused one
+ * @param n the symbols number
+ * @return 0 for a complete code, negative for an over-subscribed one,
+ *         positive for an incomplete one
+ */
+static int build_huffman (Huffman &h, const short *lengths, int n)
+{
+  std::memset (h.count, 0, sizeof (h.count));
+  for (int s = 0; s < n; s++)
+    h.count[lengths[s]]++;
+  if (h.count[0] == n)
+    return 0;
+
+  int left = 1;
+  for (int len = 1; len <= INFLATE_MAX_BITS; len++)
+    {
+      left = (left << 1) - h.count[len];
+      if (left < 0)
+        return left;
+    }
+
+  short offsets[INFLATE_MAX_BITS + 1];
+  offsets[1] = 0;
+  for (int len = 1; len < INFLATE_MAX_BITS; len++)
+    offsets[len + 1] = offsets[len] + h.count[len];
+  for (int s = 0; s < n; s++)
+    if (lengths[s] != 0)
+      h.symbol[offsets[lengths[s]]++] = (short) s;
+  return left;
+}
+
+/**
+ * decode a symbol of the stream, a code bit at a time
+ * @param s the stream
+ * @param h the code
+ * @return the symbol, or -1 on a code out of h (or past the stream end)
+ */
+static int decode_symbol (InflateState &s, const Huffman &h)
+{
+  int code = 0, first = 0, index = 0;
+  for (int len = 1; len <= INFLATE_MAX_BITS; len++)
+    {
+      code |= s.bits (1);
+      if (s.failed)
+        return -1;
+      int count = h.count[len];
+      if (code - count < first)
+        return h.symbol[index + (code - first)];
+      index += count;
+      first = (first + count) << 1;
+      code <<= 1;
+    }
+  return -1;
+}
+
+/**
+ * inflate a stored block: its length, the length complement and the bytes
+ * @param s the stream, at the block after its header bits
+ * @return whether the block is valid
+ */
+static bool inflate_stored (InflateState &s)
+{
+  // the block starts at the next byte boundary.
+  s.bit_buf = 0;
+  s.bit_count = 0;
+  if (s.size - s.pos < 4)
+    return false;
+  unsigned len = s.src[s.pos] | s.src[s.pos + 1] << 8;
+  unsigned nlen = s.src[s.pos + 2] | s.src[s.pos + 3] << 8;
+  s.pos += 4;
+  if (len != (~nlen & 0xffff) || s.size - s.pos < len
+      || s.dst_size - s.out < len)
+    return false;
+  std::memcpy (s.dst + s.out, s.src + s.pos, len);
+  s.pos += len;
+  s.out += len;
+  return true;
+}
+
+/**
+ * inflate the symbols of a Huffman block, up to its end symbol
+ * @param s the stream
+ * @param lencode the literal/length code
+ * @param distcode the distance code
+ * @return whether the block is valid
+ */
+static bool inflate_codes (InflateState &s, const Huffman &lencode,
+                           const Huffman &distcode)
+{
+  static const short length_base[29] = {
+      3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51,
+      59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+  static const short length_extra[29] = {
+      0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4,
+      4, 5, 5, 5, 5, 0};
+  static const short dist_base[30] = {
+      1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385,
+      513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385,
+      24577};
+  static const short dist_extra[30] = {
+      0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10,
+      10, 11, 11, 12, 12, 13, 13};
+
+  for (;;)
+    {
+      int symbol = decode_symbol (s, lencode);
+      if (symbol < 0)
+        return false;
+      if (symbol < 256)
+        {
+          if (s.out == s.dst_size)
+            return false;
+          s.dst[s.out++] = (uint8_t) symbol;
+          continue;
+        }
+      if (symbol == 256)
+        return true;
+
+      symbol -= 257;
+      if (symbol >= 29)
+        return false;
+      std::size_t len = length_base[symbol] + s.bits (length_extra[symbol]);
+      symbol = decode_symbol (s, distcode);
+      if (symbol < 0 || symbol >= 30)
+        return false;
+      std::size_t dist = dist_base[symbol] + s.bits (dist_extra[symbol]);
+      if (s.failed || dist > s.out || s.dst_size - s.out < len)
+        return false;
+      // the copy may overlap its own output (dist < len): byte by byte.
+      uint8_t *out = s.dst + s.out;
+      for (std::size_t i = 0; i < len; i++)
+        out[i] = out[(std::ptrdiff_t) i - (std::ptrdiff_t) dist];
+      s.out += len;
+    }
+}
+
+/**
+ * inflate a block of the fixed Huffman codes
+ * @param s the stream
+ * @return whether the block is valid
+ */
+static bool inflate_fixed (InflateState &s)
+{
+  struct FixedCodes
+  {
+    Huffman lencode, distcode;
+
+    FixedCodes ()
+    {
+      short lengths[INFLATE_FIX_LCODES];
+      int s = 0;
+      for (; s < 144; s++)
+        lengths[s] = 8;
+      for (; s < 256; s++)
+        lengths[s] = 9;
+      for (; s < 280; s++)
+        lengths[s] = 7;
+      for (; s < INFLATE_FIX_LCODES; s++)
+        lengths[s] = 8;
+      build_huffman (lencode, lengths, INFLATE_FIX_LCODES);
+      for (s = 0; s < INFLATE_MAX_DCODES; s++)
+        lengths[s] = 5;
+      build_huffman (distcode, lengths, INFLATE_MAX_DCODES);
+    }
+  };
+  static const FixedCodes fixed;
+  return inflate_codes (s, fixed.lencode, fixed.distcode);
+}
+
+/**
+ * inflate a block of dynamic Huffman codes: the code lengths of the codes,
+ * themselves Huffman coded, then the symbols
+ * @param s the stream
+ * @return whether the block is valid
+ */
+static bool inflate_dynamic (InflateState &s)
+{
+  static const short order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4,
+                                  12, 3, 13, 2, 14, 1, 15};
+  int nlen = s.bits (5) + 257, ndist = s.bits (5) + 1;
+  int ncode = s.bits (4) + 4;
+  if (s.failed || nlen > INFLATE_MAX_LCODES || ndist > INFLATE_MAX_DCODES)
+    return false;
+
+  short lengths[INFLATE_MAX_LCODES + INFLATE_MAX_DCODES] = {};
+  for (int i = 0; i < ncode; i++)
+    lengths[order[i]] = (short) s.bits (3);
+  Huffman lencode, distcode;
+  if (s.failed || build_huffman (lencode, lengths, 19) != 0)
+    return false;
+
+  for (int i = 0; i < nlen + ndist;)
+    {
+      int symbol = decode_symbol (s, lencode);
+      if (symbol < 0)
+        return false;
+      if (symbol < 16)
+        {
+          lengths[i++] = (short) symbol;
+          continue;
+        }
+      short len = 0;
+      int repeat;
+      if (symbol == 16)
+        {
+          if (i == 0)
+            return false;
+          len = lengths[i - 1];
+          repeat = 3 + s.bits (2);
+        }
+      else if (symbol == 17)
+        repeat = 3 + s.bits (3);
+      else
+        repeat = 11 + s.bits (7);
+      if (s.failed || i + repeat > nlen + ndist)
+        return false;
+      while (repeat--)
+        lengths[i++] = len;
+    }
+  if (lengths[256] == 0)
+    return false;
+
+  // an incomplete code is only valid of a single code.
+  int err = build_huffman (lencode, lengths, nlen);
+  if (err < 0 || (err > 0 && nlen - lencode.count[0] != 1))
+    return false;
+  err = build_huffman (distcode, lengths + nlen, ndist);
+  if (err < 0 || (err > 0 && ndist - distcode.count[0] != 1))
+    return false;
+  return inflate_codes (s, lencode, distcode);
+}
+
+/**
+ * inflate a zlib stream
+ * @param src the stream bytes
+ * @param size the stream size
+ * @param dst the output
+ * @param dst_size the expected output size
+ * @return whether the stream is valid and inflates to exactly dst_size
+ *         bytes
+ */
+bool inflate_zlib (const uint8_t *src, std::size_t size, uint8_t *dst,
+                   std::size_t dst_size)
+{
+  // the header: deflate (8) with a window up to 32K, no preset dictionary.
+  if (size < 6 || (src[0] & 0x0f) != 8 || (src[0] >> 4) > 7
+      || (src[0] << 8 | src[1]) % 31 != 0 || (src[1] & 0x20))
+    return false;
+
+  InflateState s = {src, size, 2, 0, 0, false, dst, dst_size, 0};
+  int last;
+  do
+    {
+      last = s.bits (1);
+      int type = s.bits (2);
+      bool ok;
+      if (s.failed)
+        return false;
+      if (type == 0)
+        ok = inflate_stored (s);
+      else if (type == 1)
+        ok = inflate_fixed (s);
+      else if (type == 2)
+        ok = inflate_dynamic (s);
+      else
+        return false;
+      if (!ok || s.failed)
+        return false;
+    }
+  while (!last);
+
+  // the adler32 of the output follows, at the next byte boundary.
+  if (s.out != dst_size || s.size - s.pos < 4)
+    return false;
+  uint32_t a = 1, b = 0;
+  for (std::size_t i = 0; i < dst_size;)
+    {
+      // 5552 bytes keep b under 2^32 before the modulo.
+      std::size_t end = dst_size - i < 5552 ? dst_size : i + 5552;
+      for (; i < end; i++)
+        {
+          a += dst[i];
+          b += a;
+        }
+      a %= INFLATE_ADLER_MOD;
+      b %= INFLATE_ADLER_MOD;
+    }
+  return read_be32 (s.src + s.pos) == (b << 16 | a);
+}
+
+/**
+ * normalize an image to floats in [0, 1] and resample it to rows x cols
+ * by area averaging
+ * @param img the image
+ * @param dst rows * cols floats, row by row
+ * @param rows the output rows-size
+ * @param cols the output cols-size
+ */
+void normalize_resize (const GrayImage &img, float *dst, int rows, int cols)
+{
+  float scale = 1.0f / (float) img.max_value;
+  if (img.width == cols && img.height == rows)
+    {
+      for (int i = 0; i < rows; i++)
+        u8_to_float (img.pixels + (std::size_t) i * img.stride, scale,
+                     dst + (std::size_t) i * cols, cols);
+      return;
+    }
+
+  // every output row is the weighted sum of the input rows it covers (a
+  // fraction of the first and last ones), then every output pixel the
+  // weighted sum of the columns of that sum it covers: the columns weights
+  // are the same for every row.
+  thread_local std::vector<float> sums, col_weights;
+  thread_local std::vector<int> col_first, col_count;
+  sums.resize (img.width);
+  col_weights.clear ();
+  col_first.resize (cols);
+  col_count.resize (cols);
+  double x_step = (double) img.width / cols;
+  for (int j = 0; j < cols; j++)
+    {
+      double x0 = j * x_step, x1 = x0 + x_step;
+      int c1 = std::min ((int) std::ceil (x1), img.width);
+      col_first[j] = (int) x0;
+      col_count[j] = c1 - (int) x0;
+      for (int c = (int) x0; c < c1; c++)
+        col_weights.push_back ((float) ((std::min (c + 1.0, x1)
+                                         - std::max ((double) c, x0))
+                                        / x_step));
+    }
+
+  double y_step = (double) img.height / rows;
+  for (int i = 0; i < rows; i++)
+    {
+      std::fill (sums.begin (), sums.end (), 0.0f);
+      double y0 = i * y_step, y1 = y0 + y_step;
+      int r1 = std::min ((int) std::ceil (y1), img.height);
+      for (int r = (int) y0; r < r1; r++)
+        {
+          double weight = std::min (r + 1.0, y1) - std::max ((double) r, y0);
+          if (weight > 0)
+            u8_accumulate (img.pixels + (std::size_t) r * img.stride,
+                           (float) (weight / y_step) * scale, sums.data (),
+                           img.width);
+        }
+      const float *weights = col_weights.data ();
+      for (int j = 0; j < cols; j++)
+        {
+          const float *x = sums.data () + col_first[j];
+          float sum = 0;
+          for (int c = 0; c < col_count[j]; c++)
+            sum += x[c] * weights[c];
+          weights += col_count[j];
+          dst[(std::size_t) i * cols + j] = sum;
+        }
+    }
+}
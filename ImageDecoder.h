@@ -0,0 +1,91 @@
+// ImageDecoder.h
+
+#ifndef IMAGEDECODER_H
+#define IMAGEDECODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define IMAGE_MAX_PIXELS (1 << 26)
+
+/**
+ * @enum ImageFormat
+ * @brief The format of an image file, told by its first bytes.
+ */
+enum ImageFormat
+{
+    IMAGE_RAW,      // anything else: raw float32 pixels
+    IMAGE_PGM,      // binary 8 bits graymap, "P5"
+    IMAGE_PNG       // png, of its 8 bytes signature
+};
+
+/**
+ * A decoded 8 bits grayscale image: a view of its pixels, in the file bytes
+ * (pgm) or in the decoder buffer (png). Valid while they are.
+ */
+struct GrayImage
+{
+  const uint8_t *pixels;  // the (0,0) pixel
+  int width, height;
+  int stride;             // the distance between two rows beginnings
+  int max_value;          // the white pixel value (255, or a pgm maxval)
+};
+
+/**
+ * tell the format of an image file
+ * @param data the file bytes
+ * @param size the file size
+ * @return the format of its signature, IMAGE_RAW if none matches
+ */
+ImageFormat image_format (const uint8_t *data, std::size_t size);
+
+/**
+ * decode a binary pgm (P5) of a maxval up to 255: a header of the width,
+ * the height and the maxval (white space separated, '#' comments), then the
+ * pixels, row by row. The pixels are not copied.
+ * @param data the file bytes
+ * @param size the file size
+ * @param img the decoded image, set on success
+ * @return whether the file is a valid pgm of 8 bits pixels
+ */
+bool decode_pgm (const uint8_t *data, std::size_t size, GrayImage &img);
+
+/**
+ * decode a non-interlaced 8 bits grayscale png: its IDAT chunks are
+ * inflated (inflate_zlib) and unfiltered in place, in the buffer.
+ * @param data the file bytes
+ * @param size the file size
+ * @param buffer the decoder buffer, grown as needed, reused across calls
+ * @param img the decoded image, set on success
+ * @return whether the file is a valid png of this kind
+ */
+bool decode_png (const uint8_t *data, std::size_t size,
+                 std::vector<uint8_t> &buffer, GrayImage &img);
+
+/**
+ * inflate a zlib stream (RFC 1950, RFC 1951): stored, fixed and dynamic
+ * Huffman blocks, checked against the stream adler32.
+ * @param src the stream bytes
+ * @param size the stream size
+ * @param dst the output
+ * @param dst_size the expected output size
+ * @return whether the stream is valid and inflates to exactly dst_size
+ *         bytes
+ */
+bool inflate_zlib (const uint8_t *src, std::size_t size, uint8_t *dst,
+                   std::size_t dst_size);
+
+/**
+ * normalize an image to floats in [0, 1] (pixel / max_value) and resample
+ * it to rows x cols by area averaging: every output pixel is the mean of
+ * the input area it covers. The input rows are accumulated by the
+ * vectorized u8_accumulate (u8_to_float if no resampling is needed).
+ * @param img the image
+ * @param dst rows * cols floats, row by row
+ * @param rows the output rows-size
+ * @param cols the output cols-size
+ */
+void normalize_resize (const GrayImage &img, float *dst, int rows, int cols);
+
+#endif //IMAGEDECODER_H
@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "ImageDecoder.h"
+#include "ImageFile.h"
+#include "MlpNetwork.h"
+#include "Trace.h"
+
+#define MAX_DIGIT 9
+#define IMAGE_SIGNATURE_SIZE 8
+
+/**
+ * Decodes a pgm or png file into a matrix of img_dims size (or of the
+ * matrix dimensions, for a matrix of another size): the pixels are
+ * normalized and resized straight into the matrix.
+ * @param data - the file bytes
+ * @param size - the file size
+ * @param format - the file format
+ * @param mat - matrix to decode the file into.
+ * @return boolean status
+ *          true - success
+ *          false - failure: the file is not a supported image
+ */
+static bool decodeToMatrix(const uint8_t *data, std::size_t size,
+    ImageFormat format, Matrix &mat)
+{
+    thread_local std::vector<uint8_t> decodeBuffer;
+    GrayImage img;
+    if(format == IMAGE_PGM ? !decode_pgm(data, size, img) :
+       !decode_png(data, size, decodeBuffer, img))
+    {
+        return false;
+    }
+
+    int rows = mat.get_rows(), cols = mat.get_cols();
+    if((long int) rows * cols == (long int) img_dims.rows * img_dims.cols)
+    {
+        rows = img_dims.rows;
+        cols = img_dims.cols;
+    }
+    normalize_resize(img, mat.data(), rows, cols);
+    return true;
+}
+
+/**
+ * Given an image file path and a matrix,
+ * reads the content of the file into the matrix.
+ * The file is either raw float32 pixels, which must match the matrix in
+ * size, or an 8 bits grayscale pgm or png image of any size, which is
+ * resized to the matrix (see decodeToMatrix).
+ * @param filePath - path of the image file to read
+ * @param mat -  matrix to read the file into.
+ * @return boolean status
+ *          true - success
+ *          false - failure
+ */
+bool readFileToMatrix(const std::string &filePath, Matrix &mat)
+{
+    TRACE_SCOPE("read_image");
+    std::ifstream is;
+    is.open(filePath, std::ios::in | std::ios::binary | std::ios::ate);
+    if(!is.is_open())
+    {
+        return false;
+    }
+
+    long int fileSize = is.tellg();
+    if(fileSize < 0)
+    {
+        is.close();
+        return false;
+    }
+    uint8_t signature[IMAGE_SIGNATURE_SIZE] = {};
+    is.seekg(0, std::ios_base::beg);
+    is.read((char *) signature, std::min(fileSize,
+                                         (long int) IMAGE_SIGNATURE_SIZE));
+    ImageFormat format = image_format(signature, is.gcount());
+    if(format != IMAGE_RAW)
+    {
+        // the whole file is read once, and decoded from the buffer.
+        thread_local std::vector<uint8_t> fileBuffer;
+        fileBuffer.resize(fileSize);
+        is.seekg(0, std::ios_base::beg);
+        is.read((char *) fileBuffer.data(), fileSize);
+        bool valid = is.gcount() == fileSize &&
+            decodeToMatrix(fileBuffer.data(), fileSize, format, mat);
+        is.close();
+        TRACE_COUNT("image_bytes", fileSize);
+        return valid;
+    }
+
+    long int matByteSize = (long int) mat.get_cols () * mat.get_rows ()  *
+        sizeof(float);
+    if(fileSize != matByteSize)
+    {
+        is.close();
+        return false;
+    }
+
+    is.seekg(0, std::ios_base::beg);
+    read_binary_file (is, mat);
+    is.close();
+    TRACE_COUNT("image_bytes", matByteSize);
+    return true;
+}
+
+/**
+ * Reads a labeled images list: a line per image, its file path and its
+ * digit (0-9).
+ * @param listPath - path of the list file
+ * @param imageSize - the number of floats of every image file
+ * @param images - the images, an image per row (#images x imageSize)
+ * @param labels - the digit of every image
+ * @return boolean status
+ *          true - success
+ *          false - failure
+ */
+bool readLabeledImages(const std::string &listPath, int imageSize,
+    Matrix &images, std::vector<unsigned int> &labels)
+{
+    std::ifstream list(listPath);
+    if(!list.is_open())
+    {
+        return false;
+    }
+
+    std::vector<float> pixels;
+    std::vector<unsigned int> digits;
+    Matrix img(imageSize, 1);
+    std::string line;
+    while(std::getline(list, line))
+    {
+        std::istringstream fields(line);
+        std::string imagePath;
+        int label;
+        if(!(fields >> imagePath))
+        {
+            continue;
+        }
+        if(!(fields >> label) || label < 0 || label > MAX_DIGIT ||
+           !readFileToMatrix(imagePath, img))
+        {
+            return false;
+        }
+        pixels.insert(pixels.end(), img.data(), img.data() + imageSize);
+        digits.push_back((unsigned int) label);
+    }
+    if(digits.empty())
+    {
+        return false;
+    }
+
+    images = Matrix((int) digits.size(), imageSize);
+    std::memcpy(images.data(), pixels.data(), sizeof(float) * pixels.size());
+    labels = digits;
+    return true;
+}
@@ -0,0 +1,41 @@
+// ImageFile.h
+
+#ifndef IMAGEFILE_H
+#define IMAGEFILE_H
+
+#include <string>
+#include <vector>
+
+#include "Matrix.h"
+
+/**
+ * Given an image file path and a matrix,
+ * reads the content of the file into the matrix.
+ * The file is either raw float32 pixels, which must match the matrix in
+ * size, or an 8 bits grayscale pgm (P5) or png image of any size: it is
+ * decoded, normalized to [0, 1] and resized to img_dims (or to the matrix
+ * dimensions, for a matrix of another size) straight into the matrix.
+ * @param filePath - path of the image file to read
+ * @param mat -  matrix to read the file into.
+ * @return boolean status
+ *          true - success
+ *          false - failure
+ */
+bool readFileToMatrix(const std::string &filePath, Matrix &mat);
+
+/**
+ * Reads a labeled images list: a line per image, its file path and its
+ * digit (0-9), separated by white space. Empty lines are skipped.
+ * @param listPath - path of the list file
+ * @param imageSize - the number of floats of every image file
+ * @param images - the images, an image per row (#images x imageSize)
+ * @param labels - the digit of every image
+ * @return boolean status
+ *          true - success
+ *          false - failure: the list could not be read, a line is
+ *                  malformed, an image is invalid, or there are no images
+ */
+bool readLabeledImages(const std::string &listPath, int imageSize,
+    Matrix &images, std::vector<unsigned int> &labels);
+
+#endif //IMAGEFILE_H
@@ -0,0 +1,74 @@
+#include "InferenceClient.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstring>
+
+/**
+ * connect to a server
+ * @param socket_path the server socket path
+ * @return the client, or nullptr if the server could not be reached
+ */
+std::shared_ptr<InferenceClient> InferenceClient::connect (
+    const std::string &socket_path)
+{
+  struct sockaddr_un addr;
+  std::memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof (addr.sun_path))
+    return nullptr;
+  std::memcpy (addr.sun_path, socket_path.c_str(), socket_path.size());
+
+  int fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return nullptr;
+  if (::connect (fd, (struct sockaddr *) &addr, sizeof (addr)) != 0)
+    {
+      close (fd);
+      return nullptr;
+    }
+  return std::shared_ptr<InferenceClient> (new InferenceClient (fd));
+}
+
+/**
+ * InferenceClient destructor, closes the connection
+ */
+InferenceClient::~InferenceClient ()
+{
+  close (_fd);
+}
+
+/**
+ * classify an image on the server
+ * @param image the image, of img_dims size (any shape)
+ * @param result set to the identified digit
+ * @return false if the connection failed
+ */
+bool InferenceClient::classify (const Matrix &image, digit &result)
+{
+  ServerRequestHeader header = {SERVER_OP_CLASSIFY};
+  ServerDigitReply reply;
+  std::size_t img_bytes = sizeof (float) * image.get_rows()
+                          * image.get_cols();
+  if (!write_full (_fd, &header, sizeof (header))
+      || !write_full (_fd, image.data(), img_bytes)
+      || !read_full (_fd, &reply, sizeof (reply)))
+    return false;
+  result.value = reply.value;
+  result.probability = reply.probability;
+  return true;
+}
+
+/**
+ * get the server counters
+ * @param stats set to the counters
+ * @return false if the connection failed
+ */
+bool InferenceClient::stats (ServerStatsReply &stats)
+{
+  ServerRequestHeader header = {SERVER_OP_STATS};
+  return write_full (_fd, &header, sizeof (header))
+         && read_full (_fd, &stats, sizeof (stats));
+}
@@ -0,0 +1,60 @@
+// InferenceClient.h
+
+#ifndef INFERENCECLIENT_H
+#define INFERENCECLIENT_H
+
+#include <memory>
+#include <string>
+
+#include "Digit.h"
+#include "Matrix.h"
+#include "ServerProtocol.h"
+
+/**
+ * A connection to a local InferenceServer. A client is used by one thread
+ * at a time; concurrent requests use a client each.
+ */
+class InferenceClient
+{
+  int _fd;
+
+/**
+ * InferenceClient constructor, takes over a connected socket
+ * @param fd the socket
+ */
+  explicit InferenceClient (int fd) : _fd(fd) {}
+
+ public:
+/**
+ * connect to a server
+ * @param socket_path the server socket path
+ * @return the client, or nullptr if the server could not be reached
+ */
+  static std::shared_ptr<InferenceClient> connect (const std::string
+                                                   &socket_path);
+
+  InferenceClient (const InferenceClient &oth) = delete;
+  InferenceClient &operator= (const InferenceClient &rhs) = delete;
+
+/**
+ * InferenceClient destructor, closes the connection
+ */
+  ~InferenceClient ();
+
+/**
+ * classify an image on the server
+ * @param image the image, of img_dims size (any shape)
+ * @param result set to the identified digit
+ * @return false if the connection failed
+ */
+  bool classify (const Matrix &image, digit &result);
+
+/**
+ * get the server counters
+ * @param stats set to the counters
+ * @return false if the connection failed
+ */
+  bool stats (ServerStatsReply &stats);
+};
+
+#endif //INFERENCECLIENT_H
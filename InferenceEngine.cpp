@@ -0,0 +1,238 @@
+#include "InferenceEngine.h"
+
+#include <algorithm>
+
+#include "ImageFile.h"
+
+#define CHUNKS_PER_WORKER 4
+#define MAX_CHUNK_SIZE 256
+#define EVAL_BATCH 64           // the images of a classify_batch
+#define EVAL_CHUNK 1024         // the images of an evaluation task
+#define INVALID_EVAL_SET "Error: the images must match the network input " \
+                         "size, a label per image, each a network " \
+                         "output.\n"
+
+/**
+ * the number of items of every task of a classify_all call: enough tasks to
+ * balance the workers through stealing, few enough to keep the queueing cost
+ * negligible
+ */
+static std::size_t chunk_size (std::size_t n, int threads)
+{
+  std::size_t chunks = (std::size_t) threads * CHUNKS_PER_WORKER;
+  std::size_t size = (n + chunks - 1) / chunks;
+  return std::max ((std::size_t) 1, std::min (size,
+                                              (std::size_t) MAX_CHUNK_SIZE));
+}
+
+/**
+ * the InferenceEngine constructor, starts the workers
+ * @param mlp the network to evaluate (its weights are shared, not copied)
+ * @param threads the workers number, at least 1
+ */
+InferenceEngine::InferenceEngine (const MlpNetwork &mlp, int threads)
+    : _mlp(mlp), _scratch(std::max (threads, 1)), _pool(threads)
+{
+  for (WorkerScratch &s : _scratch)
+    s.image = Matrix (img_dims.rows * img_dims.cols, 1);
+}
+
+/**
+ * @return the scratch buffers of the calling worker
+ */
+InferenceEngine::WorkerScratch &InferenceEngine::scratch ()
+{
+  return _scratch[_pool.current_worker()];
+}
+
+/**
+ * classify a range of images, on the calling worker
+ */
+void InferenceEngine::classify_range (const Matrix *images, digit *results,
+                                      std::size_t n)
+{
+  MlpWorkspace &ws = scratch().ws;
+  for (std::size_t i = 0; i < n; i++)
+    results[i] = _mlp (images[i], ws);
+}
+
+/**
+ * read and classify a range of image files, on the calling worker
+ */
+void InferenceEngine::classify_range (const std::string *paths,
+                                      ImageResult *results, std::size_t n)
+{
+  // the image buffer is already a vector: the file is read in place,
+  // without a vectorize copy.
+  WorkerScratch &s = scratch();
+  for (std::size_t i = 0; i < n; i++)
+    {
+      results[i].valid = readFileToMatrix (paths[i], s.image);
+      if (results[i].valid)
+        results[i].result = _mlp (s.image, s.ws);
+    }
+}
+
+/**
+ * classify an image asynchronously
+ * @param image the image vector (copied), of img_dims size
+ * @return a future of the identified digit
+ */
+std::future<digit> InferenceEngine::submit (const Matrix &image)
+{
+  return _pool.submit ([this, image] () {
+      return _mlp (image, scratch().ws);
+  });
+}
+
+/**
+ * read and classify an image file asynchronously
+ * @param path the image file path
+ * @return a future of the file classification
+ */
+std::future<ImageResult> InferenceEngine::submit (const std::string &path)
+{
+  return _pool.submit ([this, path] () {
+      ImageResult result;
+      classify_range (&path, &result, 1);
+      return result;
+  });
+}
+
+/**
+ * classify images on all the workers, and wait for the results
+ * @param images the image vectors, of img_dims size each
+ * @return the identified digits, in images order
+ */
+std::vector<digit> InferenceEngine::classify_all (const std::vector<Matrix>
+                                                  &images)
+{
+  std::vector<digit> results (images.size());
+  std::size_t chunk = chunk_size (images.size(), get_threads());
+  std::vector<std::future<void>> done;
+  for (std::size_t i = 0; i < images.size(); i += chunk)
+    {
+      std::size_t n = std::min (chunk, images.size() - i);
+      done.push_back (_pool.submit ([this, &images, &results, i, n] () {
+          classify_range (&images[i], &results[i], n);
+      }));
+    }
+  for (std::future<void> &f : done)
+    f.get();
+  return results;
+}
+
+/**
+ * read and classify image files on all the workers, and wait for the results
+ * @param paths the image file paths
+ * @return the files classifications, in paths order
+ */
+std::vector<ImageResult> InferenceEngine::classify_all (
+    const std::vector<std::string> &paths)
+{
+  std::vector<ImageResult> results (paths.size());
+  std::size_t chunk = chunk_size (paths.size(), get_threads());
+  std::vector<std::future<void>> done;
+  for (std::size_t i = 0; i < paths.size(); i += chunk)
+    {
+      std::size_t n = std::min (chunk, paths.size() - i);
+      done.push_back (_pool.submit ([this, &paths, &results, i, n] () {
+          classify_range (&paths[i], &results[i], n);
+      }));
+    }
+  for (std::future<void> &f : done)
+    f.get();
+  return results;
+}
+
+/**
+ * classify a range of labeled images in batches, on the calling worker
+ * @param images the images
+ * @param labels the label of every image
+ * @param first the first image index
+ * @param n the images number
+ * @return the confusion counts of the range
+ */
+std::vector<long> InferenceEngine::evaluate_range (const IdxImages &images,
+                                                   const IdxLabels &labels,
+                                                   int first, int n)
+{
+  int classes = _mlp.get_output_size(), size = images.image_size();
+  std::vector<long> confusion ((std::size_t) classes * classes, 0);
+  WorkerScratch &s = scratch();
+  for (int i = first; i < first + n; i += EVAL_BATCH)
+    {
+      int b = std::min (EVAL_BATCH, first + n - i);
+      // the images are normalized an image per row, then transposed into
+      // the input vector per column of the batch.
+      s.rows.resize (b, size);
+      images.read (i, b, s.rows.data());
+      s.batch.resize (size, b);
+      copy_view (s.rows.view().transposed(), s.batch.view());
+      std::vector<digit> results = _mlp.classify_batch (s.batch);
+      for (int j = 0; j < b; j++)
+        {
+          unsigned int label = labels[i + j];
+          confusion[label * classes + results[j].value]++;
+        }
+    }
+  return confusion;
+}
+
+/**
+ * classify a labeled images set on all the workers, in batches
+ * @param images the images
+ * @param labels the label of every image
+ * @return the set measures
+ */
+EvalStats InferenceEngine::evaluate (const IdxImages &images,
+                                     const IdxLabels &labels)
+{
+  if (images.image_size() != _mlp.get_input_size()
+      || images.size() != labels.size())
+    {
+      std::cerr << INVALID_EVAL_SET << std::endl;
+      exit (EXIT_FAILURE);
+    }
+  // a label out of the confusion matrix would be counted in no class.
+  for (int i = 0; i < labels.size(); i++)
+    if (labels[i] >= (unsigned int) _mlp.get_output_size())
+      {
+        std::cerr << INVALID_EVAL_SET << std::endl;
+        exit (EXIT_FAILURE);
+      }
+
+  EvalStats stats;
+  stats.images = images.size();
+  stats.classes = _mlp.get_output_size();
+  stats.confusion.assign ((std::size_t) stats.classes * stats.classes, 0);
+  images.advise_sequential();
+
+  // a window of tasks at a time: its pages are dropped once it is done.
+  long window = (long) get_threads() * CHUNKS_PER_WORKER * EVAL_CHUNK;
+  std::vector<std::future<std::vector<long>>> done;
+  for (long start = 0; start < images.size(); start += window)
+    {
+      int end = (int) std::min ((long) images.size(), start + window);
+      for (int i = (int) start; i < end; i += EVAL_CHUNK)
+        {
+          int n = std::min (EVAL_CHUNK, end - i);
+          done.push_back (_pool.submit ([this, &images, &labels, i, n] () {
+              return evaluate_range (images, labels, i, n);
+          }));
+        }
+      for (std::future<std::vector<long>> &f : done)
+        {
+          std::vector<long> confusion = f.get();
+          for (std::size_t c = 0; c < confusion.size(); c++)
+            stats.confusion[c] += confusion[c];
+        }
+      done.clear();
+      images.release ((int) start, end - (int) start);
+    }
+
+  stats.correct = 0;
+  for (int c = 0; c < stats.classes; c++)
+    stats.correct += stats.confusion[(std::size_t) c * stats.classes + c];
+  return stats;
+}
@@ -0,0 +1,148 @@
+// InferenceEngine.h
+
+#ifndef INFERENCEENGINE_H
+#define INFERENCEENGINE_H
+
+#include <future>
+#include <string>
+#include <vector>
+
+#include "IdxDataset.h"
+#include "MlpNetwork.h"
+#include "ThreadPool.h"
+
+/**
+ * @struct ImageResult
+ * @brief The classification of an image file.
+ * @var valid - whether the file was read (existing, of the image size)
+ * @var result - the identified digit, when valid
+ */
+struct ImageResult
+{
+    bool valid;
+    digit result;
+};
+
+/**
+ * @struct EvalStats
+ * @brief The measures of a labeled images set.
+ * @var images - the images number
+ * @var correct - the correctly classified images number
+ * @var classes - the network outputs number
+ * @var confusion - classes x classes counts, row by row: a row per label, a
+ *                  col per predicted digit
+ */
+struct EvalStats
+{
+    long images;
+    long correct;
+    int classes;
+    std::vector<long> confusion;
+};
+
+/**
+ * Classifies images on a fixed pool of worker threads. Every worker
+ * evaluates the network in its own scratch buffers (the layer outputs and an
+ * image buffer), so the workers share nothing but the read-only weights.
+ */
+class InferenceEngine
+{
+/**
+ * @struct WorkerScratch
+ * @brief The buffers of a single worker, on their own cache lines.
+ */
+  struct alignas(64) WorkerScratch
+  {
+    MlpWorkspace ws;
+    Matrix image;
+    Matrix rows, batch;   // the images of an evaluation batch
+  };
+
+  MlpNetwork _mlp;
+  std::vector<WorkerScratch> _scratch;
+  ThreadPool _pool;
+
+/**
+ * @return the scratch buffers of the calling worker
+ */
+  WorkerScratch &scratch ();
+
+/**
+ * classify a range of images, on the calling worker
+ */
+  void classify_range (const Matrix *images, digit *results, std::size_t n);
+
+/**
+ * read and classify a range of image files, on the calling worker
+ */
+  void classify_range (const std::string *paths, ImageResult *results,
+                       std::size_t n);
+
+/**
+ * classify a range of labeled images in batches, on the calling worker
+ * @return the confusion counts of the range
+ */
+  std::vector<long> evaluate_range (const IdxImages &images,
+                                    const IdxLabels &labels, int first,
+                                    int n);
+
+ public:
+/**
+ * the InferenceEngine constructor, starts the workers
+ * @param mlp the network to evaluate (its weights are shared, not copied)
+ * @param threads the workers number, at least 1
+ */
+  InferenceEngine (const MlpNetwork &mlp, int threads);
+
+/**
+ * @return the workers number
+ */
+  int get_threads () const
+  {
+    return _pool.size();
+  }
+
+/**
+ * classify an image asynchronously
+ * @param image the image vector (copied), of img_dims size
+ * @return a future of the identified digit
+ */
+  std::future<digit> submit (const Matrix &image);
+
+/**
+ * read and classify an image file asynchronously
+ * @param path the image file path
+ * @return a future of the file classification
+ */
+  std::future<ImageResult> submit (const std::string &path);
+
+/**
+ * classify images on all the workers, and wait for the results
+ * @param images the image vectors, of img_dims size each
+ * @return the identified digits, in images order
+ */
+  std::vector<digit> classify_all (const std::vector<Matrix> &images);
+
+/**
+ * read and classify image files on all the workers, and wait for the results
+ * @param paths the image file paths
+ * @return the files classifications, in paths order
+ */
+  std::vector<ImageResult> classify_all (const std::vector<std::string>
+                                         &paths);
+
+/**
+ * classify a labeled images set on all the workers, in batches. the
+ * images are normalized from the mapping batch by batch, and the pages of
+ * every window of batches are dropped once it is classified, so the set
+ * may be larger than RAM.
+ * exits (code == 1) if the images are not of the network input size, the
+ * labels number does not match, or a label is not a network output.
+ * @param images the images
+ * @param labels the label of every image
+ * @return the set measures
+ */
+  EvalStats evaluate (const IdxImages &images, const IdxLabels &labels);
+};
+
+#endif //INFERENCEENGINE_H
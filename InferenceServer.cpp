@@ -0,0 +1,226 @@
+#include "InferenceServer.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#define SERVER_LATENCY_WINDOW 8192
+#define SERVER_LISTEN_BACKLOG 64
+#define P50 0.50
+#define P99 0.99
+
+/**
+ * the InferenceServer constructor
+ * @param mlp the network (its weights are shared, not copied)
+ * @param max_batch the largest batch size, at least 1
+ * @param max_delay_us the longest time in microseconds a request waits for
+ *        more requests to join its batch
+ */
+InferenceServer::InferenceServer (const MlpNetwork &mlp, int max_batch,
+                                  int max_delay_us)
+    : _mlp(mlp), _max_batch(std::max (max_batch, 1)),
+      _max_delay(std::max (max_delay_us, 0)), _requests(0), _batches(0),
+      _max_queue_depth(0), _latency_next(0)
+{
+  _latencies_us.reserve (SERVER_LATENCY_WINDOW);
+}
+
+/**
+ * a percentile of sorted values
+ */
+static float percentile (const std::vector<float> &sorted, double p)
+{
+  if (sorted.empty())
+    return 0;
+  std::size_t idx = (std::size_t) (p * (double) (sorted.size() - 1) + 0.5);
+  return sorted[idx];
+}
+
+/**
+ * @return the current counters of the server
+ */
+ServerStatsReply InferenceServer::stats ()
+{
+  ServerStatsReply reply;
+  std::memset (&reply, 0, sizeof (reply));
+  {
+    std::lock_guard<std::mutex> guard (_queue_lock);
+    reply.queue_depth = (uint32_t) _queue.size();
+  }
+  std::vector<float> sorted;
+  {
+    std::lock_guard<std::mutex> guard (_stats_lock);
+    reply.requests = _requests;
+    reply.batches = _batches;
+    reply.max_queue_depth = (uint32_t) _max_queue_depth;
+    sorted = _latencies_us;
+  }
+  std::sort (sorted.begin(), sorted.end());
+  reply.p50_us = percentile (sorted, P50);
+  reply.p99_us = percentile (sorted, P99);
+  return reply;
+}
+
+/**
+ * queue a classification, and wait for its batch to run
+ * @param req the request
+ * @return the identified digit
+ */
+digit InferenceServer::classify (PendingRequest &req)
+{
+  std::future<digit> result = req.result.get_future();
+  req.arrival = Clock::now();
+  std::size_t depth;
+  {
+    std::lock_guard<std::mutex> guard (_queue_lock);
+    _queue.push_back (&req);
+    depth = _queue.size();
+  }
+  _arrived.notify_one();
+  {
+    std::lock_guard<std::mutex> guard (_stats_lock);
+    _max_queue_depth = std::max (_max_queue_depth, depth);
+  }
+  return result.get();
+}
+
+/**
+ * the batching thread loop: collects, runs and answers the batches
+ */
+void InferenceServer::batch_loop ()
+{
+  std::vector<PendingRequest *> batch;
+  Matrix inputs;
+  while (true)
+    {
+      {
+        std::unique_lock<std::mutex> guard (_queue_lock);
+        _arrived.wait (guard, [this] () { return !_queue.empty(); });
+        // the batch is due when it is full, or when its oldest request
+        // waited long enough.
+        Clock::time_point due = _queue.front()->arrival + _max_delay;
+        _arrived.wait_until (guard, due, [this] () {
+            return (int) _queue.size() >= _max_batch;
+        });
+        std::size_t n = std::min (_queue.size(), (std::size_t) _max_batch);
+        batch.assign (_queue.begin(), _queue.begin() + (long) n);
+        _queue.erase (_queue.begin(), _queue.begin() + (long) n);
+      }
+      run_batch (batch, inputs);
+    }
+}
+
+/**
+ * run a batch of requests through the network, and answer them
+ * @param batch the requests
+ * @param inputs a scratch matrix for the batch images
+ */
+void InferenceServer::run_batch (const std::vector<PendingRequest *> &batch,
+                                 Matrix &inputs)
+{
+  int img_size = img_dims.rows * img_dims.cols;
+  int n = (int) batch.size();
+  inputs.resize (img_size, n);
+  for (int j = 0; j < n; j++)
+    {
+      const float *img = batch[j]->image.data();
+      for (int i = 0; i < img_size; i++)
+        inputs(i, j) = img[i];
+    }
+  std::vector<digit> results = _mlp.classify_batch (inputs);
+
+  Clock::time_point done = Clock::now();
+  {
+    std::lock_guard<std::mutex> guard (_stats_lock);
+    _requests += (uint64_t) n;
+    _batches++;
+    for (const PendingRequest *req : batch)
+      {
+        float us = std::chrono::duration<float, std::micro> (
+            done - req->arrival).count();
+        if (_latencies_us.size() < SERVER_LATENCY_WINDOW)
+          _latencies_us.push_back (us);
+        else
+          _latencies_us[_latency_next] = us;
+        _latency_next = (_latency_next + 1) % SERVER_LATENCY_WINDOW;
+      }
+  }
+  // the requests are owned by their connection threads, and may be gone
+  // right after being answered.
+  for (int j = 0; j < n; j++)
+    batch[j]->result.set_value (results[j]);
+}
+
+/**
+ * the connection thread loop: answers the requests of a client
+ * @param fd the connection socket, closed at the end
+ */
+void InferenceServer::serve_connection (int fd)
+{
+  std::size_t img_bytes = sizeof (float) * img_dims.rows * img_dims.cols;
+  ServerRequestHeader header;
+  Matrix image (img_dims.rows * img_dims.cols, 1);
+  while (read_full (fd, &header, sizeof (header)))
+    {
+      bool ok = false;
+      if (header.op == SERVER_OP_CLASSIFY)
+        {
+          PendingRequest req;
+          req.image = std::move (image);
+          if (!read_full (fd, req.image.data(), img_bytes))
+            break;
+          digit result = classify (req);
+          image = std::move (req.image);
+          ServerDigitReply reply = {result.value, result.probability};
+          ok = write_full (fd, &reply, sizeof (reply));
+        }
+      else if (header.op == SERVER_OP_STATS)
+        {
+          ServerStatsReply reply = stats();
+          ok = write_full (fd, &reply, sizeof (reply));
+        }
+      // an unknown request ends the connection.
+      if (!ok)
+        break;
+    }
+  close (fd);
+}
+
+/**
+ * listen on a Unix domain socket, and serve the clients until the process
+ * ends
+ * @param socket_path the socket path
+ * @return false if the socket could not be listened on
+ */
+bool InferenceServer::run (const std::string &socket_path)
+{
+  struct sockaddr_un addr;
+  std::memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof (addr.sun_path))
+    return false;
+  std::memcpy (addr.sun_path, socket_path.c_str(), socket_path.size());
+
+  int listen_fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd < 0)
+    return false;
+  unlink (socket_path.c_str());
+  if (bind (listen_fd, (struct sockaddr *) &addr, sizeof (addr)) != 0
+      || listen (listen_fd, SERVER_LISTEN_BACKLOG) != 0)
+    {
+      close (listen_fd);
+      return false;
+    }
+
+  std::thread (&InferenceServer::batch_loop, this).detach();
+  while (true)
+    {
+      int fd = accept (listen_fd, nullptr, nullptr);
+      if (fd >= 0)
+        std::thread (&InferenceServer::serve_connection, this, fd).detach();
+    }
+}
@@ -0,0 +1,106 @@
+// InferenceServer.h
+
+#ifndef INFERENCESERVER_H
+#define INFERENCESERVER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "MlpNetwork.h"
+#include "ServerProtocol.h"
+
+/**
+ * A long running classification server on a Unix domain socket (see
+ * ServerProtocol.h). Every connection is served by its own thread, and the
+ * requests of all the connections are grouped into micro-batches: a batch
+ * is run once it holds max_batch requests, or once its oldest request has
+ * waited max_delay - the network then runs as one matrix-matrix product per
+ * layer for the whole batch.
+ */
+class InferenceServer
+{
+  typedef std::chrono::steady_clock Clock;
+
+/**
+ * @struct PendingRequest
+ * @brief A classification waiting in the batching queue, owned by its
+ *        connection thread.
+ */
+  struct PendingRequest
+  {
+    Matrix image;
+    Clock::time_point arrival;
+    std::promise<digit> result;
+  };
+
+  MlpNetwork _mlp;
+  int _max_batch;
+  std::chrono::microseconds _max_delay;
+
+  std::mutex _queue_lock;
+  std::condition_variable _arrived;
+  std::deque<PendingRequest *> _queue;
+
+  std::mutex _stats_lock;
+  uint64_t _requests, _batches;
+  std::size_t _max_queue_depth;
+  std::vector<float> _latencies_us;    // a ring of the recent latencies
+  std::size_t _latency_next;
+
+/**
+ * the batching thread loop: collects, runs and answers the batches
+ */
+  void batch_loop ();
+
+/**
+ * run a batch of requests through the network, and answer them
+ * @param batch the requests
+ * @param inputs a scratch matrix for the batch images
+ */
+  void run_batch (const std::vector<PendingRequest *> &batch,
+                  Matrix &inputs);
+
+/**
+ * queue a classification, and wait for its batch to run
+ * @param req the request
+ * @return the identified digit
+ */
+  digit classify (PendingRequest &req);
+
+/**
+ * the connection thread loop: answers the requests of a client
+ * @param fd the connection socket, closed at the end
+ */
+  void serve_connection (int fd);
+
+ public:
+/**
+ * the InferenceServer constructor
+ * @param mlp the network (its weights are shared, not copied)
+ * @param max_batch the largest batch size, at least 1
+ * @param max_delay_us the longest time in microseconds a request waits for
+ *        more requests to join its batch
+ */
+  InferenceServer (const MlpNetwork &mlp, int max_batch, int max_delay_us);
+
+/**
+ * @return the current counters of the server
+ */
+  ServerStatsReply stats ();
+
+/**
+ * listen on a Unix domain socket, and serve the clients until the process
+ * ends. a stale socket file of the same path is replaced.
+ * @param socket_path the socket path
+ * @return false if the socket could not be listened on (returns only then)
+ */
+  bool run (const std::string &socket_path);
+};
+
+#endif //INFERENCESERVER_H
@@ -0,0 +1,1272 @@
+#include "Kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#define KERNELS_AVX2
+#define GEMM_MR 6
+#define GEMM_NR 16
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define KERNELS_SSE2
+#define GEMM_MR 4
+#define GEMM_NR 8
+#else
+#define GEMM_MR 4
+#define GEMM_NR 4
+#endif
+
+// cache blocking: a KC x NR panel of b is streamed from L1 by the
+// micro-kernel, a MC x KC block of a is kept in L2, and a KC x NC block of b
+// is kept in the last level cache.
+#define GEMM_KC 256
+#define GEMM_MC 120
+#define GEMM_NC 1024
+
+// the gemv variants shape thresholds, measured (see select_gemv).
+#define GEMV_SMALL_MAX_VECTORS 4
+#define GEMV_SMALL_MAX_COLS 32
+#define GEMV_SKINNY_MAX_ROWS 4
+#define GEMV_WIDE_MIN_COLS 256
+
+/**
+ * convert a float to a half precision value, rounding to nearest even
+ */
+uint16_t float_to_half (float val, HalfFormat format)
+{
+  uint32_t bits;
+  std::memcpy (&bits, &val, sizeof (bits));
+  if (format == HALF_BF16)
+    {
+      if ((bits & 0x7fffffff) > 0x7f800000)
+        return (uint16_t) ((bits >> 16) | 0x40);   // keep NaN a quiet NaN
+      bits += 0x7fff + ((bits >> 16) & 1);
+      return (uint16_t) (bits >> 16);
+    }
+
+  uint16_t sign = (uint16_t) ((bits >> 16) & 0x8000);
+  bits &= 0x7fffffff;
+  if (bits >= 0x7f800000)
+    return sign | 0x7c00 | (bits > 0x7f800000 ? 0x200 : 0);
+  if (bits >= 0x477ff000)
+    return sign | 0x7c00;   // rounds above the largest half: infinity
+  if (bits < 0x38800000)
+    {
+      // a subnormal half (or zero): a multiple of 2^-24
+      float abs_val;
+      std::memcpy (&abs_val, &bits, sizeof (abs_val));
+      return sign | (uint16_t) std::nearbyint (abs_val * 16777216.0f);
+    }
+  uint32_t half = (bits - 0x38000000) >> 13;   // rebias the exponent
+  uint32_t rest = bits & 0x1fff;
+  if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+    half++;
+  return sign | (uint16_t) half;
+}
+
+/**
+ * widen a half precision value to float
+ */
+float half_to_float (uint16_t val, HalfFormat format)
+{
+  uint32_t bits;
+  if (format == HALF_BF16)
+    {
+      bits = (uint32_t) val << 16;
+    }
+  else
+    {
+      uint32_t sign = (uint32_t) (val & 0x8000) << 16;
+      uint32_t exp = (val >> 10) & 0x1f, mant = val & 0x3ff;
+      if (exp == 0)
+        {
+          float abs_val = (float) mant / 16777216.0f;
+          return sign ? -abs_val : abs_val;
+        }
+      if (exp == 0x1f)
+        bits = sign | 0x7f800000 | (mant << 13);
+      else
+        bits = sign | ((exp + 112) << 23) | (mant << 13);
+    }
+  float result;
+  std::memcpy (&result, &bits, sizeof (result));
+  return result;
+}
+
+/**
+ * the packing buffers of the calling thread. they only grow, so in steady
+ * state the products do not allocate.
+ */
+static thread_local std::vector<float> packed_a, packed_b;
+
+/**
+ * widen an element of a to float
+ */
+static inline float widen (float val, HalfFormat)
+{
+  return val;
+}
+static inline float widen (uint16_t val, HalfFormat format)
+{
+  return half_to_float (val, format);
+}
+
+/**
+ * pack a (mc x kc) block of a into MR-rows panels, each panel ordered by k,
+ * zero padded up to a full MR rows. half precision elements are widened to
+ * float here, so the micro-kernel only ever sees floats. a is read through
+ * its row and col strides, so a transposed a is packed in place.
+ */
+template <typename T>
+static void pack_a (const T *a, HalfFormat format, int a_rs, int a_cs,
+                    int mc, int kc, float *dst)
+{
+  for (int ir = 0; ir < mc; ir += GEMM_MR)
+    {
+      int mr = mc - ir < GEMM_MR ? mc - ir : GEMM_MR;
+      for (int p = 0; p < kc; p++)
+        {
+          for (int r = 0; r < mr; r++)
+            dst[r] = widen (a[(ir + r) * a_rs + p * a_cs], format);
+          for (int r = mr; r < GEMM_MR; r++)
+            dst[r] = 0;
+          dst += GEMM_MR;
+        }
+    }
+}
+
+/**
+ * pack a (kc x nc) block of b into NR-cols panels, each panel ordered by k,
+ * zero padded up to a full NR cols. b is read through its row and col
+ * strides.
+ */
+static void pack_b (const float *b, int b_rs, int b_cs, int kc, int nc,
+                    float *dst)
+{
+  for (int jr = 0; jr < nc; jr += GEMM_NR)
+    {
+      int nr = nc - jr < GEMM_NR ? nc - jr : GEMM_NR;
+      for (int p = 0; p < kc; p++)
+        {
+          const float *b_row = b + p * b_rs + jr * b_cs;
+          if (b_cs == 1)
+            for (int j = 0; j < nr; j++)
+              dst[j] = b_row[j];
+          else
+            for (int j = 0; j < nr; j++)
+              dst[j] = b_row[j * b_cs];
+          for (int j = nr; j < GEMM_NR; j++)
+            dst[j] = 0;
+          dst += GEMM_NR;
+        }
+    }
+}
+
+/**
+ * the register tiled micro-kernel: tile = packed a panel * packed b panel,
+ * where tile is a full MR x NR row-major block.
+ */
+static void micro_kernel (int kc, const float *pa, const float *pb,
+                          float *tile)
+{
+#if defined(KERNELS_AVX2)
+  __m256 c00 = _mm256_setzero_ps (), c01 = _mm256_setzero_ps ();
+  __m256 c10 = _mm256_setzero_ps (), c11 = _mm256_setzero_ps ();
+  __m256 c20 = _mm256_setzero_ps (), c21 = _mm256_setzero_ps ();
+  __m256 c30 = _mm256_setzero_ps (), c31 = _mm256_setzero_ps ();
+  __m256 c40 = _mm256_setzero_ps (), c41 = _mm256_setzero_ps ();
+  __m256 c50 = _mm256_setzero_ps (), c51 = _mm256_setzero_ps ();
+  for (int p = 0; p < kc; p++)
+    {
+      __m256 b0 = _mm256_loadu_ps (pb);
+      __m256 b1 = _mm256_loadu_ps (pb + 8);
+      __m256 a_val = _mm256_broadcast_ss (pa);
+      c00 = _mm256_fmadd_ps (a_val, b0, c00);
+      c01 = _mm256_fmadd_ps (a_val, b1, c01);
+      a_val = _mm256_broadcast_ss (pa + 1);
+      c10 = _mm256_fmadd_ps (a_val, b0, c10);
+      c11 = _mm256_fmadd_ps (a_val, b1, c11);
+      a_val = _mm256_broadcast_ss (pa + 2);
+      c20 = _mm256_fmadd_ps (a_val, b0, c20);
+      c21 = _mm256_fmadd_ps (a_val, b1, c21);
+      a_val = _mm256_broadcast_ss (pa + 3);
+      c30 = _mm256_fmadd_ps (a_val, b0, c30);
+      c31 = _mm256_fmadd_ps (a_val, b1, c31);
+      a_val = _mm256_broadcast_ss (pa + 4);
+      c40 = _mm256_fmadd_ps (a_val, b0, c40);
+      c41 = _mm256_fmadd_ps (a_val, b1, c41);
+      a_val = _mm256_broadcast_ss (pa + 5);
+      c50 = _mm256_fmadd_ps (a_val, b0, c50);
+      c51 = _mm256_fmadd_ps (a_val, b1, c51);
+      pa += GEMM_MR;
+      pb += GEMM_NR;
+    }
+  _mm256_storeu_ps (tile, c00);
+  _mm256_storeu_ps (tile + 8, c01);
+  _mm256_storeu_ps (tile + 16, c10);
+  _mm256_storeu_ps (tile + 24, c11);
+  _mm256_storeu_ps (tile + 32, c20);
+  _mm256_storeu_ps (tile + 40, c21);
+  _mm256_storeu_ps (tile + 48, c30);
+  _mm256_storeu_ps (tile + 56, c31);
+  _mm256_storeu_ps (tile + 64, c40);
+  _mm256_storeu_ps (tile + 72, c41);
+  _mm256_storeu_ps (tile + 80, c50);
+  _mm256_storeu_ps (tile + 88, c51);
+#elif defined(KERNELS_SSE2)
+  __m128 c00 = _mm_setzero_ps (), c01 = _mm_setzero_ps ();
+  __m128 c10 = _mm_setzero_ps (), c11 = _mm_setzero_ps ();
+  __m128 c20 = _mm_setzero_ps (), c21 = _mm_setzero_ps ();
+  __m128 c30 = _mm_setzero_ps (), c31 = _mm_setzero_ps ();
+  for (int p = 0; p < kc; p++)
+    {
+      __m128 b0 = _mm_loadu_ps (pb);
+      __m128 b1 = _mm_loadu_ps (pb + 4);
+      __m128 a_val = _mm_set1_ps (pa[0]);
+      c00 = _mm_add_ps (c00, _mm_mul_ps (a_val, b0));
+      c01 = _mm_add_ps (c01, _mm_mul_ps (a_val, b1));
+      a_val = _mm_set1_ps (pa[1]);
+      c10 = _mm_add_ps (c10, _mm_mul_ps (a_val, b0));
+      c11 = _mm_add_ps (c11, _mm_mul_ps (a_val, b1));
+      a_val = _mm_set1_ps (pa[2]);
+      c20 = _mm_add_ps (c20, _mm_mul_ps (a_val, b0));
+      c21 = _mm_add_ps (c21, _mm_mul_ps (a_val, b1));
+      a_val = _mm_set1_ps (pa[3]);
+      c30 = _mm_add_ps (c30, _mm_mul_ps (a_val, b0));
+      c31 = _mm_add_ps (c31, _mm_mul_ps (a_val, b1));
+      pa += GEMM_MR;
+      pb += GEMM_NR;
+    }
+  _mm_storeu_ps (tile, c00);
+  _mm_storeu_ps (tile + 4, c01);
+  _mm_storeu_ps (tile + 8, c10);
+  _mm_storeu_ps (tile + 12, c11);
+  _mm_storeu_ps (tile + 16, c20);
+  _mm_storeu_ps (tile + 20, c21);
+  _mm_storeu_ps (tile + 24, c30);
+  _mm_storeu_ps (tile + 28, c31);
+#else
+  float acc[GEMM_MR * GEMM_NR] = {0};
+  for (int p = 0; p < kc; p++)
+    {
+      for (int r = 0; r < GEMM_MR; r++)
+        for (int j = 0; j < GEMM_NR; j++)
+          acc[r * GEMM_NR + j] += pa[r] * pb[j];
+      pa += GEMM_MR;
+      pb += GEMM_NR;
+    }
+  for (int i = 0; i < GEMM_MR * GEMM_NR; i++)
+    tile[i] = acc[i];
+#endif
+}
+
+/**
+ * merge a computed micro-kernel tile into its (mr x nr) block of c. the
+ * epilogue (bias and relu) is applied when the last k-block is merged, so
+ * the outputs are written once and never revisited.
+ */
+static void store_tile (const float *tile, float *c, int c_rs, int c_cs,
+                        int mr, int nr, bool first, bool last,
+                        const float *bias, bool relu)
+{
+  for (int r = 0; r < mr; r++)
+    {
+      float *c_row = c + r * c_rs;
+      const float *t_row = tile + r * GEMM_NR;
+      float row_bias = (last && bias) ? bias[r] : 0;
+      for (int j = 0; j < nr; j++)
+        {
+          float &out = c_row[j * c_cs];
+          float val = (first ? 0 : out) + t_row[j] + row_bias;
+          out = (last && relu && val < 0) ? 0 : val;
+        }
+    }
+}
+
+/**
+ * the blocked matrix-matrix product: c = a * b (+ bias, relu), for a float
+ * or a half precision a. every matrix is given by its row and col strides.
+ */
+template <typename T>
+static void gemm_blocked (const T *a, HalfFormat format, int a_rs, int a_cs,
+                          const float *b, int b_rs, int b_cs, float *c,
+                          int c_rs, int c_cs, int m, int n, int k,
+                          const float *bias, bool relu)
+{
+  if (k == 0)
+    {
+      for (int i = 0; i < m; i++)
+        for (int j = 0; j < n; j++)
+          {
+            float val = bias ? bias[i] : 0;
+            c[i * c_rs + j * c_cs] = (relu && val < 0) ? 0 : val;
+          }
+      return;
+    }
+
+  int nc_max = n < GEMM_NC ? n : GEMM_NC;
+  int mc_max = m < GEMM_MC ? m : GEMM_MC;
+  std::size_t b_size = (std::size_t) GEMM_KC
+                       * ((nc_max + GEMM_NR - 1) / GEMM_NR) * GEMM_NR;
+  std::size_t a_size = (std::size_t) GEMM_KC
+                       * ((mc_max + GEMM_MR - 1) / GEMM_MR) * GEMM_MR;
+  if (packed_b.size () < b_size)
+    packed_b.resize (b_size);
+  if (packed_a.size () < a_size)
+    packed_a.resize (a_size);
+
+  alignas(32) float tile[GEMM_MR * GEMM_NR];
+  for (int jc = 0; jc < n; jc += GEMM_NC)
+    {
+      int nc = n - jc < GEMM_NC ? n - jc : GEMM_NC;
+      for (int pc = 0; pc < k; pc += GEMM_KC)
+        {
+          int kc = k - pc < GEMM_KC ? k - pc : GEMM_KC;
+          pack_b (b + pc * b_rs + jc * b_cs, b_rs, b_cs, kc, nc,
+                  packed_b.data ());
+          for (int ic = 0; ic < m; ic += GEMM_MC)
+            {
+              int mc = m - ic < GEMM_MC ? m - ic : GEMM_MC;
+              pack_a (a + ic * a_rs + pc * a_cs, format, a_rs, a_cs, mc,
+                      kc, packed_a.data ());
+              for (int jr = 0; jr < nc; jr += GEMM_NR)
+                {
+                  int nr = nc - jr < GEMM_NR ? nc - jr : GEMM_NR;
+                  const float *pb = packed_b.data () + jr * kc;
+                  for (int ir = 0; ir < mc; ir += GEMM_MR)
+                    {
+                      int mr = mc - ir < GEMM_MR ? mc - ir : GEMM_MR;
+                      micro_kernel (kc, packed_a.data () + ir * kc, pb, tile);
+
+                      store_tile (tile, c + (ic + ir) * c_rs
+                                        + (jc + jr) * c_cs,
+                                  c_rs, c_cs, mr, nr, pc == 0, pc + kc == k,
+                                  bias ? bias + ic + ir : nullptr, relu);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * the general matrix-matrix product: c = a * b (+ bias, relu)
+ */
+void gemm (const float *a, int lda, const float *b, int ldb, float *c,
+           int ldc, int m, int n, int k, const float *bias, bool relu)
+{
+  gemm_blocked (a, HALF_F16, lda, 1, b, ldb, 1, c, ldc, 1, m, n, k, bias,
+                relu);
+}
+
+/**
+ * the matrix-matrix product of strided matrices: c = a * b (+ bias, relu)
+ */
+void gemm_strided (const float *a, int a_rs, int a_cs, const float *b,
+                   int b_rs, int b_cs, float *c, int c_rs, int c_cs, int m,
+                   int n, int k, const float *bias, bool relu)
+{
+  gemm_blocked (a, HALF_F16, a_rs, a_cs, b, b_rs, b_cs, c, c_rs, c_cs, m, n,
+                k, bias, relu);
+}
+
+/**
+ * the matrix-matrix product of a half precision a: c = a * b (+ bias, relu)
+ */
+void gemm_half (const uint16_t *a, HalfFormat format, int lda,
+                const float *b, int ldb, float *c, int ldc, int m, int n,
+                int k, const float *bias, bool relu)
+{
+  gemm_blocked (a, format, lda, 1, b, ldb, 1, c, ldc, 1, m, n, k, bias,
+                relu);
+}
+
+#if defined(KERNELS_AVX2)
+/**
+ * horizontal sums of four vectors
+ * @return {sum(s0), sum(s1), sum(s2), sum(s3)}
+ */
+static inline __m128 hsum4 (__m256 s0, __m256 s1, __m256 s2, __m256 s3)
+{
+  __m256 h = _mm256_hadd_ps (_mm256_hadd_ps (s0, s1),
+                             _mm256_hadd_ps (s2, s3));
+  return _mm_add_ps (_mm256_castps256_ps128 (h),
+                     _mm256_extractf128_ps (h, 1));
+}
+#elif defined(KERNELS_SSE2)
+/**
+ * horizontal sums of four vectors
+ * @return {sum(s0), sum(s1), sum(s2), sum(s3)}
+ */
+static inline __m128 hsum4 (__m128 s0, __m128 s1, __m128 s2, __m128 s3)
+{
+  _MM_TRANSPOSE4_PS (s0, s1, s2, s3);
+  return _mm_add_ps (_mm_add_ps (s0, s1), _mm_add_ps (s2, s3));
+}
+#endif
+
+/**
+ * the matrix-vector product: y = a * x (+ bias, relu)
+ * four rows of a are reduced together, so every load of x is reused four
+ * times. the epilogue is applied on the reduced sums, before y is written.
+ */
+void gemv (const float *a, int lda, const float *x, float *y, int m, int k,
+           const float *bias, bool relu)
+{
+  int i = 0;
+#if defined(KERNELS_AVX2) || defined(KERNELS_SSE2)
+  for (; i + 4 <= m; i += 4)
+    {
+      const float *a0 = a + i * lda, *a1 = a0 + lda;
+      const float *a2 = a1 + lda, *a3 = a2 + lda;
+      int p = 0;
+#if defined(KERNELS_AVX2)
+      __m256 s0 = _mm256_setzero_ps (), s1 = _mm256_setzero_ps ();
+      __m256 s2 = _mm256_setzero_ps (), s3 = _mm256_setzero_ps ();
+      for (; p + 8 <= k; p += 8)
+        {
+          __m256 xv = _mm256_loadu_ps (x + p);
+          s0 = _mm256_fmadd_ps (_mm256_loadu_ps (a0 + p), xv, s0);
+          s1 = _mm256_fmadd_ps (_mm256_loadu_ps (a1 + p), xv, s1);
+          s2 = _mm256_fmadd_ps (_mm256_loadu_ps (a2 + p), xv, s2);
+          s3 = _mm256_fmadd_ps (_mm256_loadu_ps (a3 + p), xv, s3);
+        }
+#else
+      __m128 s0 = _mm_setzero_ps (), s1 = _mm_setzero_ps ();
+      __m128 s2 = _mm_setzero_ps (), s3 = _mm_setzero_ps ();
+      for (; p + 4 <= k; p += 4)
+        {
+          __m128 xv = _mm_loadu_ps (x + p);
+          s0 = _mm_add_ps (s0, _mm_mul_ps (_mm_loadu_ps (a0 + p), xv));
+          s1 = _mm_add_ps (s1, _mm_mul_ps (_mm_loadu_ps (a1 + p), xv));
+          s2 = _mm_add_ps (s2, _mm_mul_ps (_mm_loadu_ps (a2 + p), xv));
+          s3 = _mm_add_ps (s3, _mm_mul_ps (_mm_loadu_ps (a3 + p), xv));
+        }
+#endif
+      alignas(16) float sums[4];
+      _mm_store_ps (sums, hsum4 (s0, s1, s2, s3));
+      for (; p < k; p++)
+        {
+          sums[0] += a0[p] * x[p];
+          sums[1] += a1[p] * x[p];
+          sums[2] += a2[p] * x[p];
+          sums[3] += a3[p] * x[p];
+        }
+      for (int r = 0; r < 4; r++)
+        {
+          float val = sums[r] + (bias ? bias[i + r] : 0);
+          y[i + r] = (relu && val < 0) ? 0 : val;
+        }
+    }
+#endif
+  for (; i < m; i++)
+    {
+      const float *a_row = a + i * lda;
+      float sum = bias ? bias[i] : 0;
+      for (int p = 0; p < k; p++)
+        sum += a_row[p] * x[p];
+      y[i] = (relu && sum < 0) ? 0 : sum;
+    }
+}
+
+// the vector type of the gemv variants: 8 floats with AVX2, 4 with SSE2.
+#if defined(KERNELS_AVX2)
+typedef __m256 vfloat;
+#define VLEN 8
+#define vzero() _mm256_setzero_ps ()
+#define vset1(v) _mm256_set1_ps (v)
+#define vload(p) _mm256_loadu_ps (p)
+#define vstore(p, v) _mm256_storeu_ps (p, v)
+#define vadd(a, b) _mm256_add_ps (a, b)
+#define vfmadd(a, b, c) _mm256_fmadd_ps (a, b, c)
+#elif defined(KERNELS_SSE2)
+typedef __m128 vfloat;
+#define VLEN 4
+#define vzero() _mm_setzero_ps ()
+#define vset1(v) _mm_set1_ps (v)
+#define vload(p) _mm_loadu_ps (p)
+#define vstore(p, v) _mm_storeu_ps (p, v)
+#define vadd(a, b) _mm_add_ps (a, b)
+#define vfmadd(a, b, c) _mm_add_ps (_mm_mul_ps (a, b), c)
+#endif
+
+#if defined(KERNELS_AVX2) || defined(KERNELS_SSE2)
+/**
+ * the sum of the lanes of a vector
+ */
+static inline float vsum (vfloat v)
+{
+  alignas(32) float lanes[VLEN];
+  vstore (lanes, v);
+  float sum = 0;
+  for (int l = 0; l < VLEN; l++)
+    sum += lanes[l];
+  return sum;
+}
+
+/**
+ * a single row dot product, from four independent accumulators (a long row
+ * is bound by the FMA latency, not by the loads)
+ */
+static inline float row_dot (const float *a, const float *x, int k)
+{
+  vfloat s0 = vzero(), s1 = vzero(), s2 = vzero(), s3 = vzero();
+  int p = 0;
+  for (; p + 4 * VLEN <= k; p += 4 * VLEN)
+    {
+      s0 = vfmadd (vload (a + p), vload (x + p), s0);
+      s1 = vfmadd (vload (a + p + VLEN), vload (x + p + VLEN), s1);
+      s2 = vfmadd (vload (a + p + 2 * VLEN), vload (x + p + 2 * VLEN), s2);
+      s3 = vfmadd (vload (a + p + 3 * VLEN), vload (x + p + 3 * VLEN), s3);
+    }
+  for (; p + VLEN <= k; p += VLEN)
+    s0 = vfmadd (vload (a + p), vload (x + p), s0);
+  float sum = vsum (vadd (vadd (s0, s1), vadd (s2, s3)));
+  for (; p < k; p++)
+    sum += a[p] * x[p];
+  return sum;
+}
+#endif
+
+/**
+ * gemv of long rows: four rows are reduced together, each into two
+ * accumulators, so eight independent FMA chains hide the FMA latency
+ */
+void gemv_wide (const float *a, int lda, const float *x, float *y, int m,
+                int k, const float *bias, bool relu)
+{
+#if defined(KERNELS_AVX2) || defined(KERNELS_SSE2)
+  int i = 0;
+  for (; i + 4 <= m; i += 4)
+    {
+      const float *a0 = a + i * lda, *a1 = a0 + lda;
+      const float *a2 = a1 + lda, *a3 = a2 + lda;
+      vfloat s0 = vzero(), s1 = vzero(), s2 = vzero(), s3 = vzero();
+      vfloat t0 = vzero(), t1 = vzero(), t2 = vzero(), t3 = vzero();
+      int p = 0;
+      for (; p + 2 * VLEN <= k; p += 2 * VLEN)
+        {
+          vfloat x0 = vload (x + p), x1 = vload (x + p + VLEN);
+          s0 = vfmadd (vload (a0 + p), x0, s0);
+          t0 = vfmadd (vload (a0 + p + VLEN), x1, t0);
+          s1 = vfmadd (vload (a1 + p), x0, s1);
+          t1 = vfmadd (vload (a1 + p + VLEN), x1, t1);
+          s2 = vfmadd (vload (a2 + p), x0, s2);
+          t2 = vfmadd (vload (a2 + p + VLEN), x1, t2);
+          s3 = vfmadd (vload (a3 + p), x0, s3);
+          t3 = vfmadd (vload (a3 + p + VLEN), x1, t3);
+        }
+      for (; p + VLEN <= k; p += VLEN)
+        {
+          vfloat x0 = vload (x + p);
+          s0 = vfmadd (vload (a0 + p), x0, s0);
+          s1 = vfmadd (vload (a1 + p), x0, s1);
+          s2 = vfmadd (vload (a2 + p), x0, s2);
+          s3 = vfmadd (vload (a3 + p), x0, s3);
+        }
+      alignas(16) float sums[4];
+      _mm_store_ps (sums, hsum4 (vadd (s0, t0), vadd (s1, t1),
+                                 vadd (s2, t2), vadd (s3, t3)));
+      for (; p < k; p++)
+        {
+          sums[0] += a0[p] * x[p];
+          sums[1] += a1[p] * x[p];
+          sums[2] += a2[p] * x[p];
+          sums[3] += a3[p] * x[p];
+        }
+      for (int r = 0; r < 4; r++)
+        {
+          float val = sums[r] + (bias ? bias[i + r] : 0);
+          y[i + r] = (relu && val < 0) ? 0 : val;
+        }
+    }
+  if (i < m)
+    gemv_skinny (a + i * lda, lda, x, y + i, m - i, k, bias ? bias + i
+                                                            : nullptr, relu);
+#else
+  gemv (a, lda, x, y, m, k, bias, relu);
+#endif
+}
+
+/**
+ * gemv of a few long rows: every row is reduced on its own, by the whole
+ * vector width
+ */
+void gemv_skinny (const float *a, int lda, const float *x, float *y, int m,
+                  int k, const float *bias, bool relu)
+{
+#if defined(KERNELS_AVX2) || defined(KERNELS_SSE2)
+  for (int i = 0; i < m; i++)
+    {
+      float val = row_dot (a + i * lda, x, k) + (bias ? bias[i] : 0);
+      y[i] = (relu && val < 0) ? 0 : val;
+    }
+#else
+  gemv (a, lda, x, y, m, k, bias, relu);
+#endif
+}
+
+/**
+ * the number of floats of a row of the transposed matrix of gemv_small
+ */
+int gemv_small_ld (int m)
+{
+#if defined(KERNELS_AVX2) || defined(KERNELS_SSE2)
+  return (m + VLEN - 1) / VLEN * VLEN;
+#else
+  return m;
+#endif
+}
+
+/**
+ * lay a matrix out for gemv_small: transposed, and its rows zero padded to
+ * whole vectors
+ */
+void gemv_small_pack (const float *a, int lda, int m, int k, float *at)
+{
+  int ldt = gemv_small_ld (m);
+  std::memset (at, 0, sizeof (float) * (std::size_t) ldt * k);
+  for (int i = 0; i < m; i++)
+    for (int p = 0; p < k; p++)
+      at[p * ldt + i] = a[i * lda + p];
+}
+
+#if defined(KERNELS_AVX2) || defined(KERNELS_SSE2)
+/**
+ * gemv_small of V output vectors, fully unrolled: y is kept in registers
+ * while x is broadcast element by element. the even and odd elements of x
+ * go to separate accumulators, to halve the FMA chains.
+ */
+template <int V>
+static void gemv_small_unrolled (const float *at, const float *x, float *y,
+                                 int m, int k, const float *bias, bool relu)
+{
+  constexpr int LDT = V * VLEN;
+  vfloat s[V], t[V];
+  for (int v = 0; v < V; v++)
+    {
+      s[v] = vzero();
+      t[v] = vzero();
+    }
+  int p = 0;
+  for (; p + 2 <= k; p += 2)
+    {
+      vfloat x0 = vset1 (x[p]), x1 = vset1 (x[p + 1]);
+      const float *r0 = at + p * LDT, *r1 = r0 + LDT;
+      for (int v = 0; v < V; v++)
+        {
+          s[v] = vfmadd (vload (r0 + v * VLEN), x0, s[v]);
+          t[v] = vfmadd (vload (r1 + v * VLEN), x1, t[v]);
+        }
+    }
+  if (p < k)
+    {
+      vfloat x0 = vset1 (x[p]);
+      for (int v = 0; v < V; v++)
+        s[v] = vfmadd (vload (at + p * LDT + v * VLEN), x0, s[v]);
+    }
+
+  alignas(32) float out[LDT];
+  for (int v = 0; v < V; v++)
+    vstore (out + v * VLEN, vadd (s[v], t[v]));
+  for (int i = 0; i < m; i++)
+    {
+      float val = out[i] + (bias ? bias[i] : 0);
+      y[i] = (relu && val < 0) ? 0 : val;
+    }
+}
+#endif
+
+/**
+ * gemv of a small matrix, laid out by gemv_small_pack
+ */
+void gemv_small (const float *at, const float *x, float *y, int m, int k,
+                 const float *bias, bool relu)
+{
+#if defined(KERNELS_AVX2) || defined(KERNELS_SSE2)
+  switch (gemv_small_ld (m) / VLEN)
+    {
+      case 1:
+        return gemv_small_unrolled<1> (at, x, y, m, k, bias, relu);
+      case 2:
+        return gemv_small_unrolled<2> (at, x, y, m, k, bias, relu);
+      case 3:
+        return gemv_small_unrolled<3> (at, x, y, m, k, bias, relu);
+      case 4:
+        return gemv_small_unrolled<4> (at, x, y, m, k, bias, relu);
+      default:
+        break;
+    }
+#endif
+  // a taller matrix (or no SIMD): column by column, from the packed layout.
+  int ldt = gemv_small_ld (m);
+  for (int i = 0; i < m; i++)
+    y[i] = bias ? bias[i] : 0;
+  for (int p = 0; p < k; p++)
+    for (int i = 0; i < m; i++)
+      y[i] += at[p * ldt + i] * x[p];
+  if (relu)
+    for (int i = 0; i < m; i++)
+      y[i] = y[i] < 0 ? 0 : y[i];
+}
+
+/**
+ * pick the gemv variant of a matrix shape. a matrix of a few short rows
+ * fits the registers (small); below four rows, gemv reduces every row in
+ * scalar (skinny); a remainder of rows, or long rows, take the two
+ * accumulators of gemv_wide; anything else is memory bound, as gemv.
+ */
+GemvVariant select_gemv (int m, int k)
+{
+#if defined(KERNELS_AVX2) || defined(KERNELS_SSE2)
+  if (gemv_small_ld (m) / VLEN <= GEMV_SMALL_MAX_VECTORS
+      && k <= GEMV_SMALL_MAX_COLS)
+    return GEMV_SMALL;
+  if (m < GEMV_SKINNY_MAX_ROWS)
+    return GEMV_SKINNY;
+  if (m % 4 != 0 || k >= GEMV_WIDE_MIN_COLS)
+    return GEMV_WIDE;
+#else
+  (void) m;
+  (void) k;
+#endif
+  return GEMV_ROWS;
+}
+
+/**
+ * @return the name of a gemv variant
+ */
+const char *gemv_variant_name (GemvVariant variant)
+{
+  switch (variant)
+    {
+      case GEMV_WIDE:
+        return "wide";
+      case GEMV_SKINNY:
+        return "skinny";
+      case GEMV_SMALL:
+        return "small";
+      default:
+        return "rows";
+    }
+}
+
+/**
+ * gemv of a block-sparse matrix, only the stored blocks are multiplied
+ */
+void gemv_sparse (const int *row_ptr, const int *block_cols,
+                  const float *values, const float *x, float *y, int m, int k,
+                  const float *bias, bool relu)
+{
+  for (int i = 0; i < m; i++)
+    {
+      float sum = 0;
+      int b = row_ptr[i], end = row_ptr[i + 1];
+#if defined(KERNELS_AVX2) || defined(KERNELS_SSE2)
+      // two accumulators: a row of a few blocks is an FMA latency chain.
+      vfloat s0 = vzero(), s1 = vzero();
+      for (; b + 1 < end && block_cols[b + 1] + SPARSE_BLOCK <= k; b += 2)
+        for (int l = 0; l < SPARSE_BLOCK; l += VLEN)
+          {
+            s0 = vfmadd (vload (values + b * SPARSE_BLOCK + l),
+                         vload (x + block_cols[b] + l), s0);
+            s1 = vfmadd (vload (values + (b + 1) * SPARSE_BLOCK + l),
+                         vload (x + block_cols[b + 1] + l), s1);
+          }
+      if (b < end && block_cols[b] + SPARSE_BLOCK <= k)
+        {
+          for (int l = 0; l < SPARSE_BLOCK; l += VLEN)
+            s0 = vfmadd (vload (values + b * SPARSE_BLOCK + l),
+                         vload (x + block_cols[b] + l), s0);
+          b++;
+        }
+      sum = vsum (vadd (s0, s1));
+#endif
+      // the last block of a row may end past the last column.
+      for (; b < end; b++)
+        {
+          int width = std::min (SPARSE_BLOCK, k - block_cols[b]);
+          for (int l = 0; l < width; l++)
+            sum += values[b * SPARSE_BLOCK + l] * x[block_cols[b] + l];
+        }
+      float val = sum + (bias ? bias[i] : 0);
+      y[i] = (relu && val < 0) ? 0 : val;
+    }
+}
+
+/**
+ * gemm of a block-sparse left matrix, every stored element scales a row of
+ * b into a row of c
+ */
+void gemm_sparse (const int *row_ptr, const int *block_cols,
+                  const float *values, const float *b, int ldb, float *c,
+                  int ldc, int m, int n, int k, const float *bias, bool relu)
+{
+  for (int i = 0; i < m; i++)
+    {
+      float *ci = c + i * ldc;
+      float init = bias ? bias[i] : 0;
+      for (int j = 0; j < n; j++)
+        ci[j] = init;
+      for (int blk = row_ptr[i]; blk < row_ptr[i + 1]; blk++)
+        {
+          int width = std::min (SPARSE_BLOCK, k - block_cols[blk]);
+          for (int l = 0; l < width; l++)
+            {
+              float v = values[blk * SPARSE_BLOCK + l];
+              const float *bp = b + (block_cols[blk] + l) * ldb;
+              int j = 0;
+#if defined(KERNELS_AVX2) || defined(KERNELS_SSE2)
+              vfloat vv = vset1 (v);
+              for (; j + VLEN <= n; j += VLEN)
+                vstore (ci + j, vfmadd (vv, vload (bp + j), vload (ci + j)));
+#endif
+              for (; j < n; j++)
+                ci[j] += v * bp[j];
+            }
+        }
+      if (relu)
+        for (int j = 0; j < n; j++)
+          ci[j] = ci[j] < 0 ? 0 : ci[j];
+    }
+}
+
+#if defined(KERNELS_AVX2)
+/**
+ * load eight half precision values widened to floats. bf16 is the high half
+ * of a float, f16 needs the F16C conversion.
+ */
+static inline __m256 widen8 (const uint16_t *p, HalfFormat format)
+{
+  __m128i v = _mm_loadu_si128 ((const __m128i *) p);
+#if defined(__F16C__)
+  if (format == HALF_F16)
+    return _mm256_cvtph_ps (v);
+#else
+  (void) format;
+#endif
+  return _mm256_castsi256_ps (
+      _mm256_slli_epi32 (_mm256_cvtepu16_epi32 (v), 16));
+}
+#endif
+
+/**
+ * the matrix-vector product of a half precision a: y = a * x (+ bias, relu)
+ * the rows of a are widened to float in registers, inside the reduction.
+ */
+void gemv_half (const uint16_t *a, HalfFormat format, int lda,
+                const float *x, float *y, int m, int k, const float *bias,
+                bool relu)
+{
+  int i = 0;
+#if defined(KERNELS_AVX2)
+#if defined(__F16C__)
+  bool vectorized = true;
+#else
+  bool vectorized = format == HALF_BF16;
+#endif
+  for (; vectorized && i + 4 <= m; i += 4)
+    {
+      const uint16_t *a0 = a + i * lda, *a1 = a0 + lda;
+      const uint16_t *a2 = a1 + lda, *a3 = a2 + lda;
+      __m256 s0 = _mm256_setzero_ps (), s1 = _mm256_setzero_ps ();
+      __m256 s2 = _mm256_setzero_ps (), s3 = _mm256_setzero_ps ();
+      int p = 0;
+      for (; p + 8 <= k; p += 8)
+        {
+          __m256 xv = _mm256_loadu_ps (x + p);
+          s0 = _mm256_fmadd_ps (widen8 (a0 + p, format), xv, s0);
+          s1 = _mm256_fmadd_ps (widen8 (a1 + p, format), xv, s1);
+          s2 = _mm256_fmadd_ps (widen8 (a2 + p, format), xv, s2);
+          s3 = _mm256_fmadd_ps (widen8 (a3 + p, format), xv, s3);
+        }
+      alignas(16) float sums[4];
+      _mm_store_ps (sums, hsum4 (s0, s1, s2, s3));
+      for (; p < k; p++)
+        {
+          sums[0] += half_to_float (a0[p], format) * x[p];
+          sums[1] += half_to_float (a1[p], format) * x[p];
+          sums[2] += half_to_float (a2[p], format) * x[p];
+          sums[3] += half_to_float (a3[p], format) * x[p];
+        }
+      for (int r = 0; r < 4; r++)
+        {
+          float val = sums[r] + (bias ? bias[i + r] : 0);
+          y[i + r] = (relu && val < 0) ? 0 : val;
+        }
+    }
+#endif
+  for (; i < m; i++)
+    {
+      const uint16_t *a_row = a + i * lda;
+      float sum = bias ? bias[i] : 0;
+      for (int p = 0; p < k; p++)
+        sum += half_to_float (a_row[p], format) * x[p];
+      y[i] = (relu && sum < 0) ? 0 : sum;
+    }
+}
+
+/**
+ * in-place softmax of every column of c
+ */
+void softmax_columns (float *c, int ldc, int m, int n)
+{
+  for (int j = 0; j < n; j++)
+    {
+      float max_val = c[j];
+      for (int i = 1; i < m; i++)
+        if (c[i * ldc + j] > max_val)
+          max_val = c[i * ldc + j];
+
+      float sum = 0;
+      for (int i = 0; i < m; i++)
+        {
+          float exp_val = std::exp (c[i * ldc + j] - max_val);
+          c[i * ldc + j] = exp_val;
+          sum += exp_val;
+        }
+      float factor = 1 / sum;
+      for (int i = 0; i < m; i++)
+        c[i * ldc + j] *= factor;
+    }
+}
+
+#if defined(KERNELS_AVX2)
+/**
+ * horizontal sum of the eight int32 lanes of a vector
+ */
+static inline int32_t hsum_epi32 (__m256i v)
+{
+  __m128i s = _mm_add_epi32 (_mm256_castsi256_si128 (v),
+                             _mm256_extracti128_si256 (v, 1));
+  s = _mm_add_epi32 (s, _mm_shuffle_epi32 (s, _MM_SHUFFLE (1, 0, 3, 2)));
+  s = _mm_add_epi32 (s, _mm_shuffle_epi32 (s, _MM_SHUFFLE (2, 3, 0, 1)));
+  return _mm_cvtsi128_si32 (s);
+}
+#elif defined(KERNELS_SSE2)
+/**
+ * horizontal sum of the four int32 lanes of a vector
+ */
+static inline int32_t hsum_epi32 (__m128i s)
+{
+  s = _mm_add_epi32 (s, _mm_shuffle_epi32 (s, _MM_SHUFFLE (1, 0, 3, 2)));
+  s = _mm_add_epi32 (s, _mm_shuffle_epi32 (s, _MM_SHUFFLE (2, 3, 0, 1)));
+  return _mm_cvtsi128_si32 (s);
+}
+
+/**
+ * widen the low/high eight values of a 8-bit vector to int16
+ */
+static inline __m128i widen_lo (__m128i v, bool is_unsigned)
+{
+  return is_unsigned ? _mm_unpacklo_epi8 (v, _mm_setzero_si128 ())
+                     : _mm_srai_epi16 (_mm_unpacklo_epi8 (v, v), 8);
+}
+static inline __m128i widen_hi (__m128i v, bool is_unsigned)
+{
+  return is_unsigned ? _mm_unpackhi_epi8 (v, _mm_setzero_si128 ())
+                     : _mm_srai_epi16 (_mm_unpackhi_epi8 (v, v), 8);
+}
+
+/**
+ * the SSE2 body of the 8-bit matrix-vector products: four rows at a time,
+ * the values are widened to int16 and reduced pairwise into int32 lanes.
+ * @return the number of rows computed
+ */
+static int gemv_8bit_sse2 (const int8_t *a, int lda, const void *x_vec,
+                           bool x_unsigned, int32_t *y, int m, int k)
+{
+  const int8_t *x = (const int8_t *) x_vec;
+  int i = 0;
+  for (; i + 4 <= m; i += 4)
+    {
+      __m128i sums[4] = {_mm_setzero_si128 (), _mm_setzero_si128 (),
+                         _mm_setzero_si128 (), _mm_setzero_si128 ()};
+      int p = 0;
+      for (; p + 16 <= k; p += 16)
+        {
+          __m128i xv = _mm_loadu_si128 ((const __m128i *) (x + p));
+          __m128i x_lo = widen_lo (xv, x_unsigned);
+          __m128i x_hi = widen_hi (xv, x_unsigned);
+          for (int r = 0; r < 4; r++)
+            {
+              __m128i av = _mm_loadu_si128 (
+                  (const __m128i *) (a + (i + r) * lda + p));
+              sums[r] = _mm_add_epi32 (
+                  sums[r], _mm_add_epi32 (
+                      _mm_madd_epi16 (widen_lo (av, false), x_lo),
+                      _mm_madd_epi16 (widen_hi (av, false), x_hi)));
+            }
+        }
+      for (int r = 0; r < 4; r++)
+        {
+          const int8_t *a_row = a + (i + r) * lda;
+          int32_t sum = hsum_epi32 (sums[r]);
+          for (int q = p; q < k; q++)
+            sum += (int32_t) a_row[q] * (x_unsigned ? (int32_t) (uint8_t) x[q]
+                                                    : (int32_t) x[q]);
+          y[i + r] = sum;
+        }
+    }
+  return i;
+}
+#endif
+
+/**
+ * the int8 matrix-vector product with int32 accumulation: y = a * x
+ * sixteen int8 values of a row and of x are widened to int16 and reduced
+ * pairwise into int32 lanes (vpmaddwd), four rows of a per load of x.
+ */
+void gemv_s8 (const int8_t *a, int lda, const int8_t *x, int32_t *y, int m,
+              int k)
+{
+  int i = 0;
+#if defined(KERNELS_AVX2)
+  for (; i + 4 <= m; i += 4)
+    {
+      const int8_t *a0 = a + i * lda, *a1 = a0 + lda;
+      const int8_t *a2 = a1 + lda, *a3 = a2 + lda;
+      __m256i s0 = _mm256_setzero_si256 (), s1 = _mm256_setzero_si256 ();
+      __m256i s2 = _mm256_setzero_si256 (), s3 = _mm256_setzero_si256 ();
+      int p = 0;
+      for (; p + 16 <= k; p += 16)
+        {
+          __m256i xv = _mm256_cvtepi8_epi16 (
+              _mm_loadu_si128 ((const __m128i *) (x + p)));
+          s0 = _mm256_add_epi32 (s0, _mm256_madd_epi16 (_mm256_cvtepi8_epi16 (
+              _mm_loadu_si128 ((const __m128i *) (a0 + p))), xv));
+          s1 = _mm256_add_epi32 (s1, _mm256_madd_epi16 (_mm256_cvtepi8_epi16 (
+              _mm_loadu_si128 ((const __m128i *) (a1 + p))), xv));
+          s2 = _mm256_add_epi32 (s2, _mm256_madd_epi16 (_mm256_cvtepi8_epi16 (
+              _mm_loadu_si128 ((const __m128i *) (a2 + p))), xv));
+          s3 = _mm256_add_epi32 (s3, _mm256_madd_epi16 (_mm256_cvtepi8_epi16 (
+              _mm_loadu_si128 ((const __m128i *) (a3 + p))), xv));
+        }
+      int32_t sums[4] = {hsum_epi32 (s0), hsum_epi32 (s1), hsum_epi32 (s2),
+                         hsum_epi32 (s3)};
+      for (; p < k; p++)
+        {
+          sums[0] += (int32_t) a0[p] * x[p];
+          sums[1] += (int32_t) a1[p] * x[p];
+          sums[2] += (int32_t) a2[p] * x[p];
+          sums[3] += (int32_t) a3[p] * x[p];
+        }
+      for (int r = 0; r < 4; r++)
+        y[i + r] = sums[r];
+    }
+#elif defined(KERNELS_SSE2)
+  i = gemv_8bit_sse2 (a, lda, x, false, y, m, k);
+#endif
+  for (; i < m; i++)
+    {
+      const int8_t *a_row = a + i * lda;
+      int32_t sum = 0;
+      for (int p = 0; p < k; p++)
+        sum += (int32_t) a_row[p] * x[p];
+      y[i] = sum;
+    }
+}
+
+/**
+ * the int8 matrix-vector product of a non-negative input: y = a * x
+ * thirty two products of a row are computed at once (vpmaddubsw, which
+ * can not saturate as the input is at most 127), then reduced into int32
+ * lanes, four rows of a per load of x.
+ */
+void gemv_u8s8 (const int8_t *a, int lda, const uint8_t *x, int32_t *y,
+                int m, int k)
+{
+  int i = 0;
+#if defined(KERNELS_AVX2)
+  const __m256i ones = _mm256_set1_epi16 (1);
+  for (; i + 4 <= m; i += 4)
+    {
+      const int8_t *a0 = a + i * lda, *a1 = a0 + lda;
+      const int8_t *a2 = a1 + lda, *a3 = a2 + lda;
+      __m256i s0 = _mm256_setzero_si256 (), s1 = _mm256_setzero_si256 ();
+      __m256i s2 = _mm256_setzero_si256 (), s3 = _mm256_setzero_si256 ();
+      int p = 0;
+      for (; p + 32 <= k; p += 32)
+        {
+          __m256i xv = _mm256_loadu_si256 ((const __m256i *) (x + p));
+          s0 = _mm256_add_epi32 (s0, _mm256_madd_epi16 (_mm256_maddubs_epi16 (
+              xv, _mm256_loadu_si256 ((const __m256i *) (a0 + p))), ones));
+          s1 = _mm256_add_epi32 (s1, _mm256_madd_epi16 (_mm256_maddubs_epi16 (
+              xv, _mm256_loadu_si256 ((const __m256i *) (a1 + p))), ones));
+          s2 = _mm256_add_epi32 (s2, _mm256_madd_epi16 (_mm256_maddubs_epi16 (
+              xv, _mm256_loadu_si256 ((const __m256i *) (a2 + p))), ones));
+          s3 = _mm256_add_epi32 (s3, _mm256_madd_epi16 (_mm256_maddubs_epi16 (
+              xv, _mm256_loadu_si256 ((const __m256i *) (a3 + p))), ones));
+        }
+      int32_t sums[4] = {hsum_epi32 (s0), hsum_epi32 (s1), hsum_epi32 (s2),
+                         hsum_epi32 (s3)};
+      for (; p < k; p++)
+        {
+          sums[0] += (int32_t) a0[p] * x[p];
+          sums[1] += (int32_t) a1[p] * x[p];
+          sums[2] += (int32_t) a2[p] * x[p];
+          sums[3] += (int32_t) a3[p] * x[p];
+        }
+      for (int r = 0; r < 4; r++)
+        y[i + r] = sums[r];
+    }
+#elif defined(KERNELS_SSE2)
+  i = gemv_8bit_sse2 (a, lda, x, true, y, m, k);
+#endif
+  for (; i < m; i++)
+    {
+      const int8_t *a_row = a + i * lda;
+      int32_t sum = 0;
+      for (int p = 0; p < k; p++)
+        sum += (int32_t) a_row[p] * x[p];
+      y[i] = sum;
+    }
+}
+
+/**
+ * quantize floats to int8: q = clamp(round(x * inv_scale), min, 127)
+ */
+void quantize_s8 (const float *x, float inv_scale, int8_t *q, int n,
+                  bool non_negative)
+{
+  float min_val = non_negative ? 0 : -127;
+  int i = 0;
+#if defined(KERNELS_AVX2)
+  const __m256 scale = _mm256_set1_ps (inv_scale);
+  const __m256 max_q = _mm256_set1_ps (127);
+  const __m256 min_q = _mm256_set1_ps (min_val);
+  for (; i + 16 <= n; i += 16)
+    {
+      __m256 f0 = _mm256_mul_ps (_mm256_loadu_ps (x + i), scale);
+      __m256 f1 = _mm256_mul_ps (_mm256_loadu_ps (x + i + 8), scale);
+      f0 = _mm256_max_ps (_mm256_min_ps (f0, max_q), min_q);
+      f1 = _mm256_max_ps (_mm256_min_ps (f1, max_q), min_q);
+      // round to nearest even, as std::nearbyint in the default mode
+      __m256i i0 = _mm256_cvtps_epi32 (f0), i1 = _mm256_cvtps_epi32 (f1);
+      __m128i w0 = _mm_packs_epi32 (_mm256_castsi256_si128 (i0),
+                                    _mm256_extracti128_si256 (i0, 1));
+      __m128i w1 = _mm_packs_epi32 (_mm256_castsi256_si128 (i1),
+                                    _mm256_extracti128_si256 (i1, 1));
+      _mm_storeu_si128 ((__m128i *) (q + i), _mm_packs_epi16 (w0, w1));
+    }
+#elif defined(KERNELS_SSE2)
+  const __m128 scale = _mm_set1_ps (inv_scale);
+  const __m128 max_q = _mm_set1_ps (127), min_q = _mm_set1_ps (min_val);
+  for (; i + 8 <= n; i += 8)
+    {
+      __m128 f0 = _mm_mul_ps (_mm_loadu_ps (x + i), scale);
+      __m128 f1 = _mm_mul_ps (_mm_loadu_ps (x + i + 4), scale);
+      f0 = _mm_max_ps (_mm_min_ps (f0, max_q), min_q);
+      f1 = _mm_max_ps (_mm_min_ps (f1, max_q), min_q);
+      __m128i w = _mm_packs_epi32 (_mm_cvtps_epi32 (f0), _mm_cvtps_epi32 (f1));
+      _mm_storel_epi64 ((__m128i *) (q + i), _mm_packs_epi16 (w, w));
+    }
+#endif
+  for (; i < n; i++)
+    {
+      float v = std::nearbyint (x[i] * inv_scale);
+      q[i] = (int8_t) (v > 127 ? 127 : (v < min_val ? min_val : v));
+    }
+}
+
+/**
+ * widen uint8 values to floats: y = x * scale
+ */
+void u8_to_float (const uint8_t *x, float scale, float *y, int n)
+{
+  int i = 0;
+#if defined(KERNELS_AVX2)
+  const __m256 s = _mm256_set1_ps (scale);
+  for (; i + 16 <= n; i += 16)
+    {
+      __m128i bytes = _mm_loadu_si128 ((const __m128i *) (x + i));
+      __m256i i0 = _mm256_cvtepu8_epi32 (bytes);
+      __m256i i1 = _mm256_cvtepu8_epi32 (_mm_srli_si128 (bytes, 8));
+      _mm256_storeu_ps (y + i, _mm256_mul_ps (_mm256_cvtepi32_ps (i0), s));
+      _mm256_storeu_ps (y + i + 8,
+                        _mm256_mul_ps (_mm256_cvtepi32_ps (i1), s));
+    }
+#elif defined(KERNELS_SSE2)
+  const __m128 s = _mm_set1_ps (scale);
+  const __m128i zero = _mm_setzero_si128 ();
+  for (; i + 16 <= n; i += 16)
+    {
+      __m128i bytes = _mm_loadu_si128 ((const __m128i *) (x + i));
+      __m128i lo = _mm_unpacklo_epi8 (bytes, zero);
+      __m128i hi = _mm_unpackhi_epi8 (bytes, zero);
+      __m128i w[4] = {_mm_unpacklo_epi16 (lo, zero),
+                      _mm_unpackhi_epi16 (lo, zero),
+                      _mm_unpacklo_epi16 (hi, zero),
+                      _mm_unpackhi_epi16 (hi, zero)};
+      for (int q = 0; q < 4; q++)
+        _mm_storeu_ps (y + i + 4 * q,
+                       _mm_mul_ps (_mm_cvtepi32_ps (w[q]), s));
+    }
+#endif
+  for (; i < n; i++)
+    y[i] = (float) x[i] * scale;
+}
+
+/**
+ * accumulate scaled uint8 values into floats: y += x * scale
+ * @param x the uint8 values
+ * @param scale the factor of every value
+ * @param y the float accumulators
+ * @param n the values number
+ */
+void u8_accumulate (const uint8_t *x, float scale, float *y, int n)
+{
+  int i = 0;
+#if defined(KERNELS_AVX2)
+  const __m256 s = _mm256_set1_ps (scale);
+  for (; i + 16 <= n; i += 16)
+    {
+      __m128i bytes = _mm_loadu_si128 ((const __m128i *) (x + i));
+      __m256i i0 = _mm256_cvtepu8_epi32 (bytes);
+      __m256i i1 = _mm256_cvtepu8_epi32 (_mm_srli_si128 (bytes, 8));
+      _mm256_storeu_ps (y + i, _mm256_fmadd_ps (_mm256_cvtepi32_ps (i0), s,
+                                                _mm256_loadu_ps (y + i)));
+      _mm256_storeu_ps (y + i + 8,
+                        _mm256_fmadd_ps (_mm256_cvtepi32_ps (i1), s,
+                                         _mm256_loadu_ps (y + i + 8)));
+    }
+#elif defined(KERNELS_SSE2)
+  const __m128 s = _mm_set1_ps (scale);
+  const __m128i zero = _mm_setzero_si128 ();
+  for (; i + 16 <= n; i += 16)
+    {
+      __m128i bytes = _mm_loadu_si128 ((const __m128i *) (x + i));
+      __m128i lo = _mm_unpacklo_epi8 (bytes, zero);
+      __m128i hi = _mm_unpackhi_epi8 (bytes, zero);
+      __m128i w[4] = {_mm_unpacklo_epi16 (lo, zero),
+                      _mm_unpackhi_epi16 (lo, zero),
+                      _mm_unpacklo_epi16 (hi, zero),
+                      _mm_unpackhi_epi16 (hi, zero)};
+      for (int q = 0; q < 4; q++)
+        _mm_storeu_ps (y + i + 4 * q,
+                       _mm_add_ps (_mm_loadu_ps (y + i + 4 * q),
+                                   _mm_mul_ps (_mm_cvtepi32_ps (w[q]), s)));
+    }
+#endif
+  for (; i < n; i++)
+    y[i] += (float) x[i] * scale;
+}
+
+/**
+ * @return the name of the instruction set the kernels were compiled for
+ */
+const char *kernels_isa ()
+{
+#if defined(KERNELS_AVX2)
+  return "avx2";
+#elif defined(KERNELS_SSE2)
+  return "sse2";
+#else
+  return "scalar";
+#endif
+}
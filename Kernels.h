@@ -0,0 +1,304 @@
+// Kernels.h
+
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <cstdint>
+
+/**
+ * Low level dense float kernels used by the Matrix products.
+ * All the matrices are row-major, and given by a pointer to their first
+ * element and a leading dimension (the distance, in floats, between the
+ * beginnings of two consecutive rows).
+ *
+ * The kernels are compiled for the best instruction set enabled at build time:
+ * AVX2+FMA (-mavx2 -mfma / -march=native), SSE2, or a portable scalar code.
+ * The f16 conversions also use F16C (-mf16c / -march=native) when enabled.
+ */
+
+/**
+ * @enum HalfFormat
+ * @brief A 16-bit floating point storage format.
+ */
+enum HalfFormat
+{
+    HALF_F16,   // IEEE binary16
+    HALF_BF16   // bfloat16, the high half of a float
+};
+
+/**
+ * convert a float to a half precision value, rounding to nearest even
+ * @param val the float value
+ * @param format the half precision format
+ * @return the half precision bits
+ */
+uint16_t float_to_half (float val, HalfFormat format);
+
+/**
+ * widen a half precision value to float (exact)
+ * @param val the half precision bits
+ * @param format the half precision format
+ * @return the float value
+ */
+float half_to_float (uint16_t val, HalfFormat format);
+
+/**
+ * the general matrix-matrix product: c = a * b, optionally followed by a
+ * fused epilogue: c(i,j) += bias[i], and c = relu(c).
+ * the product is cache blocked (b panels are kept in L2, a panels in L1),
+ * and computed by a register tiled micro-kernel.
+ * @param a left matrix (m x k)
+ * @param lda leading dimension of a
+ * @param b right matrix (k x n)
+ * @param ldb leading dimension of b
+ * @param c the output matrix (m x n), overwritten
+ * @param ldc leading dimension of c
+ * @param m rows number of a and c
+ * @param n cols number of b and c
+ * @param k cols number of a, rows number of b
+ * @param bias m floats added to every column of c, or nullptr
+ * @param relu whether to clamp the negative outputs to 0
+ */
+void gemm (const float *a, int lda, const float *b, int ldb, float *c,
+           int ldc, int m, int n, int k, const float *bias = nullptr,
+           bool relu = false);
+
+/**
+ * gemm of strided matrices: every matrix is given by a pointer to its first
+ * element, the distance between the beginnings of two consecutive rows and
+ * the distance between two consecutive elements of a row - so a transposed
+ * matrix (strides swapped) or a block of a larger one is multiplied in
+ * place. the strides are only followed while packing, the micro-kernel is
+ * that of gemm.
+ * @param a left matrix (m x k)
+ * @param a_rs row stride of a
+ * @param a_cs col stride of a
+ * @param b right matrix (k x n)
+ * @param b_rs row stride of b
+ * @param b_cs col stride of b
+ * @param c the output matrix (m x n), overwritten
+ * @param c_rs row stride of c
+ * @param c_cs col stride of c
+ * (the other parameters as in gemm)
+ */
+void gemm_strided (const float *a, int a_rs, int a_cs, const float *b,
+                   int b_rs, int b_cs, float *c, int c_rs, int c_cs, int m,
+                   int n, int k, const float *bias = nullptr,
+                   bool relu = false);
+
+/**
+ * gemm of a half precision left matrix: the blocks of a are widened to float
+ * while they are packed for the micro-kernel.
+ * @param a left matrix (m x k) of half precision values
+ * @param format the half precision format of a
+ * (the other parameters as in gemm)
+ */
+void gemm_half (const uint16_t *a, HalfFormat format, int lda,
+                const float *b, int ldb, float *c, int ldc, int m, int n,
+                int k, const float *bias = nullptr, bool relu = false);
+
+/**
+ * the matrix-vector product: y = a * x, optionally followed by a fused
+ * epilogue: y += bias, and y = relu(y).
+ * @param a the matrix (m x k)
+ * @param lda leading dimension of a
+ * @param x input vector (k floats)
+ * @param y output vector (m floats), overwritten
+ * @param m rows number of a
+ * @param k cols number of a
+ * @param bias m floats added to y, or nullptr
+ * @param relu whether to clamp the negative outputs to 0
+ */
+void gemv (const float *a, int lda, const float *x, float *y, int m, int k,
+           const float *bias = nullptr, bool relu = false);
+
+/**
+ * @enum GemvVariant
+ * @brief A matrix-vector product kernel, specialized for a matrix shape.
+ */
+enum GemvVariant
+{
+    GEMV_ROWS,      // gemv: four rows at a time, the general case
+    GEMV_WIDE,      // gemv_wide: long rows
+    GEMV_SKINNY,    // gemv_skinny: a few long rows
+    GEMV_SMALL      // gemv_small: a small matrix, transposed in advance
+};
+
+/**
+ * pick the fastest gemv variant of a matrix shape
+ * @param m rows number of the matrix
+ * @param k cols number of the matrix
+ * @return the variant
+ */
+GemvVariant select_gemv (int m, int k);
+
+/**
+ * @param variant a gemv variant
+ * @return the variant name
+ */
+const char *gemv_variant_name (GemvVariant variant);
+
+/**
+ * gemv of long rows: four rows are reduced together, each into two
+ * accumulators, to hide the FMA latency
+ * (the parameters as in gemv)
+ */
+void gemv_wide (const float *a, int lda, const float *x, float *y, int m,
+                int k, const float *bias = nullptr, bool relu = false);
+
+/**
+ * gemv of a few long rows: every row is reduced on its own, by the whole
+ * vector width
+ * (the parameters as in gemv)
+ */
+void gemv_skinny (const float *a, int lda, const float *x, float *y, int m,
+                  int k, const float *bias = nullptr, bool relu = false);
+
+/**
+ * the leading dimension of a matrix laid out for gemv_small
+ * @param m rows number of the matrix
+ * @return the floats number of every row of the transposed matrix
+ */
+int gemv_small_ld (int m);
+
+/**
+ * lay a matrix out for gemv_small: transposed, every row zero padded to
+ * gemv_small_ld(m) floats
+ * @param a the matrix (m x k)
+ * @param lda leading dimension of a
+ * @param m rows number of a
+ * @param k cols number of a
+ * @param at the output, k * gemv_small_ld(m) floats
+ */
+void gemv_small_pack (const float *a, int lda, int m, int k, float *at);
+
+/**
+ * gemv of a small matrix, fully unrolled over the outputs: y is kept in
+ * registers while the columns of a are scaled by the elements of x, so no
+ * horizontal reduction is needed
+ * @param at the matrix, laid out by gemv_small_pack
+ * (the other parameters as in gemv)
+ */
+void gemv_small (const float *at, const float *x, float *y, int m, int k,
+                 const float *bias = nullptr, bool relu = false);
+
+/**
+ * the block width of the block-sparse kernels: a block is SPARSE_BLOCK
+ * consecutive elements of a row, starting on a column multiple of
+ * SPARSE_BLOCK - a whole AVX2 vector
+ */
+#define SPARSE_BLOCK 8
+
+/**
+ * gemv of a block-sparse matrix: only the stored blocks are read and
+ * multiplied, a vector load of the block and of x each.
+ * the matrix is stored row by row (BSR): the blocks of row i are
+ * [row_ptr[i], row_ptr[i + 1]), block b starts on column block_cols[b], and
+ * its SPARSE_BLOCK elements are values[b * SPARSE_BLOCK ...] (a block past
+ * the last column is zero padded).
+ * @param row_ptr m + 1 block indices
+ * @param block_cols the first column of every block
+ * @param values the elements of every block
+ * (the other parameters as in gemv)
+ */
+void gemv_sparse (const int *row_ptr, const int *block_cols,
+                  const float *values, const float *x, float *y, int m, int k,
+                  const float *bias = nullptr, bool relu = false);
+
+/**
+ * gemm of a block-sparse left matrix: c = a * b, with the epilogue of gemm.
+ * every stored element of a scales a row of b into a row of c.
+ * @param row_ptr m + 1 block indices (as in gemv_sparse)
+ * @param block_cols the first column of every block
+ * @param values the elements of every block
+ * (the other parameters as in gemm)
+ */
+void gemm_sparse (const int *row_ptr, const int *block_cols,
+                  const float *values, const float *b, int ldb, float *c,
+                  int ldc, int m, int n, int k, const float *bias = nullptr,
+                  bool relu = false);
+
+/**
+ * gemv of a half precision matrix: the rows of a are widened to float in
+ * registers inside the reduction (F16C for f16, a shift for bf16), or by a
+ * scalar conversion when the instruction set lacks them.
+ * @param a the matrix (m x k) of half precision values
+ * @param format the half precision format of a
+ * (the other parameters as in gemv)
+ */
+void gemv_half (const uint16_t *a, HalfFormat format, int lda,
+                const float *x, float *y, int m, int k,
+                const float *bias = nullptr, bool relu = false);
+
+/**
+ * in-place softmax of every column of a matrix (max subtracted, so large
+ * inputs do not overflow)
+ * @param c the matrix (m x n)
+ * @param ldc leading dimension of c
+ * @param m rows number of c
+ * @param n cols number of c
+ */
+void softmax_columns (float *c, int ldc, int m, int n);
+
+/**
+ * the int8 matrix-vector product with int32 accumulation: y = a * x
+ * @param a the int8 matrix (m x k)
+ * @param lda leading dimension of a
+ * @param x int8 input vector (k values)
+ * @param y int32 output vector (m values), overwritten
+ * @param m rows number of a
+ * @param k cols number of a
+ */
+void gemv_s8 (const int8_t *a, int lda, const int8_t *x, int32_t *y, int m,
+              int k);
+
+/**
+ * the int8 matrix-vector product of a non-negative input: y = a * x.
+ * faster than gemv_s8, every input value must be in [0, 127].
+ * @param a the int8 matrix (m x k)
+ * @param lda leading dimension of a
+ * @param x uint8 input vector (k values in [0, 127])
+ * @param y int32 output vector (m values), overwritten
+ * @param m rows number of a
+ * @param k cols number of a
+ */
+void gemv_u8s8 (const int8_t *a, int lda, const uint8_t *x, int32_t *y,
+                int m, int k);
+
+/**
+ * quantize floats to int8: q = clamp(round(x * inv_scale), min, 127), where
+ * min is 0 for a non-negative quantization (an input of gemv_u8s8) or -127
+ * @param x the float values
+ * @param inv_scale the inverse quantization scale
+ * @param q the quantized values
+ * @param n the values number
+ * @param non_negative whether to clamp the negative values to 0
+ */
+void quantize_s8 (const float *x, float inv_scale, int8_t *q, int n,
+                  bool non_negative);
+
+/**
+ * widen uint8 values to floats: y = x * scale (e.g. 1/255 for pixels)
+ * @param x the uint8 values
+ * @param scale the factor of every value
+ * @param y the float values
+ * @param n the values number
+ */
+void u8_to_float (const uint8_t *x, float scale, float *y, int n);
+
+/**
+ * accumulate scaled uint8 values into floats: y += x * scale (e.g. the rows
+ * of an image, by their weights in a resampled row)
+ * @param x the uint8 values
+ * @param scale the factor of every value
+ * @param y the float accumulators
+ * @param n the values number
+ */
+void u8_accumulate (const uint8_t *x, float scale, float *y, int n);
+
+/**
+ * @return the name of the instruction set the kernels were compiled for
+ */
+const char *kernels_isa ();
+
+#endif //KERNELS_H
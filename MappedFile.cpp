@@ -0,0 +1,130 @@
+#include "MappedFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <utility>
+
+/**
+ * @struct MappedMatrix
+ * @brief a matrix borrowing its elements from a mapping, together with the
+ *        mapping it keeps alive
+ */
+struct MappedMatrix
+{
+    std::shared_ptr<MappedFile> file;
+    Matrix mat;
+
+    MappedMatrix (std::shared_ptr<MappedFile> mapped_file, float *vec,
+                  int rows, int cols) : file(std::move (mapped_file)),
+                                        mat(vec, rows, cols) {}
+};
+
+/**
+ * map a file read-only
+ * @param path the file path
+ * @return the mapped file, or nullptr if the file could not be mapped
+ */
+std::shared_ptr<MappedFile> MappedFile::open (const std::string &path)
+{
+  int fd = ::open (path.c_str(), O_RDONLY);
+  if (fd < 0)
+    {
+      return nullptr;
+    }
+
+  struct stat st;
+  if (fstat (fd, &st) != 0 || !S_ISREG (st.st_mode) || st.st_size == 0)
+    {
+      close (fd);
+      return nullptr;
+    }
+
+  std::size_t size = (std::size_t) st.st_size;
+  void *data = mmap (nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
+  if (data == MAP_FAILED)
+    {
+      return nullptr;
+    }
+  return std::shared_ptr<MappedFile> (new MappedFile (data, size));
+}
+
+/**
+ * MappedFile destructor, unmaps the file
+ */
+MappedFile::~MappedFile ()
+{
+  munmap (const_cast<void *> (_data), _size);
+}
+
+/**
+ * hint the kernel that the file is read front to back
+ */
+void MappedFile::advise_sequential () const
+{
+  madvise (const_cast<void *> (_data), _size, MADV_SEQUENTIAL);
+}
+
+/**
+ * drop the pages of a byte range that was read, from the mapping
+ * @param offset the first byte of the range
+ * @param size the range size in bytes
+ */
+void MappedFile::release (std::size_t offset, std::size_t size) const
+{
+  // only the whole pages inside the range are dropped.
+  std::size_t page = (std::size_t) sysconf (_SC_PAGESIZE);
+  std::size_t begin = (offset + page - 1) / page * page;
+  std::size_t end = std::min (offset + size, _size) / page * page;
+  if (begin < end)
+    madvise ((char *) const_cast<void *> (_data) + begin, end - begin,
+             MADV_DONTNEED);
+}
+
+/**
+ * create a read-only matrix whose elements live straight in a mapped file
+ * @param file the mapped file
+ * @param offset the byte offset of the first element in the file
+ * @param rows matrix rows-size
+ * @param cols matrix cols-size
+ * @return the matrix, or nullptr if the file is too small or offset is not
+ *         aligned for floats
+ */
+SharedMatrix map_matrix (const std::shared_ptr<MappedFile> &file,
+                         std::size_t offset, int rows, int cols)
+{
+  std::size_t n_bytes = (std::size_t) rows * cols * sizeof (float);
+  if (!file || rows <= 0 || cols <= 0 || offset % alignof (float) != 0
+      || offset > file->size() || file->size() - offset < n_bytes)
+    {
+      return nullptr;
+    }
+
+  // the mapping is read-only, the matrix is only ever exposed as const.
+  float *vec = (float *) const_cast<void *> (file->data())
+               + offset / sizeof (float);
+  auto holder = std::make_shared<MappedMatrix> (file, vec, rows, cols);
+  return SharedMatrix (holder, &holder->mat);
+}
+
+/**
+ * map a raw float32 matrix file without copying
+ * @param path the file path
+ * @param rows matrix rows-size
+ * @param cols matrix cols-size
+ * @return the matrix, or nullptr if the file could not be mapped or does not
+ *         suit the matrix size
+ */
+SharedMatrix map_matrix_file (const std::string &path, int rows, int cols)
+{
+  std::shared_ptr<MappedFile> file = MappedFile::open (path);
+  if (!file || file->size() != (std::size_t) rows * cols * sizeof (float))
+    {
+      return nullptr;
+    }
+  return map_matrix (file, 0, rows, cols);
+}
@@ -0,0 +1,100 @@
+// MappedFile.h
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "Matrix.h"
+
+/**
+ * A read-only memory mapping of a whole file. The pages are shared with the
+ * page cache, so every process mapping the same file uses a single physical
+ * copy of it, and mapping costs the same for any file size.
+ */
+class MappedFile
+{
+  const void *_data;
+  std::size_t _size;
+
+/**
+ * MappedFile constructor, takes over an existing mapping
+ * @param data the mapping address
+ * @param size the mapping size in bytes
+ */
+  MappedFile (const void *data, std::size_t size) : _data(data), _size(size)
+  {}
+
+ public:
+/**
+ * map a file read-only
+ * @param path the file path
+ * @return the mapped file, or nullptr if the file could not be mapped
+ */
+  static std::shared_ptr<MappedFile> open (const std::string &path);
+
+  MappedFile (const MappedFile &oth) = delete;
+  MappedFile &operator= (const MappedFile &rhs) = delete;
+
+/**
+ * MappedFile destructor, unmaps the file
+ */
+  ~MappedFile ();
+
+/**
+ * @return the address of the first byte of the file
+ */
+  const void *data () const
+  {
+    return _data;
+  }
+
+/**
+ * @return the file size in bytes
+ */
+  std::size_t size () const
+  {
+    return _size;
+  }
+/**
+ * hint the kernel that the file is read front to back: the pages are read
+ * ahead aggressively
+ */
+  void advise_sequential () const;
+
+/**
+ * drop the pages of a byte range that was read, from the mapping: a file
+ * larger than RAM is then streamed through with a bounded resident size.
+ * the range may still be read, it is mapped in again on demand.
+ * @param offset the first byte of the range
+ * @param size the range size in bytes
+ */
+  void release (std::size_t offset, std::size_t size) const;
+};
+
+/**
+ * create a read-only matrix whose elements live straight in a mapped file.
+ * the returned matrix keeps the mapping alive.
+ * @param file the mapped file
+ * @param offset the byte offset of the first element in the file
+ * @param rows matrix rows-size
+ * @param cols matrix cols-size
+ * @return the matrix, or nullptr if the file is too small or offset is not
+ *         aligned for floats
+ */
+SharedMatrix map_matrix (const std::shared_ptr<MappedFile> &file,
+                         std::size_t offset, int rows, int cols);
+
+/**
+ * map a raw float32 matrix file (as read by read_binary_file) without copying
+ * @param path the file path
+ * @param rows matrix rows-size
+ * @param cols matrix cols-size
+ * @return the matrix, or nullptr if the file could not be mapped or does not
+ *         suit the matrix size
+ */
+SharedMatrix map_matrix_file (const std::string &path, int rows, int cols);
+
+#endif //MAPPEDFILE_H
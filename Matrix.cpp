@@ -1,4 +1,8 @@
 #include "Matrix.h"
+#include "Kernels.h"
+
+#include <algorithm>
+#include <utility>
 
 #define PRINT_IMAGE_FACTOR_VALUE 0.1
 
@@ -23,14 +27,27 @@
  * @param rows new matrix rows-size
  * @param cols new matrix cols-size
  */
-Matrix::Matrix (int rows, int cols) : _rows(rows), _cols(cols), _vec_size
-(rows*cols), _vec(new float[_vec_size]())
+Matrix::Matrix (int rows, int cols)
+    : Matrix (rows, cols, current_matrix_allocator())
+{}
+
+/**
+ * Matrix allocator constructor, the elements are zero initialized
+ * @param rows new matrix rows-size
+ * @param cols new matrix cols-size
+ * @param alloc the allocator of the storage
+ */
+Matrix::Matrix (int rows, int cols, MatrixAllocator &alloc) : _rows(rows),
+_cols(cols), _vec_size(rows*cols), _capacity(rows*cols), _vec(nullptr),
+_alloc(&alloc)
 {
   if (rows <= 0 || cols <= 0)
     {
       std::cerr << INVALID_ROWS_COLS_NUM_ERROR << std::endl;
       exit (EXIT_FAILURE);
     }
+  _vec = _alloc->allocate (_capacity);
+  std::fill (_vec, _vec + _vec_size, 0.0f);
 }
 
 /**
@@ -38,6 +55,22 @@ Matrix::Matrix (int rows, int cols) : _rows(rows), _cols(cols), _vec_size
  */
 Matrix::Matrix () : Matrix(DEFAULT_ROW_NUM, DEFAULT_COL_NUM) {}
 
+/**
+ * Matrix borrowing-constructor, uses the given elements storage as is
+ * @param vec rows * cols floats, ordered row by row
+ * @param rows new matrix rows-size
+ * @param cols new matrix cols-size
+ */
+Matrix::Matrix (float *vec, int rows, int cols) : _rows(rows), _cols(cols),
+_vec_size(rows*cols), _capacity(rows*cols), _vec(vec), _alloc(nullptr)
+{
+  if (rows <= 0 || cols <= 0)
+    {
+      std::cerr << INVALID_ROWS_COLS_NUM_ERROR << std::endl;
+      exit (EXIT_FAILURE);
+    }
+}
+
 /**
  * Matrix copy-constructor
  * @param oth the copied matrix
@@ -45,20 +78,106 @@ Matrix::Matrix () : Matrix(DEFAULT_ROW_NUM, DEFAULT_COL_NUM) {}
 Matrix::Matrix (const Matrix &oth) : _rows (oth._rows), _cols (oth._cols)
 {
   _vec_size = _rows * _cols;
-  _vec = new float[_vec_size];
+  _capacity = _vec_size;
+  _alloc = &current_matrix_allocator();
+  _vec = _alloc->allocate (_capacity);
 
   for (int i = 0; i < _vec_size; i++)
     _vec[i] = oth._vec[i];
 }
 
+/**
+ * Matrix view-constructor, copies the viewed elements into a new matrix
+ * @param view the copied view
+ */
+Matrix::Matrix (const ConstMatrixView &view)
+    : Matrix (view.get_rows(), view.get_cols())
+{
+  for (int i = 0; i < _rows; i++)
+    for (int j = 0; j < _cols; j++)
+      _vec[i * _cols + j] = view(i, j);
+}
+
+/**
+ * Matrix move-constructor, takes over the storage of oth
+ * @param oth the moved matrix, left empty
+ */
+Matrix::Matrix (Matrix &&oth) noexcept : _rows (oth._rows), _cols (oth._cols),
+_vec_size (oth._vec_size), _capacity (oth._capacity), _vec (oth._vec),
+_alloc (oth._alloc)
+{
+  oth._rows = oth._cols = oth._vec_size = oth._capacity = 0;
+  oth._vec = nullptr;
+  oth._alloc = nullptr;
+}
+
 // Methods & Functions:
+/**
+ * change the matrix dimensions, reusing the storage when it is large enough
+ * @param rows new matrix rows-size
+ * @param cols new matrix cols-size
+ * @return reference of the resized matrix
+ */
+Matrix &Matrix::resize (int rows, int cols)
+{
+  if (rows <= 0 || cols <= 0)
+    {
+      std::cerr << INVALID_ROWS_COLS_NUM_ERROR << std::endl;
+      exit (EXIT_FAILURE);
+    }
+  if (rows * cols > _capacity)
+    {
+      if (_alloc)
+        _alloc->deallocate (_vec, _capacity);
+      else
+        _alloc = &current_matrix_allocator();
+      _capacity = rows * cols;
+      _vec = _alloc->allocate (_capacity);
+    }
+  _rows = rows;
+  _cols = cols;
+  _vec_size = rows * cols;
+  return *this;
+}
+
+/**
+ * multiply every element of this matrix by a float number, in place
+ * @param scalar float to multiply
+ * @return reference of the updated matrix
+ */
+Matrix &Matrix::scale_inplace (float scalar)
+{
+  for (int i = 0; i < _vec_size; i++)
+    _vec[i] *= scalar;
+  return *this;
+}
+
+/**
+ * add another matrix to this matrix, in place: this = this + rhs
+ * @param rhs another matrix
+ * @return reference of the updated matrix
+ */
+Matrix &Matrix::add_inplace (const Matrix &rhs)
+{
+  if (this->_rows != rhs._rows || this->_cols != rhs._cols)
+    {
+      std::cerr << INVALID_MATRIX_SIZE_FOR_ADD << std::endl;
+      exit (EXIT_FAILURE);
+    }
+
+  for (int i = 0; i < this->_vec_size; i++)
+    _vec[i] += rhs._vec[i];
+  return *this;
+}
+
 /**
  * transpose the matrix
  * @return reference of the matrix after transposed
  */
 Matrix &Matrix::transpose ()
 {
-  float *new_vec = new float[_vec_size];
+  MatrixAllocator *alloc = _alloc ? _alloc : &current_matrix_allocator();
+  float *new_vec = alloc->allocate (_vec_size);
 
   // the transpose action:
   for (int i = 0; i < _rows; i++)
@@ -69,10 +188,13 @@ Matrix &Matrix::transpose ()
         }
     }
 
-  delete[] _vec;
+  if (_alloc)
+    _alloc->deallocate (_vec, _capacity);
   _rows = _cols;
   _cols = _vec_size/_rows;
+  _capacity = _vec_size;
   _vec = new_vec;
+  _alloc = alloc;
   return *this;
 }
 
@@ -167,6 +289,20 @@ std::istream& read_binary_file (std::istream &is, Matrix &m)
   return is;
 }
 
+/**
+ * write the matrix elements into a binary file, in the format
+ * read_binary_file reads
+ * @param os stream of the binary file
+ * @param m the matrix to write
+ * @return reference to the given stream, failed if the write failed
+ */
+std::ostream& write_binary_file (std::ostream &os, const Matrix &m)
+{
+  os.write ((const char *) m._vec,
+            (std::streamsize) sizeof (float) * m._rows * m._cols);
+  return os;
+}
+
 // operators:
 /**
  * the '+' operator
@@ -197,17 +333,28 @@ Matrix &Matrix::operator= (const Matrix &rhs)
     {
       return *this;
     }
-  this->_rows = rhs._rows;
-  this->_cols = rhs._cols;
-  this->_vec_size = rhs._vec_size;
-
-  delete[] this->_vec;
-  _vec = new float[_vec_size];
+  resize (rhs._rows, rhs._cols);
   for (int i = 0; i < this->_vec_size; i++)
     this->_vec[i] = rhs._vec[i];
   return *this;
 }
 
+/**
+ * the move '=' operator, take over the storage of rhs
+ * @param rhs another matrix, left with the previous storage of this matrix
+ * @return reference of the updated matrix
+ */
+Matrix &Matrix::operator= (Matrix &&rhs) noexcept
+{
+  std::swap (_rows, rhs._rows);
+  std::swap (_cols, rhs._cols);
+  std::swap (_vec_size, rhs._vec_size);
+  std::swap (_capacity, rhs._capacity);
+  std::swap (_vec, rhs._vec);
+  std::swap (_alloc, rhs._alloc);
+  return *this;
+}
+
 /**
  * the '*' operator perform the product of this matrix and another
  * @param rhs another matrix
@@ -222,19 +369,11 @@ Matrix Matrix::operator* (const Matrix &rhs) const
     }
 
   Matrix new_mat (this->_rows, rhs._cols);
-  for (int i = 0; i < this->_rows; i++)
-    {
-      for (int j = 0; j < rhs._cols; j++)
-        {
-          // inner product of (this-> i row, rhs -> j col)
-          for (int k = 0; k < this->_cols; k++)
-            {
-              float a_i_k = (*this) (i, k);
-              float b_k_j = rhs (k, j);
-              new_mat (i, j) += (a_i_k * b_k_j);
-            }
-        }
-    }
+  if (rhs._cols == 1)
+    gemv (_vec, _cols, rhs._vec, new_mat._vec, _rows, _cols);
+  else
+    gemm (_vec, _cols, rhs._vec, rhs._cols, new_mat._vec, new_mat._cols,
+          _rows, rhs._cols, _cols);
   return new_mat;
 }
 
@@ -247,8 +386,7 @@ Matrix Matrix::operator* (const Matrix &rhs) const
 Matrix Matrix::operator* (const float &scalar) const
 {
   Matrix new_mat (*this);
-  for (int i = 0; i < new_mat._vec_size; i++)
-    new_mat[i] *= scalar;
+  new_mat.scale_inplace (scalar);
   return new_mat;
 }
 
@@ -262,8 +400,7 @@ Matrix Matrix::operator* (const float &scalar) const
 Matrix operator* (const float &scalar, const Matrix &m)
 {
   Matrix new_mat (m);
-  for (int i = 0; i < new_mat._vec_size; i++)
-    new_mat[i] *= scalar;
+  new_mat.scale_inplace (scalar);
   return new_mat;
 }
 
@@ -274,15 +411,7 @@ Matrix operator* (const float &scalar, const Matrix &m)
  */
 Matrix &Matrix::operator+= (const Matrix &rhs)
 {
-  if (this->_rows != rhs._rows || this->_cols != rhs._cols)
-    {
-      std::cerr << INVALID_MATRIX_SIZE_FOR_ADD << std::endl;
-      exit (EXIT_FAILURE);
-    }
-
-  for (int i = 0; i < this->_vec_size; i++)
-    (*this)[i] += rhs[i];
-  return *this;
+  return add_inplace (rhs);
 }
 
 /**
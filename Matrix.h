@@ -9,6 +9,10 @@
 
 #include <iostream>
 #include <cmath>
+#include <memory>
+
+#include "MatrixAllocator.h"
+#include "MatrixView.h"
 
 /**
  * @struct matrix_dims
@@ -19,35 +23,71 @@ typedef struct matrix_dims {
 } matrix_dims;
 
 class Matrix {
-  int _rows, _cols, _vec_size;
+  int _rows, _cols, _vec_size, _capacity;
   float *_vec;
+  // the allocator of the storage, nullptr for a borrowed storage.
+  MatrixAllocator *_alloc;
 
  public:
 
 /**
- * Matrix regular constructor
+ * Matrix regular constructor, the storage comes from the current allocator
+ * of the thread (see ScopedMatrixAllocator)
  * @param rows new matrix rows-size
  * @param cols new matrix cols-size
  */
   Matrix (int rows, int cols);
 
+/**
+ * Matrix allocator constructor, the storage and every reallocation of it
+ * come from the given allocator
+ * @param rows new matrix rows-size
+ * @param cols new matrix cols-size
+ * @param alloc the allocator, must outlive the matrix
+ */
+  Matrix (int rows, int cols, MatrixAllocator &alloc);
+
 /**
  * Matrix default-constructor
  */
   Matrix ();
 
+/**
+ * Matrix borrowing-constructor: the matrix uses the given elements storage
+ * as is, without copying it or ever freeing it. the storage must outlive the
+ * matrix (e.g. a memory mapped parameters file)
+ * @param vec rows * cols floats, ordered row by row
+ * @param rows new matrix rows-size
+ * @param cols new matrix cols-size
+ */
+  Matrix (float *vec, int rows, int cols);
+
 /**
  * Matrix copy-constructor
  * @param oth the copied matrix
  */
   Matrix (const Matrix &oth);
 
+/**
+ * Matrix view-constructor, copies the viewed elements (of any strides) into
+ * a new matrix of the view dimensions
+ * @param view the copied view
+ */
+  explicit Matrix (const ConstMatrixView &view);
+
+/**
+ * Matrix move-constructor, takes over the storage of oth
+ * @param oth the moved matrix, left empty
+ */
+  Matrix (Matrix &&oth) noexcept;
+
 /**
  * Matrix destructor
  */
   ~Matrix ()
   {
-    delete[] _vec;
+    if (_alloc)
+      _alloc->deallocate (_vec, _capacity);
   }
 
 /**
@@ -67,9 +107,73 @@ class Matrix {
     return _cols;
   }
 
+/**
+ * the raw elements getter, ordered row by row
+ * @return pointer to the first element of the matrix
+ */
+  float *data ()
+  {
+    return _vec;
+  }
+
+/**
+ * the raw elements getter, ordered row by row
+ * @return const pointer to the first element of the matrix
+ */
+  const float *data () const
+  {
+    return _vec;
+  }
+
+/**
+ * a view of the matrix elements, e.g. view().transposed() is the transpose
+ * without a copy. the view is valid until the matrix is resized or freed.
+ * @return a writable view of the whole matrix
+ */
+  MatrixView view ()
+  {
+    return MatrixView (_vec, _rows, _cols);
+  }
+
+/**
+ * a view of the matrix elements
+ * @return a read-only view of the whole matrix
+ */
+  ConstMatrixView view () const
+  {
+    return ConstMatrixView (_vec, _rows, _cols);
+  }
+
 // Methods & Functions:
 /**
- * transpose the matrix
+ * change the matrix dimensions. the storage is reused when it is large enough,
+ * so a matrix used as an output buffer stops allocating once it reached its
+ * largest size. a larger storage comes from the allocator of the matrix
+ * (the current one for a borrowed storage). the elements values are
+ * unspecified after a resize.
+ * @param rows new matrix rows-size
+ * @param cols new matrix cols-size
+ * @return reference of the resized matrix
+ */
+  Matrix &resize (int rows, int cols);
+
+/**
+ * multiply every element of this matrix by a float number, in place
+ * @param scalar float to multiply
+ * @return reference of the updated matrix
+ */
+  Matrix &scale_inplace (float scalar);
+
+/**
+ * add another matrix to this matrix, in place: this = this + rhs
+ * @param rhs another matrix
+ * @return reference of the updated matrix
+ */
+  Matrix &add_inplace (const Matrix &rhs);
+
+/**
+ * transpose the matrix, into a new storage (view().transposed() gives the
+ * transpose without copying)
  * @return reference of the matrix after transposed
  */
   Matrix &transpose ();
@@ -107,6 +211,15 @@ class Matrix {
  */
   friend std::istream& read_binary_file (std::istream &is, Matrix &m);
 
+/**
+ * write the matrix elements into a binary file, in the format
+ * read_binary_file reads (raw float32, row by row)
+ * @param os stream of the binary file
+ * @param m the matrix to write
+ * @return reference to the given stream, failed if the write failed
+ */
+  friend std::ostream& write_binary_file (std::ostream &os, const Matrix &m);
+
 //operators:
 /**
  * the '+' operator
@@ -116,14 +229,24 @@ class Matrix {
   Matrix operator+ (const Matrix &rhs) const;
 
 /**
- * the '=' operator, update this matrix to be a copy of rhs
+ * the '=' operator, update this matrix to be a copy of rhs. the current
+ * storage is reused when it is large enough
  * @param rhs another matrix
  * @return reference of the updated matrix
  */
   Matrix &operator= (const Matrix &rhs);
 
 /**
- * this '*' operator perform the product of this matrix and another
+ * the move '=' operator, take over the storage of rhs
+ * @param rhs another matrix, left with the previous storage of this matrix
+ * @return reference of the updated matrix
+ */
+  Matrix &operator= (Matrix &&rhs) noexcept;
+
+/**
+ * this '*' operator perform the product of this matrix and another.
+ * computed by the blocked gemm kernel, or the gemv kernel when rhs is a
+ * single column vector.
  * @param rhs another matrix
  * @return new matrix = this * rhs
  */
@@ -192,4 +315,10 @@ class Matrix {
   friend std::ostream &operator<< (std::ostream &os, const Matrix &m);
 };
 
+/**
+ * a read-only matrix that may be referenced by many owners (layers, networks,
+ * threads) without copying its elements
+ */
+typedef std::shared_ptr<const Matrix> SharedMatrix;
+
 #endif //MATRIX_H
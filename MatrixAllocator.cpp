@@ -0,0 +1,231 @@
+#include "MatrixAllocator.h"
+
+#include <new>
+
+#define POOL_MIN_CLASS 16           // the floats of the smallest class
+#define POOL_CLASSES 19             // up to 16 << 18 floats (16 MB)
+#define POOL_CLASS_CACHE (1 << 20)  // the floats cached per class (4 MB)
+
+/**
+ * @param n a floats number
+ * @return the bytes of n floats, rounded up to the alignment
+ */
+static std::size_t aligned_bytes (std::size_t n)
+{
+  std::size_t bytes = n * sizeof (float);
+  return (bytes + MATRIX_ALIGNMENT - 1) / MATRIX_ALIGNMENT * MATRIX_ALIGNMENT;
+}
+
+/**
+ * an aligned storage of the global allocator
+ */
+static float *aligned_new (std::size_t n)
+{
+  return static_cast<float *> (::operator new (
+      aligned_bytes (n), std::align_val_t (MATRIX_ALIGNMENT)));
+}
+
+/**
+ * free an aligned_new storage
+ */
+static void aligned_delete (float *p)
+{
+  ::operator delete (p, std::align_val_t (MATRIX_ALIGNMENT));
+}
+
+/**
+ * the allocator of the global aligned operator new
+ */
+class AlignedAllocator : public MatrixAllocator
+{
+ public:
+  float *allocate (std::size_t n) override
+  {
+    return aligned_new (n);
+  }
+
+  void deallocate (float *p, std::size_t) override
+  {
+    aligned_delete (p);
+  }
+};
+
+/**
+ * the freed storages of a thread, per size class
+ */
+struct PoolCache
+{
+  std::vector<float *> free_blocks[POOL_CLASSES];
+
+  ~PoolCache ();
+};
+
+// set once the cache of the thread is gone (a trivial thread_local, so it
+// is still readable by the destructors of the other thread_local objects).
+static thread_local bool pool_cache_freed = false;
+static thread_local PoolCache pool_cache;
+
+PoolCache::~PoolCache ()
+{
+  for (std::vector<float *> &blocks : free_blocks)
+    for (float *p : blocks)
+      aligned_delete (p);
+  pool_cache_freed = true;
+}
+
+/**
+ * @param n a floats number
+ * @return the size class of n, or POOL_CLASSES if n is above them
+ */
+static int pool_class (std::size_t n)
+{
+  int c = 0;
+  std::size_t size = POOL_MIN_CLASS;
+  while (size < n && c < POOL_CLASSES)
+    {
+      size <<= 1;
+      c++;
+    }
+  return c;
+}
+
+/**
+ * the allocator of the per-thread size-class caches
+ */
+class PoolAllocator : public MatrixAllocator
+{
+ public:
+  float *allocate (std::size_t n) override
+  {
+    int c = pool_class (n);
+    if (c == POOL_CLASSES)
+      return aligned_new (n);
+    if (!pool_cache_freed && !pool_cache.free_blocks[c].empty())
+      {
+        float *p = pool_cache.free_blocks[c].back();
+        pool_cache.free_blocks[c].pop_back();
+        return p;
+      }
+    return aligned_new ((std::size_t) POOL_MIN_CLASS << c);
+  }
+
+  void deallocate (float *p, std::size_t n) override
+  {
+    if (p == nullptr)
+      return;
+    int c = pool_class (n);
+    if (c == POOL_CLASSES || pool_cache_freed)
+      {
+        aligned_delete (p);
+        return;
+      }
+    // at least a storage is cached per class, however large.
+    std::size_t class_size = (std::size_t) POOL_MIN_CLASS << c;
+    std::size_t max_blocks = POOL_CLASS_CACHE / class_size;
+    if (pool_cache.free_blocks[c].size() >= (max_blocks ? max_blocks : 1))
+      {
+        aligned_delete (p);
+        return;
+      }
+    pool_cache.free_blocks[c].push_back (p);
+  }
+};
+
+static AlignedAllocator aligned_instance;
+static PoolAllocator pool_instance;
+static thread_local MatrixAllocator *current_allocator = &pool_instance;
+
+/**
+ * @return the plain aligned allocator
+ */
+MatrixAllocator &aligned_allocator ()
+{
+  return aligned_instance;
+}
+
+/**
+ * @return the size-class pool allocator
+ */
+MatrixAllocator &pool_allocator ()
+{
+  return pool_instance;
+}
+
+/**
+ * @return the allocator of the matrices the calling thread creates
+ */
+MatrixAllocator &current_matrix_allocator ()
+{
+  return *current_allocator;
+}
+
+/**
+ * make an allocator the current one of the calling thread
+ * @param alloc the allocator of the matrices created in the scope
+ */
+ScopedMatrixAllocator::ScopedMatrixAllocator (MatrixAllocator &alloc)
+    : _previous(current_allocator)
+{
+  current_allocator = &alloc;
+}
+
+/**
+ * restore the previous current allocator
+ */
+ScopedMatrixAllocator::~ScopedMatrixAllocator ()
+{
+  current_allocator = _previous;
+}
+
+/**
+ * the MatrixArena constructor
+ * @param chunk_size the floats number of a chunk
+ */
+MatrixArena::MatrixArena (std::size_t chunk_size)
+    : _chunk(0), _used(0), _chunk_size(chunk_size)
+{}
+
+/**
+ * the MatrixArena destructor, frees the chunks
+ */
+MatrixArena::~MatrixArena ()
+{
+  for (Chunk &chunk : _chunks)
+    aligned_delete (chunk.data);
+}
+
+/**
+ * @param n the number of floats, at least 1
+ * @return aligned storage of n floats, uninitialized
+ */
+float *MatrixArena::allocate (std::size_t n)
+{
+  // every storage starts on an alignment boundary of its chunk.
+  std::size_t floats = aligned_bytes (n) / sizeof (float);
+  while (_chunk < _chunks.size()
+         && _used + floats > _chunks[_chunk].size)
+    {
+      _chunk++;
+      _used = 0;
+    }
+  if (_chunk == _chunks.size())
+    {
+      std::size_t size = floats > _chunk_size ? floats : _chunk_size;
+      _chunks.push_back ({aligned_new (size), size});
+      _used = 0;
+    }
+  float *p = _chunks[_chunk].data + _used;
+  _used += floats;
+  return p;
+}
+
+/**
+ * @return the floats number of the reserved chunks
+ */
+std::size_t MatrixArena::reserved () const
+{
+  std::size_t total = 0;
+  for (const Chunk &chunk : _chunks)
+    total += chunk.size;
+  return total;
+}
@@ -0,0 +1,153 @@
+// MatrixAllocator.h
+
+#ifndef MATRIXALLOCATOR_H
+#define MATRIXALLOCATOR_H
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * the alignment, in bytes, of every Matrix storage: a cache line, so the
+ * rows of a matrix never share a line with another allocation, and a whole
+ * number of AVX2 vectors.
+ */
+#define MATRIX_ALIGNMENT 64
+
+/**
+ * The source of the Matrix element storages. Every storage it returns is
+ * MATRIX_ALIGNMENT aligned, and given back through deallocate of the same
+ * allocator, with the same number of floats.
+ */
+class MatrixAllocator
+{
+ public:
+  virtual ~MatrixAllocator () = default;
+
+/**
+ * @param n the number of floats, at least 1
+ * @return MATRIX_ALIGNMENT aligned storage of n floats, uninitialized
+ */
+  virtual float *allocate (std::size_t n) = 0;
+
+/**
+ * give a storage back
+ * @param p the storage, as allocated by this allocator, or nullptr
+ * @param n the number of floats it was allocated with
+ */
+  virtual void deallocate (float *p, std::size_t n) = 0;
+};
+
+/**
+ * @return the plain aligned allocator: every storage comes from (and goes
+ *         back to) the global aligned operator new. thread safe.
+ */
+MatrixAllocator &aligned_allocator ();
+
+/**
+ * The size-class pool: the storages are rounded up to a power of two
+ * floats, and a freed storage is cached by the freeing thread, per size
+ * class, for the next allocation of its class - so the temporaries of
+ * repeated shapes stop reaching the global allocator. Every thread has its
+ * own caches (no lock); a storage freed by another thread than the one
+ * that allocated it simply moves to that thread's cache. The caches are
+ * bounded per class, and freed when their thread ends.
+ * @return the pool allocator, the default of every thread. thread safe.
+ */
+MatrixAllocator &pool_allocator ();
+
+/**
+ * A bump allocator for the matrices of a single request: allocate moves a
+ * pointer along reserved chunks, deallocate does nothing, and reset frees
+ * all the storages at once - keeping the chunks, so a steady stream of
+ * requests stops allocating after the first one.
+ *
+ * The matrices allocated by an arena must not be used after its reset, and
+ * must be destroyed before the arena is. An arena is used by one thread at
+ * a time.
+ */
+class MatrixArena : public MatrixAllocator
+{
+  struct Chunk
+  {
+    float *data;
+    std::size_t size;
+  };
+
+  std::vector<Chunk> _chunks;
+  std::size_t _chunk, _used;   // the current chunk, and its used floats
+  std::size_t _chunk_size;
+
+ public:
+/**
+ * the MatrixArena constructor, reserves nothing until the first allocation
+ * @param chunk_size the floats number of a chunk (a larger storage gets a
+ *                   chunk of its own size)
+ */
+  explicit MatrixArena (std::size_t chunk_size = 1 << 18);
+
+  MatrixArena (const MatrixArena &) = delete;
+  MatrixArena &operator= (const MatrixArena &) = delete;
+
+/**
+ * the MatrixArena destructor, frees the chunks
+ */
+  ~MatrixArena () override;
+
+/**
+ * @param n the number of floats, at least 1
+ * @return MATRIX_ALIGNMENT aligned storage of n floats, uninitialized
+ */
+  float *allocate (std::size_t n) override;
+
+/**
+ * does nothing: the storages are freed together, by reset
+ */
+  void deallocate (float *, std::size_t) override
+  {}
+
+/**
+ * free all the storages allocated since the last reset, in one step
+ */
+  void reset ()
+  {
+    _chunk = 0;
+    _used = 0;
+  }
+
+/**
+ * @return the floats number of the reserved chunks
+ */
+  std::size_t reserved () const;
+};
+
+/**
+ * @return the allocator of the matrices the calling thread creates
+ */
+MatrixAllocator &current_matrix_allocator ();
+
+/**
+ * Makes an allocator the current one of the calling thread, for the scope
+ * of the object. A matrix keeps the allocator it was created with: a
+ * resize or transpose reallocates from it, whatever is current at the
+ * time.
+ */
+class ScopedMatrixAllocator
+{
+  MatrixAllocator *_previous;
+
+ public:
+/**
+ * @param alloc the allocator of the matrices created in the scope
+ */
+  explicit ScopedMatrixAllocator (MatrixAllocator &alloc);
+
+  ScopedMatrixAllocator (const ScopedMatrixAllocator &) = delete;
+  ScopedMatrixAllocator &operator= (const ScopedMatrixAllocator &) = delete;
+
+/**
+ * restore the previous current allocator
+ */
+  ~ScopedMatrixAllocator ();
+};
+
+#endif //MATRIXALLOCATOR_H
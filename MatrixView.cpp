@@ -0,0 +1,78 @@
+#include "MatrixView.h"
+
+#include <cstdlib>
+#include <iostream>
+
+#include "Kernels.h"
+
+#define INVALID_VIEW_SIZE_FOR_MULT "Error: multiply not defined for A,B,C " \
+                                   "views of unmatched dimensions.\n"
+#define INVALID_VIEW_SIZE_FOR_COPY "Error: copy not defined for views of " \
+                                   "unequal dimensions.\n"
+#define COPY_TILE 16
+
+/**
+ * report an invalid view operation, and exit (code == 1)
+ * @param msg the error message
+ */
+void matrix_view_error (const char *msg)
+{
+  std::cerr << msg << std::endl;
+  exit (EXIT_FAILURE);
+}
+
+/**
+ * the product of two views: c = a * b (+ bias, relu)
+ * @param a left view (m x k)
+ * @param b right view (k x n)
+ * @param c the output view (m x n), overwritten
+ * @param bias m floats, or nullptr
+ * @param relu whether to clamp the negative outputs to 0
+ */
+void multiply (const ConstMatrixView &a, const ConstMatrixView &b,
+               const MatrixView &c, const float *bias, bool relu)
+{
+  int m = a.get_rows(), n = b.get_cols(), k = a.get_cols();
+  if (b.get_rows() != k || c.get_rows() != m || c.get_cols() != n)
+    matrix_view_error (INVALID_VIEW_SIZE_FOR_MULT);
+
+  // a single column of consecutive floats, by a matrix of rows: the gemv.
+  bool unit_rows = a.get_col_stride() == 1 || k <= 1;
+  bool unit_x = b.get_row_stride() == 1 || k <= 1;
+  bool unit_y = c.get_row_stride() == 1 || m <= 1;
+  if (n == 1 && unit_rows && unit_x && unit_y)
+    {
+      gemv (a.data(), a.get_row_stride(), b.data(), c.data(), m, k, bias,
+            relu);
+      return;
+    }
+  gemm_strided (a.data(), a.get_row_stride(), a.get_col_stride(), b.data(),
+                b.get_row_stride(), b.get_col_stride(), c.data(),
+                c.get_row_stride(), c.get_col_stride(), m, n, k, bias, relu);
+}
+
+/**
+ * copy the elements of a view into another of the same dimensions
+ * @param src the source view
+ * @param dst the destination view
+ */
+void copy_view (const ConstMatrixView &src, const MatrixView &dst)
+{
+  int rows = src.get_rows(), cols = src.get_cols();
+  if (dst.get_rows() != rows || dst.get_cols() != cols)
+    matrix_view_error (INVALID_VIEW_SIZE_FOR_COPY);
+
+  const float *s = src.data();
+  float *d = dst.data();
+  long s_rs = src.get_row_stride(), s_cs = src.get_col_stride();
+  long d_rs = dst.get_row_stride(), d_cs = dst.get_col_stride();
+  for (int i0 = 0; i0 < rows; i0 += COPY_TILE)
+    for (int j0 = 0; j0 < cols; j0 += COPY_TILE)
+      {
+        int i1 = i0 + COPY_TILE < rows ? i0 + COPY_TILE : rows;
+        int j1 = j0 + COPY_TILE < cols ? j0 + COPY_TILE : cols;
+        for (int i = i0; i < i1; i++)
+          for (int j = j0; j < j1; j++)
+            d[i * d_rs + j * d_cs] = s[i * s_rs + j * s_cs];
+      }
+}
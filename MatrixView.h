@@ -0,0 +1,242 @@
+// MatrixView.h
+
+#ifndef MATRIXVIEW_H
+#define MATRIXVIEW_H
+
+/**
+ * report an invalid view operation, and exit (code == 1)
+ * @param msg the error message
+ */
+[[noreturn]] void matrix_view_error (const char *msg);
+
+#define VIEW_OUT_OF_RANGE "Error: for view(i,j) - i,j must be in range of " \
+                          "the view dimensions.\n"
+#define VIEW_INVALID_BLOCK "Error: a view block must lie inside the view.\n"
+#define VIEW_INVALID_RESHAPE "Error: only a contiguous view of the same " \
+                             "size can be reshaped.\n"
+
+/**
+ * A non-owning view of a matrix: a pointer to its (0,0) element, its
+ * dimensions, and the distances (in elements) between two consecutive rows
+ * and two consecutive cols. A transpose swaps the dimensions and the
+ * strides, a block moves the pointer - neither copies an element, so a view
+ * may expose a slice of a larger buffer (e.g. some columns of a batch) to
+ * the kernels (see multiply).
+ *
+ * The viewed elements must outlive the view. The element access is checked
+ * (exit on out of range indices) unless NDEBUG is defined, so the release
+ * builds (-DNDEBUG) index the elements directly.
+ * @tparam T float, or const float for a read-only view
+ */
+template <typename T>
+class BasicMatrixView
+{
+  T *_data;
+  int _rows, _cols;
+  int _row_stride, _col_stride;
+
+ public:
+/**
+ * the strided view constructor
+ * @param data the (0,0) element
+ * @param rows the view rows-size
+ * @param cols the view cols-size
+ * @param row_stride the distance between the beginnings of two rows
+ * @param col_stride the distance between two elements of a row
+ */
+  BasicMatrixView (T *data, int rows, int cols, int row_stride,
+                   int col_stride)
+      : _data(data), _rows(rows), _cols(cols), _row_stride(row_stride),
+        _col_stride(col_stride)
+  {}
+
+/**
+ * the contiguous view constructor, of rows * cols elements row by row
+ * @param data the (0,0) element
+ * @param rows the view rows-size
+ * @param cols the view cols-size
+ */
+  BasicMatrixView (T *data, int rows, int cols)
+      : BasicMatrixView (data, rows, cols, cols, 1)
+  {}
+
+/**
+ * the read-only view of a writable view
+ * @param oth the writable view
+ */
+  template <typename U>
+  BasicMatrixView (const BasicMatrixView<U> &oth)
+      : BasicMatrixView (oth.data(), oth.get_rows(), oth.get_cols(),
+                         oth.get_row_stride(), oth.get_col_stride())
+  {}
+
+/**
+ * @return the view rows number
+ */
+  int get_rows () const
+  {
+    return _rows;
+  }
+
+/**
+ * @return the view cols number
+ */
+  int get_cols () const
+  {
+    return _cols;
+  }
+
+/**
+ * @return the distance between the beginnings of two consecutive rows
+ */
+  int get_row_stride () const
+  {
+    return _row_stride;
+  }
+
+/**
+ * @return the distance between two consecutive elements of a row
+ */
+  int get_col_stride () const
+  {
+    return _col_stride;
+  }
+
+/**
+ * @return pointer to the (0,0) element
+ */
+  T *data () const
+  {
+    return _data;
+  }
+
+/**
+ * @return whether the elements are rows * cols consecutive floats, row by
+ *         row (the layout of a Matrix)
+ */
+  bool is_contiguous () const
+  {
+    return (_cols <= 1 || _col_stride == 1)
+           && (_rows <= 1 || _row_stride == _cols);
+  }
+
+/**
+ * this view(i,j) operator
+ * @param i index symbolize the row number
+ * @param j index symbolize the col number
+ * @return a reference to the (i,j) element
+ */
+  T &operator() (int i, int j) const
+  {
+#ifndef NDEBUG
+    if (i < 0 || i >= _rows || j < 0 || j >= _cols)
+      matrix_view_error (VIEW_OUT_OF_RANGE);
+#endif
+    return _data[(long) i * _row_stride + (long) j * _col_stride];
+  }
+
+/**
+ * @return the transposed view of the same elements
+ */
+  BasicMatrixView transposed () const
+  {
+    return BasicMatrixView (_data, _cols, _rows, _col_stride, _row_stride);
+  }
+
+/**
+ * a block of the view
+ * @param i the block first row
+ * @param j the block first col
+ * @param rows the block rows-size
+ * @param cols the block cols-size
+ * @return the view of the block, with the strides of this view
+ */
+  BasicMatrixView block (int i, int j, int rows, int cols) const
+  {
+    if (i < 0 || j < 0 || rows < 0 || cols < 0 || i + rows > _rows
+        || j + cols > _cols)
+      matrix_view_error (VIEW_INVALID_BLOCK);
+    return BasicMatrixView (_data + (long) i * _row_stride
+                            + (long) j * _col_stride,
+                            rows, cols, _row_stride, _col_stride);
+  }
+
+/**
+ * @param i a row index
+ * @return the view of row i (1 x cols)
+ */
+  BasicMatrixView row (int i) const
+  {
+    return block (i, 0, 1, _cols);
+  }
+
+/**
+ * @param j a col index
+ * @return the view of col j (rows x 1)
+ */
+  BasicMatrixView col (int j) const
+  {
+    return block (0, j, _rows, 1);
+  }
+
+/**
+ * view the same elements in another shape, row by row
+ * exits (code == 1) if the view is not contiguous, or of another size.
+ * @param rows the new rows-size
+ * @param cols the new cols-size
+ * @return the reshaped view
+ */
+  BasicMatrixView reshaped (int rows, int cols) const
+  {
+    if (!is_contiguous() || (long) rows * cols != (long) _rows * _cols)
+      matrix_view_error (VIEW_INVALID_RESHAPE);
+    return BasicMatrixView (_data, rows, cols);
+  }
+
+/**
+ * @return the view of the same elements as a single column
+ */
+  BasicMatrixView vectorized () const
+  {
+    return reshaped (_rows * _cols, 1);
+  }
+};
+
+/**
+ * a writable view of float elements
+ */
+typedef BasicMatrixView<float> MatrixView;
+
+/**
+ * a read-only view of float elements
+ */
+typedef BasicMatrixView<const float> ConstMatrixView;
+
+/**
+ * the product of two views: c = a * b, optionally followed by c(i,j) +=
+ * bias[i], and c = relu(c). the views may be of any strides (transposed,
+ * or blocks of larger buffers), and are read in place: a single column
+ * product runs the gemv kernel, any other the gemm kernel, whose packing
+ * follows the strides.
+ * exits (code == 1) if the dimensions do not match.
+ * @param a left view (m x k)
+ * @param b right view (k x n)
+ * @param c the output view (m x n), overwritten, not overlapping a or b
+ * @param bias m floats, or nullptr
+ * @param relu whether to clamp the negative outputs to 0
+ */
+void multiply (const ConstMatrixView &a, const ConstMatrixView &b,
+               const MatrixView &c, const float *bias = nullptr,
+               bool relu = false);
+
+/**
+ * copy the elements of a view into another of the same dimensions, e.g. a
+ * transposed view into a matrix. the copy is tiled, so a transposing copy
+ * reads and writes whole cache lines.
+ * exits (code == 1) if the dimensions do not match.
+ * @param src the source view
+ * @param dst the destination view, not overlapping src
+ */
+void copy_view (const ConstMatrixView &src, const MatrixView &dst);
+
+#endif //MATRIXVIEW_H
@@ -1,12 +1,308 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
 #include "MlpNetwork.h"
+#include "Trace.h"
+
+#define INVALID_BATCH_SIZE "Error: batch rows must match the image size.\n"
+#define EMPTY_BATCH "Error: can not classify an empty batch.\n"
+#define INVALID_TOPOLOGY "Error: invalid network topology, every layer " \
+                         "input must match the previous layer output.\n"
+#define INVALID_RANK "Error: a low-rank layer rank must be positive, and " \
+                     "at most the layer inputs and outputs numbers.\n"
+#define INVALID_CASCADE "Error: a cascade network must match the network " \
+                        "input and output sizes.\n"
+#define JACOBI_MAX_SWEEPS 50
+#define JACOBI_EPSILON 1e-24
+
+/**
+ * @struct MlpCascade
+ * @brief The cheap network of a cascade, its threshold and its counters.
+ */
+struct MlpCascade
+{
+  MlpNetwork cheap;
+  float threshold;
+  std::atomic<long> images, escalated;
+
+  MlpCascade (const MlpNetwork &cheap, float threshold)
+      : cheap(cheap), threshold(threshold), images(0), escalated(0)
+  {}
+};
+
+/**
+ * the per-thread workspace of the operator() calls without a workspace
+ */
+static thread_local MlpWorkspace thread_workspace;
+
+/**
+ * copy some columns of a matrix into a matrix of their own
+ * @param m the matrix
+ * @param cols the columns to copy, in order
+ * @param out the matrix of the columns, resized to m rows x cols.size()
+ */
+static void gather_columns (const Matrix &m, const std::vector<int> &cols,
+                            Matrix &out)
+{
+  out.resize (m.get_rows(), (int) cols.size());
+  for (size_t c = 0; c < cols.size(); c++)
+    copy_view (m.view().col (cols[c]), out.view().col ((int) c));
+}
+
+/**
+ * the eigen decomposition of a symmetric matrix, by cyclic Jacobi
+ * rotations: every rotation zeroes an off-diagonal pair, until the
+ * off-diagonal part is negligible.
+ * @param a the n x n matrix, row by row; left with the eigenvalues on its
+ *        diagonal
+ * @param n the matrix size
+ * @param vecs the n x n eigenvectors, row by row: a column per eigenvalue
+ */
+static void symmetric_eigen (std::vector<double> &a, int n,
+                             std::vector<double> &vecs)
+{
+  vecs.assign ((size_t) n * n, 0.0);
+  for (int i = 0; i < n; i++)
+    vecs[(size_t) i * n + i] = 1.0;
+
+  for (int sweep = 0; sweep < JACOBI_MAX_SWEEPS; sweep++)
+    {
+      double off = 0, diag = 0;
+      for (int p = 0; p < n; p++)
+        {
+          diag += a[(size_t) p * n + p] * a[(size_t) p * n + p];
+          for (int q = p + 1; q < n; q++)
+            off += a[(size_t) p * n + q] * a[(size_t) p * n + q];
+        }
+      if (off <= JACOBI_EPSILON * diag)
+        return;
+
+      for (int p = 0; p < n; p++)
+        for (int q = p + 1; q < n; q++)
+          {
+            double apq = a[(size_t) p * n + q];
+            if (apq == 0)
+              continue;
+            double theta = (a[(size_t) q * n + q] - a[(size_t) p * n + p])
+                           / (2 * apq);
+            double t = (theta >= 0 ? 1.0 : -1.0)
+                       / (std::fabs (theta) + std::sqrt (theta * theta + 1));
+            double c = 1 / std::sqrt (t * t + 1), sn = t * c;
+            for (int k = 0; k < n; k++)
+              {
+                double &akp = a[(size_t) k * n + p];
+                double &akq = a[(size_t) k * n + q];
+                double x = akp, y = akq;
+                akp = c * x - sn * y;
+                akq = sn * x + c * y;
+              }
+            for (int k = 0; k < n; k++)
+              {
+                double &apk = a[(size_t) p * n + k];
+                double &aqk = a[(size_t) q * n + k];
+                double x = apk, y = aqk;
+                apk = c * x - sn * y;
+                aqk = sn * x + c * y;
+              }
+            for (int k = 0; k < n; k++)
+              {
+                double &vkp = vecs[(size_t) k * n + p];
+                double &vkq = vecs[(size_t) k * n + q];
+                double x = vkp, y = vkq;
+                vkp = c * x - sn * y;
+                vkq = sn * x + c * y;
+              }
+          }
+    }
+}
 
 /**
  * the MlNetwork regular-constructor
  * @param weights array of the network's weight matrices
  * @param biases array of the network's biases matrices
  */
-MlpNetwork::MlpNetwork (Matrix *weights, Matrix *biases) : _weights(weights)
-                                                          , _biases(biases) {}
+MlpNetwork::MlpNetwork (Matrix *weights, Matrix *biases)
+{
+  _layers.reserve (MLP_SIZE);
+  for (int i=0 ; i < MLP_SIZE; i++)
+    {
+      ActivationType act_type = i < MLP_SIZE-1 ? RELU : SOFTMAX;
+      _layers.emplace_back (weights[i], biases[i], act_type);
+    }
+}
+
+/**
+ * the MlpNetwork shared-parameters constructor
+ * @param weights array of the network's weight matrices
+ * @param biases array of the network's biases matrices
+ * @param precision the weights storage precision
+ */
+MlpNetwork::MlpNetwork (const SharedMatrix *weights,
+                        const SharedMatrix *biases,
+                        WeightsPrecision precision)
+{
+  _layers.reserve (MLP_SIZE);
+  for (int i=0 ; i < MLP_SIZE; i++)
+    add_layer (weights[i], biases[i], i < MLP_SIZE-1 ? RELU : SOFTMAX,
+               precision);
+}
+
+/**
+ * the MlpNetwork runtime-topology constructor
+ * @param weights the weight matrices, one per layer
+ * @param biases the bias matrices, one per layer
+ * @param activations the activations, one per layer
+ * @param precision the weights storage precision
+ */
+MlpNetwork::MlpNetwork (const std::vector<SharedMatrix> &weights,
+                        const std::vector<SharedMatrix> &biases,
+                        const std::vector<ActivationType> &activations,
+                        WeightsPrecision precision)
+{
+  if (weights.empty() || weights.size() != biases.size()
+      || weights.size() != activations.size())
+    {
+      std::cerr << INVALID_TOPOLOGY << std::endl;
+      exit (EXIT_FAILURE);
+    }
+  _layers.reserve (weights.size());
+  for (size_t i = 0; i < weights.size(); i++)
+    {
+      if (!weights[i] || (i > 0 && weights[i]->get_cols()
+                                   != weights[i - 1]->get_rows()))
+        {
+          std::cerr << INVALID_TOPOLOGY << std::endl;
+          exit (EXIT_FAILURE);
+        }
+      add_layer (weights[i], biases[i], activations[i], precision);
+    }
+}
+
+/**
+ * add a layer, converting its weights to the given precision
+ * @param w the layer weight matrix
+ * @param bias the layer bias matrix
+ * @param act_type the layer activation
+ * @param precision the weights storage precision
+ */
+void MlpNetwork::add_layer (const SharedMatrix &w, const SharedMatrix &bias,
+                            ActivationType act_type,
+                            WeightsPrecision precision)
+{
+  if (precision == PRECISION_F32)
+    {
+      _layers.emplace_back (w, bias, act_type);
+      return;
+    }
+  HalfFormat format = precision == PRECISION_F16 ? HALF_F16 : HALF_BF16;
+  _layers.emplace_back (std::make_shared<const HalfMatrix> (*w, format), bias,
+                        act_type);
+}
+
+/**
+ * a cheaper approximation of the network: the first layer weights replaced
+ * by their best rank r approximation u * v, evaluated as two layers
+ * @param rank the rank r
+ * @return the approximated network, of no cache and no cascade
+ */
+MlpNetwork MlpNetwork::low_rank (int rank) const
+{
+  const Dense &first = _layers.front();
+  int out = first.get_output_size(), in = first.get_input_size();
+  if (rank < 1 || rank > std::min (in, out))
+    {
+      std::cerr << INVALID_RANK << std::endl;
+      exit (EXIT_FAILURE);
+    }
+  const HalfMatrix *half = first.get_half_weights();
+  Matrix widened = half ? half->to_matrix() : Matrix();
+  const float *w = half ? widened.data() : first.get_weights().data();
+
+  // the leading eigenvectors of w * w^T are the leading left singular
+  // vectors of w: u * u^T * w is the best rank r approximation of w.
+  std::vector<double> gram ((size_t) out * out), vecs;
+  for (int i = 0; i < out; i++)
+    for (int j = i; j < out; j++)
+      {
+        const float *wi = w + (size_t) i * in, *wj = w + (size_t) j * in;
+        double dot = 0;
+        for (int k = 0; k < in; k++)
+          dot += (double) wi[k] * wj[k];
+        gram[(size_t) i * out + j] = gram[(size_t) j * out + i] = dot;
+      }
+  symmetric_eigen (gram, out, vecs);
+  std::vector<int> order (out);
+  for (int i = 0; i < out; i++)
+    order[i] = i;
+  std::sort (order.begin(), order.end(), [&gram, out] (int a, int b)
+  {
+    return gram[(size_t) a * out + a] > gram[(size_t) b * out + b];
+  });
+
+  auto u = std::make_shared<Matrix> (out, rank);
+  for (int i = 0; i < out; i++)
+    for (int c = 0; c < rank; c++)
+      (*u)(i, c) = (float) vecs[(size_t) i * out + order[c]];
+  // v = u^T * w, a row at a time, accumulated over the rows of w.
+  auto v = std::make_shared<Matrix> (rank, in);
+  std::vector<double> row (in);
+  for (int c = 0; c < rank; c++)
+    {
+      std::fill (row.begin(), row.end(), 0.0);
+      for (int i = 0; i < out; i++)
+        {
+          double coef = vecs[(size_t) i * out + order[c]];
+          const float *wi = w + (size_t) i * in;
+          for (int k = 0; k < in; k++)
+            row[k] += coef * wi[k];
+        }
+      float *vc = v->data() + (size_t) c * in;
+      for (int k = 0; k < in; k++)
+        vc[k] = (float) row[k];
+    }
+
+  MlpNetwork net = *this;
+  net._cache = nullptr;
+  net._cascade = nullptr;
+  net._layers.erase (net._layers.begin());
+  net._layers.insert (net._layers.begin(),
+                      Dense (u, std::make_shared<Matrix> (first.get_bias()),
+                             first.get_activation().get_activation_type()));
+  net._layers.insert (net._layers.begin(),
+                      Dense (v, std::make_shared<Matrix> (rank, 1), LINEAR));
+  return net;
+}
+
+/**
+ * evaluate the network as a cascade of a cheap network and this one
+ * @param cheap the cheap network, of the same input and output sizes
+ * @param threshold the winning probability at which the cheap result is
+ *        kept
+ */
+void MlpNetwork::set_cascade (const MlpNetwork &cheap, float threshold)
+{
+  if (cheap.get_input_size() != get_input_size()
+      || cheap.get_output_size() != get_output_size())
+    {
+      std::cerr << INVALID_CASCADE << std::endl;
+      exit (EXIT_FAILURE);
+    }
+  _cascade = std::make_shared<MlpCascade> (cheap, threshold);
+  // the cheap network answers alone: never through its own cascade.
+  _cascade->cheap._cascade = nullptr;
+  _cascade->cheap._cache = nullptr;
+}
+
+/**
+ * @return the cascade counters, zeros if the network is not a cascade
+ */
+CascadeStats MlpNetwork::get_cascade_stats () const
+{
+  if (!_cascade)
+    return {0, 0};
+  return {_cascade->images.load(), _cascade->escalated.load()};
+}
 
 /**
  * the MlpNetwork operator, compute the network manipulations on the given
@@ -14,29 +310,360 @@ MlpNetwork::MlpNetwork (Matrix *weights, Matrix *biases) : _weights(weights)
  * @param m the input matrix
  * @return a digit struct, contain the values and its distributions
  */
-digit MlpNetwork::operator() (Matrix &m)
+digit MlpNetwork::operator() (const Matrix &m) const
 {
-  // creating the output vector:
-  for (int i=0 ; i < MLP_SIZE; i++)
+  return (*this) (m, thread_workspace);
+}
+
+/**
+ * the MlpNetwork operator, evaluated in a caller owned workspace
+ * @param m the input matrix
+ * @param ws the workspace to evaluate in
+ * @return a digit struct, contain the values and its distributions
+ */
+digit MlpNetwork::operator() (const Matrix &m, MlpWorkspace &ws) const
+{
+  uint64_t key = 0;
+  digit d;
+  if (_cache)
     {
-      ActivationType act_type = i < MLP_SIZE-1 ? RELU : SOFTMAX;
-      Dense cur_dense(this->_weights[i], this->_biases[i], act_type);
-      m = cur_dense(m);
+      key = ResultCache::hash (m.data(), m.get_rows() * m.get_cols());
+      if (_cache->lookup (key, d))
+        return d;
+    }
+  d = evaluate (m, ws);
+  if (_cache)
+    _cache->insert (key, d);
+  return d;
+}
+
+/**
+ * the label only inference: the predicted digit, picked from the logits
+ * @param m the input matrix
+ * @return the identified digit value
+ */
+unsigned int MlpNetwork::classify (const Matrix &m) const
+{
+  return classify (m, thread_workspace);
+}
 
+/**
+ * the label only inference, evaluated in a caller owned workspace
+ * @param m the input matrix
+ * @param ws the workspace to evaluate in
+ * @return the identified digit value
+ */
+unsigned int MlpNetwork::classify (const Matrix &m, MlpWorkspace &ws) const
+{
+  // a cached result, or a cascade decision, needs the winner probability.
+  if (_cache || _cascade)
+    return (*this) (m, ws).value;
+  // the softmax is monotonic, so the largest logit is the winner.
+  return column_argmax (forward (m, ws, true), 0).value;
+}
+
+/**
+ * the k most probable digits, ranked
+ * @param m the input matrix
+ * @param k the number of digits, clamped to the output size
+ * @return up to k digits, the most probable first
+ */
+std::vector<digit> MlpNetwork::top_k (const Matrix &m, int k) const
+{
+  return top_k (m, k, thread_workspace);
+}
+
+/**
+ * the k most probable digits, evaluated in a caller owned workspace
+ * @param m the input matrix
+ * @param k the number of digits, clamped to the output size
+ * @param ws the workspace to evaluate in
+ * @return up to k digits, the most probable first
+ */
+std::vector<digit> MlpNetwork::top_k (const Matrix &m, int k,
+                                      MlpWorkspace &ws) const
+{
+  const Matrix &out = forward (m, ws, true);
+  int classes = out.get_rows();
+  std::vector<digit> ranked (classes);
+  for (int i = 0; i < classes; i++)
+    ranked[i] = {(unsigned int) i, out(i, 0)};
+  k = std::max (0, std::min (k, classes));
+  std::partial_sort (ranked.begin(), ranked.begin() + k, ranked.end(),
+                     [] (const digit &a, const digit &b)
+                     {
+                       return a.probability > b.probability
+                              || (a.probability == b.probability
+                                  && a.value < b.value);
+                     });
+  ranked.resize (k);
+  if (k == 0 || !softmax_output())
+    return ranked;
+
+  // max-subtracted softmax of the winners only: ranked[0] holds the max.
+  float max_logit = ranked[0].probability;
+  float sum = 0;
+  for (int i = 0; i < classes; i++)
+    sum += std::exp (out(i, 0) - max_logit);
+  for (digit &d : ranked)
+    d.probability = std::exp (d.probability - max_logit) / sum;
+  return ranked;
+}
+
+/**
+ * run all the network layers on the given matrix, into the given outputs
+ * @param m the input matrix, one input vector per column
+ * @param outputs the output matrix of every layer, grown as needed
+ * @param logits whether to stop before the softmax of the last layer
+ * @return reference of the last layer output, inside outputs
+ */
+const Matrix &MlpNetwork::forward (const Matrix &m,
+                                   std::vector<Matrix> &outputs,
+                                   bool logits) const
+{
+  TRACE_SCOPE ("mlp_network");
+  TRACE_COUNT ("inferences", m.get_cols());
+  if (outputs.size() < _layers.size())
+    {
+      // the workspace outlives the request: never from a request arena.
+      ScopedMatrixAllocator workspace_alloc (pool_allocator());
+      outputs.resize (_layers.size());
     }
 
-  // export the final solution:
-  unsigned int value;
-  float best_probability = 0;
-  for (int i=0; i < m.get_rows() * m.get_cols(); i++)
+  const Matrix *in = &m;
+  for (size_t i = 0; i < _layers.size(); i++)
     {
-      if (m[i] > best_probability)
+      if (logits && i + 1 == _layers.size())
+        _layers[i].forward_logits (*in, outputs[i]);
+      else
+        _layers[i].forward (*in, outputs[i]);
+      in = &outputs[i];
+    }
+  return *in;
+}
+
+/**
+ * pick the most probable digit of a given column of the network output
+ * @param probs the network output matrix
+ * @param col the column (input index) to decide on
+ * @return a digit struct, contain the value and its probability
+ */
+digit MlpNetwork::column_argmax (const Matrix &probs, int col)
+{
+  digit d = {0, probs(0, col)};
+  for (int i = 1; i < probs.get_rows(); i++)
+    {
+      if (probs(i, col) > d.probability)
+        d = {(unsigned int) i, probs(i, col)};
+    }
+  return d;
+}
+
+/**
+ * pick the most probable digit of a given column of logits, computing only
+ * its probability, max-subtracted: 1 / sum(exp(logit - max))
+ * @param logits the logits matrix
+ * @param col the column (input index) to decide on
+ * @return a digit struct, contain the value and its probability
+ */
+digit MlpNetwork::logits_argmax (const Matrix &logits, int col)
+{
+  digit d = column_argmax (logits, col);
+  float sum = 0;
+  for (int i = 0; i < logits.get_rows(); i++)
+    sum += std::exp (logits(i, col) - d.probability);
+  d.probability = 1 / sum;
+  return d;
+}
+
+/**
+ * pick the most probable digit of a column of the forward(logits) output
+ * @param out the output matrix
+ * @param col the column (input index) to decide on
+ * @return a digit struct, contain the value and its probability
+ */
+digit MlpNetwork::output_argmax (const Matrix &out, int col) const
+{
+  return softmax_output() ? logits_argmax (out, col)
+                          : column_argmax (out, col);
+}
+
+/**
+ * classify a batch of images in one pass - every layer runs as one
+ * matrix-matrix product, so each weight matrix is read once per batch
+ * @param batch get_input_size() x N matrix, input vector per column
+ * @return the N identified digits, in columns order
+ */
+std::vector<digit> MlpNetwork::classify_batch (const Matrix &batch) const
+{
+  std::vector<digit> digits;
+  classify_batch (batch, digits);
+  return digits;
+}
+
+/**
+ * classify a batch of images in one pass, into a reused vector
+ * @param batch get_input_size() x N matrix, input vector per column
+ * @param digits the N identified digits, in columns order
+ */
+void MlpNetwork::classify_batch (const Matrix &batch,
+                                 std::vector<digit> &digits) const
+{
+  if (batch.get_rows() != get_input_size())
+    {
+      std::cerr << INVALID_BATCH_SIZE << std::endl;
+      exit (EXIT_FAILURE);
+    }
+
+  if (_cache)
+    {
+      digits = classify_batch_cached (batch);
+      return;
+    }
+  digits.resize (batch.get_cols());
+  evaluate_batch (batch, digits.data());
+}
+
+/**
+ * classify a batch of images through the result cache
+ * @param batch get_input_size() x N matrix, input vector per column
+ * @return the N identified digits, in columns order
+ */
+std::vector<digit>
+MlpNetwork::classify_batch_cached (const Matrix &batch) const
+{
+  int n = batch.get_cols(), size = batch.get_rows();
+  std::vector<digit> digits (n);
+  std::vector<std::pair<uint64_t, int>> missed;   // key, column
+  for (int j = 0; j < n; j++)
+    {
+      uint64_t key = ResultCache::hash (batch.data() + j, size, n);
+      if (!_cache->lookup (key, digits[j]))
+        missed.emplace_back (key, j);
+    }
+  if (missed.empty())
+    return digits;
+
+  // the missed columns are evaluated as a batch of their own, an input
+  // repeated in the batch once.
+  std::sort (missed.begin(), missed.end());
+  std::vector<int> distinct;
+  for (size_t i = 0; i < missed.size(); i++)
+    if (i == 0 || missed[i].first != missed[i - 1].first)
+      distinct.push_back (missed[i].second);
+  std::vector<digit> computed (distinct.size());
+  if ((int) distinct.size() < n)
+    {
+      Matrix pending;
+      gather_columns (batch, distinct, pending);
+      evaluate_batch (pending, computed.data());
+    }
+  else
+    evaluate_batch (batch, computed.data());
+  int c = -1;
+  for (size_t i = 0; i < missed.size(); i++)
+    {
+      if (i == 0 || missed[i].first != missed[i - 1].first)
         {
-          best_probability = m[i];
-          value = i;
+          c++;
+          digits[missed[i].second] = computed[c];
+          _cache->insert (missed[i].first, computed[c]);
         }
+      else
+        digits[missed[i].second] = digits[missed[i - 1].second];
     }
-  digit d = {value, best_probability};
-  return d;
+  return digits;
+}
+
+/**
+ * the most probable digit of a single image, through the cascade if any
+ * @param m the input matrix
+ * @param ws the workspace to evaluate in
+ * @return a digit struct, contain the value and its probability
+ */
+digit MlpNetwork::evaluate (const Matrix &m, MlpWorkspace &ws) const
+{
+  // the softmax is left out: only the winner probability is computed.
+  if (_cascade)
+    {
+      const MlpNetwork &cheap = _cascade->cheap;
+      digit d = cheap.output_argmax (cheap.forward (m, ws.cheap_outputs,
+                                                    true), 0);
+      _cascade->images++;
+      if (d.probability >= _cascade->threshold)
+        return d;
+      _cascade->escalated++;
+    }
+  return output_argmax (forward (m, ws, true), 0);
+}
+
+/**
+ * the most probable digit of every column of a batch, through the cascade
+ * if any
+ * @param batch get_input_size() x N matrix, input vector per column
+ * @param digits the N identified digits, in columns order
+ */
+void MlpNetwork::evaluate_batch (const Matrix &batch, digit *digits) const
+{
+  int n = batch.get_cols();
+  if (!_cascade)
+    {
+      const Matrix &out = forward (batch, thread_workspace, true);
+      for (int j = 0; j < n; j++)
+        digits[j] = output_argmax (out, j);
+      return;
+    }
+
+  const MlpNetwork &cheap = _cascade->cheap;
+  MlpWorkspace &ws = thread_workspace;
+  const Matrix &guess = cheap.forward (batch, ws.cheap_outputs, true);
+  std::vector<int> &unsure = ws.unsure;
+  unsure.clear();
+  for (int j = 0; j < n; j++)
+    {
+      digits[j] = cheap.output_argmax (guess, j);
+      if (digits[j].probability < _cascade->threshold)
+        unsure.push_back (j);
+    }
+  _cascade->images += n;
+  _cascade->escalated += (long) unsure.size();
+  if (unsure.empty())
+    return;
+
+  if ((int) unsure.size() < n)
+    gather_columns (batch, unsure, ws.unsure_batch);
+  const Matrix &out = forward ((int) unsure.size() < n ? ws.unsure_batch
+                                                       : batch, ws, true);
+  for (size_t c = 0; c < unsure.size(); c++)
+    digits[unsure[c]] = output_argmax (out, (int) c);
+}
+
+/**
+ * classify a batch of images in one pass
+ * @param images the images to classify, each of get_input_size() elements
+ * @return the identified digits, in images order
+ */
+std::vector<digit>
+MlpNetwork::classify_batch (const std::vector<Matrix> &images) const
+{
+  if (images.empty())
+    {
+      std::cerr << EMPTY_BATCH << std::endl;
+      exit (EXIT_FAILURE);
+    }
+
+  int img_size = get_input_size();
+  Matrix batch (img_size, (int) images.size());
+  for (int j = 0; j < (int) images.size(); j++)
+    {
+      if (images[j].get_rows() * images[j].get_cols() != img_size)
+        {
+          std::cerr << INVALID_BATCH_SIZE << std::endl;
+          exit (EXIT_FAILURE);
+        }
+      for (int i = 0; i < img_size; i++)
+        batch(i, j) = images[j][i];
+    }
+  return classify_batch (batch);
 }
 
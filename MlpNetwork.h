@@ -3,10 +3,16 @@
 #ifndef MLPNETWORK_H
 #define MLPNETWORK_H
 
+#include <memory>
+#include <vector>
+
 #include "Matrix.h"
 #include "Digit.h"
 #include "Dense.h"
+#include "ResultCache.h"
 
+// the digits network topology, of the raw parameter files. a model file
+// may hold a network of any other topology.
 #define MLP_SIZE 4
 
 //
@@ -20,25 +26,331 @@ const matrix_dims bias_dims[]    = {{128, 1},
                                     {20, 1},
                                     {10, 1}};
 
+/**
+ * @struct MlpWorkspace
+ * @brief Scratch buffers of a network evaluation: the output matrix of every
+ *        layer. A workspace belongs to a single thread at a time; reusing it
+ *        makes the evaluation allocation free. Its matrices come from the
+ *        pool allocator, whatever the allocator of the thread: a workspace
+ *        outlives the requests, and so their arenas.
+ */
+struct MlpWorkspace
+{
+    std::vector<Matrix> layer_outputs;
+    std::vector<Matrix> cheap_outputs;  // of the cheap pass of a cascade
+    std::vector<int> unsure;            // the columns a cascade escalates
+    Matrix unsure_batch;                // and their images
+
+    MlpWorkspace () : unsure_batch(1, 1, pool_allocator()) {}
+};
+
+/**
+ * @struct CascadeStats
+ * @brief The counters of a cascade network (see MlpNetwork::set_cascade).
+ * @var images - the images the cheap pass classified
+ * @var escalated - the images re-evaluated by the full network
+ */
+struct CascadeStats
+{
+    long images;
+    long escalated;
+};
+
+struct MlpCascade;
+
 class MlpNetwork
 {
-  Matrix *_weights, *_biases;
+  std::vector<Dense> _layers;
+  std::shared_ptr<ResultCache> _cache;
+  std::shared_ptr<MlpCascade> _cascade;
+
+/**
+ * add a layer, converting its weights to the given precision
+ * @param w the layer weight matrix
+ * @param bias the layer bias matrix
+ * @param act_type the layer activation
+ * @param precision the weights storage precision
+ */
+  void add_layer (const SharedMatrix &w, const SharedMatrix &bias,
+                  ActivationType act_type, WeightsPrecision precision);
+
+/**
+ * run all the network layers on the given matrix, column by column. every
+ * layer writes into its own output matrix of the workspace, so once the
+ * outputs reached their size, the evaluation does not allocate.
+ * @param m the input matrix, one input vector per column
+ * @param ws the workspace to evaluate in
+ * @param logits whether to stop before the softmax of the last layer
+ * @return reference of the last layer output (the probabilities, or the
+ *         logits), inside ws
+ */
+  const Matrix &forward (const Matrix &m, MlpWorkspace &ws,
+                         bool logits = false) const
+  {
+    return forward (m, ws.layer_outputs, logits);
+  }
+
+/**
+ * run all the network layers on the given matrix, into the given outputs
+ * @param m the input matrix, one input vector per column
+ * @param outputs the output matrix of every layer, grown as needed
+ * @param logits whether to stop before the softmax of the last layer
+ * @return reference of the last layer output, inside outputs
+ */
+  const Matrix &forward (const Matrix &m, std::vector<Matrix> &outputs,
+                         bool logits) const;
+
+/**
+ * the most probable digit of a single image, through the cascade if any
+ * @param m the input matrix
+ * @param ws the workspace to evaluate in
+ * @return a digit struct, contain the value and its probability
+ */
+  digit evaluate (const Matrix &m, MlpWorkspace &ws) const;
+
+/**
+ * the most probable digit of every column of a batch, through the cascade
+ * if any: the columns the cheap pass is unsure of are re-evaluated by the
+ * full network, as a batch of their own
+ * @param batch get_input_size() x N matrix, input vector per column
+ * @param digits the N identified digits, in columns order
+ */
+  void evaluate_batch (const Matrix &batch, digit *digits) const;
+
+/**
+ * @return whether the last layer is a softmax, so the forward(logits)
+ *         output holds logits
+ */
+  bool softmax_output () const
+  {
+    return _layers.back().get_activation().get_activation_type() == SOFTMAX;
+  }
+
+/**
+ * pick the most probable digit of a column of the forward(logits) output
+ * @param out the output matrix
+ * @param col the column (input index) to decide on
+ * @return a digit struct, contain the value and its probability
+ */
+  digit output_argmax (const Matrix &out, int col) const;
+
+/**
+ * classify a batch of images through the result cache: the cached columns
+ * are answered from it, the others evaluated as a smaller batch (a
+ * repeated input once), and cached
+ * @param batch get_input_size() x N matrix, input vector per column
+ * @return the N identified digits, in columns order
+ */
+  std::vector<digit> classify_batch_cached (const Matrix &batch) const;
 
  public:
 /**
- * the MlpNetwork regular-constructor
+ * pick the most probable digit of a given column of the network output
+ * @param probs the network output matrix
+ * @param col the column (input index) to decide on
+ * @return a digit struct, contain the value and its probability
+ */
+  static digit column_argmax (const Matrix &probs, int col);
+
+/**
+ * pick the most probable digit of a given column of logits (the softmax
+ * inputs), without computing the softmax: the winner is the largest logit,
+ * and only its probability is computed, max-subtracted:
+ * 1 / sum(exp(logit - max))
+ * @param logits the logits matrix
+ * @param col the column (input index) to decide on
+ * @return a digit struct, contain the value and its probability
+ */
+  static digit logits_argmax (const Matrix &logits, int col);
+
+/**
+ * the MlpNetwork regular-constructor, copies the parameters once into the
+ * network layers
  * @param weights array of the network's weight matrices
  * @param biases array of the network's biases matrices
  */
   MlpNetwork(Matrix weights[MLP_SIZE], Matrix biases[MLP_SIZE]);
 
+/**
+ * the MlpNetwork shared-parameters constructor, the layers reference the
+ * given read-only parameters without copying them
+ * @param weights array of the network's weight matrices
+ * @param biases array of the network's biases matrices
+ * @param precision the weights storage precision. a half precision network
+ *        converts the weights once (and keeps no reference to the given
+ *        float weights), halving their memory footprint
+ */
+  MlpNetwork(const SharedMatrix weights[MLP_SIZE],
+             const SharedMatrix biases[MLP_SIZE],
+             WeightsPrecision precision = PRECISION_F32);
+
+/**
+ * the MlpNetwork runtime-topology constructor: a network of any depth and
+ * layer widths, sharing the given read-only parameters. every layer picks
+ * its kernels for its own shape.
+ * exits (code == 1) if the lists sizes differ or are empty, or if a layer
+ * input size is not the previous layer output size.
+ * @param weights the weight matrices, one per layer
+ * @param biases the bias matrices, one per layer
+ * @param activations the activations, one per layer
+ * @param precision the weights storage precision
+ */
+  MlpNetwork(const std::vector<SharedMatrix> &weights,
+             const std::vector<SharedMatrix> &biases,
+             const std::vector<ActivationType> &activations,
+             WeightsPrecision precision = PRECISION_F32);
+
+/**
+ * @return the network input vectors size
+ */
+  int get_input_size () const
+  {
+    return _layers.front().get_input_size();
+  }
+
+/**
+ * @return the network output vectors size
+ */
+  int get_output_size () const
+  {
+    return _layers.back().get_output_size();
+  }
+
+/**
+ * put a result cache in front of the network: operator(), classify and
+ * classify_batch answer the inputs of a cached hash from the cache, and
+ * cache the results they compute (top_k and forward are not cached). the
+ * cache is shared by the copies of the network, e.g. by the workers of an
+ * InferenceEngine.
+ * @param cache the cache, or nullptr to evaluate every input
+ */
+  void set_result_cache (std::shared_ptr<ResultCache> cache)
+  {
+    _cache = std::move (cache);
+  }
+
+/**
+ * @return the result cache, or nullptr if none
+ */
+  const std::shared_ptr<ResultCache> &get_result_cache () const
+  {
+    return _cache;
+  }
+
+/**
+ * a cheaper approximation of the network, for the first pass of a
+ * cascade: the first layer weights w (out x in) are replaced by their best
+ * rank r approximation u * v - u holds the r leading eigenvectors of
+ * w * w^T (out x r), and v = u^T * w (r x in). the layer is evaluated as
+ * two: a LINEAR layer of v, then a layer of u with the bias and activation
+ * of the first layer, in r * (in + out) multiplications instead of
+ * in * out. the other layers share the weights of this network.
+ * exits (code == 1) if rank is not in [1, min(in, out)].
+ * @param rank the rank r
+ * @return the approximated network, of no cache and no cascade
+ */
+  MlpNetwork low_rank (int rank) const;
+
+/**
+ * evaluate the network as a cascade: the cheap network classifies every
+ * input first, and only the inputs of a winning probability below the
+ * threshold are re-evaluated by this network. operator(), classify and
+ * classify_batch run the cascade (behind the result cache, if any); top_k
+ * always runs this network. the cascade and its counters are shared by
+ * the copies of the network.
+ * @param cheap the cheap network (e.g. low_rank), of the same input and
+ *        output sizes
+ * @param threshold the winning probability at which the cheap result is
+ *        kept, in [0, 1]; 0 keeps every cheap result
+ */
+  void set_cascade (const MlpNetwork &cheap, float threshold);
+
+/**
+ * @return the cascade counters, zeros if the network is not a cascade
+ */
+  CascadeStats get_cascade_stats () const;
+
+/**
+ * the network layers getter
+ * @return the network layers, in evaluation order
+ */
+  const std::vector<Dense> &get_layers () const
+  {
+    return _layers;
+  }
+
 /**
  * the MlpNetwork operator, compute the network manipulations on the given
- * Matrix
+ * Matrix. the network is immutable, so the operator may be called from many
+ * threads at once - each thread evaluates in its own workspace.
  * @param m the input matrix
  * @return a digit struct, contain the values and its distributions
  */
-  digit operator() (Matrix &m);
+  digit operator() (const Matrix &m) const;
+
+/**
+ * the MlpNetwork operator, evaluated in a caller owned workspace
+ * @param m the input matrix
+ * @param ws the workspace to evaluate in
+ * @return a digit struct, contain the values and its distributions
+ */
+  digit operator() (const Matrix &m, MlpWorkspace &ws) const;
+
+/**
+ * the label only inference: the predicted digit, picked from the logits,
+ * with no softmax at all
+ * @param m the input matrix
+ * @return the identified digit value
+ */
+  unsigned int classify (const Matrix &m) const;
+
+/**
+ * the label only inference, evaluated in a caller owned workspace
+ * @param m the input matrix
+ * @param ws the workspace to evaluate in
+ * @return the identified digit value
+ */
+  unsigned int classify (const Matrix &m, MlpWorkspace &ws) const;
+
+/**
+ * the k most probable digits, ranked
+ * @param m the input matrix
+ * @param k the number of digits, clamped to the output size
+ * @return up to k digits, the most probable first
+ */
+  std::vector<digit> top_k (const Matrix &m, int k) const;
+
+/**
+ * the k most probable digits, evaluated in a caller owned workspace
+ * @param m the input matrix
+ * @param k the number of digits, clamped to the output size
+ * @param ws the workspace to evaluate in
+ * @return up to k digits, the most probable first
+ */
+  std::vector<digit> top_k (const Matrix &m, int k, MlpWorkspace &ws) const;
+
+/**
+ * classify a batch of images in one pass - every layer runs as one
+ * matrix-matrix product, so each weight matrix is read once per batch
+ * @param batch get_input_size() x N matrix, input vector per column
+ * @return the N identified digits, in columns order
+ */
+  std::vector<digit> classify_batch (const Matrix &batch) const;
+
+/**
+ * classify a batch of images in one pass, into a reused vector: with no
+ * result cache, a call of a batch size seen before does not allocate
+ * @param batch get_input_size() x N matrix, input vector per column
+ * @param digits the N identified digits, in columns order (resized to N)
+ */
+  void classify_batch (const Matrix &batch, std::vector<digit> &digits) const;
+
+/**
+ * classify a batch of images in one pass
+ * @param images the images to classify, each of get_input_size() elements
+ * @return the identified digits, in images order
+ */
+  std::vector<digit> classify_batch (const std::vector<Matrix> &images) const;
 
 };
 
@@ -0,0 +1,364 @@
+#include "MlpTrainer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <future>
+
+#include "Kernels.h"
+#include "MatrixView.h"
+
+#define INVALID_TOPOLOGY "Error: invalid network topology, every layer " \
+                         "input must match the previous layer output.\n"
+#define INVALID_TRAINING_SET "Error: training images must match the " \
+                             "network input size, a label per image.\n"
+#define MIN_PROBABILITY 1e-12
+#define WEIGHTS_FILE_PREFIX "/w"
+#define BIAS_FILE_PREFIX "/b"
+
+/**
+ * @return the default hyper-parameters: Adam at 1e-3, minibatches of 64
+ */
+TrainOptions default_train_options ()
+{
+  TrainOptions opt;
+  opt.optimizer = OPTIMIZER_ADAM;
+  opt.learning_rate = 1e-3f;
+  opt.momentum = 0.9f;
+  opt.beta1 = 0.9f;
+  opt.beta2 = 0.999f;
+  opt.epsilon = 1e-8f;
+  opt.batch_size = 64;
+  opt.seed = 1;
+  return opt;
+}
+
+/**
+ * a matrix of zeros
+ */
+static Matrix zeros (int rows, int cols)
+{
+  Matrix m (rows, cols);
+  std::fill (m.data(), m.data() + (std::size_t) rows * cols, 0.0f);
+  return m;
+}
+
+/**
+ * the MlpTrainer constructor, of a new network
+ * @param sizes the input size, then the output size of every layer
+ * @param threads the worker threads number, at least 1
+ * @param opt the hyper-parameters
+ */
+MlpTrainer::MlpTrainer (const std::vector<int> &sizes, int threads,
+                        const TrainOptions &opt)
+    : _opt(opt), _step(0), _rng(opt.seed), _shards(std::max (threads, 1)),
+      _pool(threads)
+{
+  if (sizes.size() < 2)
+    {
+      std::cerr << INVALID_TOPOLOGY << std::endl;
+      exit (EXIT_FAILURE);
+    }
+  for (std::size_t l = 1; l < sizes.size(); l++)
+    {
+      // He initialization, for the relu layers.
+      std::normal_distribution<float> dist (
+          0.0f, std::sqrt (2.0f / (float) sizes[l - 1]));
+      Matrix w (sizes[l], sizes[l - 1]);
+      for (int i = 0; i < w.get_rows() * w.get_cols(); i++)
+        w[i] = dist (_rng);
+      _w.push_back (std::move (w));
+      _b.push_back (zeros (sizes[l], 1));
+    }
+  init_state();
+}
+
+/**
+ * the MlpTrainer constructor, continuing from existing parameters
+ * @param weights the weight matrices, one per layer
+ * @param biases the bias matrices, one per layer
+ * @param threads the worker threads number, at least 1
+ * @param opt the hyper-parameters
+ */
+MlpTrainer::MlpTrainer (const std::vector<SharedMatrix> &weights,
+                        const std::vector<SharedMatrix> &biases, int threads,
+                        const TrainOptions &opt)
+    : _opt(opt), _step(0), _rng(opt.seed), _shards(std::max (threads, 1)),
+      _pool(threads)
+{
+  for (std::size_t l = 0; l < weights.size(); l++)
+    {
+      if (l >= biases.size() || !weights[l] || !biases[l]
+          || biases[l]->get_rows() != weights[l]->get_rows()
+          || (l > 0 && weights[l]->get_cols() != _w.back().get_rows()))
+        {
+          std::cerr << INVALID_TOPOLOGY << std::endl;
+          exit (EXIT_FAILURE);
+        }
+      _w.push_back (*weights[l]);
+      _b.push_back (*biases[l]);
+    }
+  if (_w.empty() || weights.size() != biases.size())
+    {
+      std::cerr << INVALID_TOPOLOGY << std::endl;
+      exit (EXIT_FAILURE);
+    }
+  init_state();
+}
+
+/**
+ * allocate the optimizer state and shard buffers of the parameters
+ */
+void MlpTrainer::init_state ()
+{
+  for (std::size_t l = 0; l < _w.size(); l++)
+    {
+      int rows = _w[l].get_rows(), cols = _w[l].get_cols();
+      _m_w.push_back (zeros (rows, cols));
+      _v_w.push_back (zeros (rows, cols));
+      _m_b.push_back (zeros (rows, 1));
+      _v_b.push_back (zeros (rows, 1));
+      for (ShardScratch &s : _shards)
+        {
+          s.grad_w.push_back (Matrix (rows, cols));
+          s.grad_b.push_back (Matrix (rows, 1));
+        }
+    }
+  for (ShardScratch &s : _shards)
+    s.outputs.resize (_w.size());
+}
+
+/**
+ * forward and backward passes of a shard of a minibatch
+ * @param s the shard buffers
+ * @param images the training images, an image per row
+ * @param labels the digit of every image
+ * @param order the images indices of the shard
+ * @param n the shard size
+ * @param batch_size the whole minibatch size, the gradients scale
+ */
+void MlpTrainer::shard_gradients (ShardScratch &s, const Matrix &images,
+                                  const std::vector<unsigned int> &labels,
+                                  const int *order, int n, int batch_size)
+{
+  int layers = (int) _w.size();
+  int input = images.get_cols();
+  s.x.resize (input, n);
+  float *x = s.x.data();
+  for (int j = 0; j < n; j++)
+    {
+      const float *img = images.data() + (std::size_t) order[j] * input;
+      for (int i = 0; i < input; i++)
+        x[i * n + j] = img[i];
+    }
+
+  // forward: the relu is fused into the products.
+  const Matrix *in = &s.x;
+  for (int l = 0; l < layers; l++)
+    {
+      Matrix &out = s.outputs[l];
+      out.resize (_w[l].get_rows(), n);
+      gemm (_w[l].data(), _w[l].get_cols(), in->data(), n, out.data(), n,
+            out.get_rows(), n, _w[l].get_cols(), _b[l].data(),
+            l < layers - 1);
+      in = &out;
+    }
+  Matrix &probs = s.outputs[layers - 1];
+  softmax_columns (probs.data(), n, probs.get_rows(), n);
+
+  // the softmax + cross-entropy delta: (probs - one_hot) / batch_size.
+  s.loss = 0;
+  s.correct = 0;
+  float scale = 1.0f / (float) batch_size;
+  for (int j = 0; j < n; j++)
+    {
+      unsigned int label = labels[order[j]];
+      int best = 0;
+      for (int i = 1; i < probs.get_rows(); i++)
+        if (probs(i, j) > probs(best, j))
+          best = i;
+      s.correct += best == (int) label;
+      s.loss -= std::log (std::max ((double) probs(label, j),
+                                    MIN_PROBABILITY));
+      for (int i = 0; i < probs.get_rows(); i++)
+        probs(i, j) = (probs(i, j) - (i == (int) label)) * scale;
+    }
+
+  // backward: every layer output turns into its delta, in place.
+  for (int l = layers - 1; l >= 0; l--)
+    {
+      const Matrix &delta = s.outputs[l];
+      const Matrix &prev = l > 0 ? s.outputs[l - 1] : s.x;
+      int rows = _w[l].get_rows(), cols = _w[l].get_cols();
+      // the transposes are views: the products read them in place.
+      multiply (delta.view(), prev.view().transposed(),
+                s.grad_w[l].view());
+      const float *d = delta.data();
+      for (int i = 0; i < rows; i++)
+        {
+          float sum = 0;
+          for (int j = 0; j < n; j++)
+            sum += d[i * n + j];
+          s.grad_b[l].data()[i] = sum;
+        }
+      if (l == 0)
+        break;
+
+      s.delta.resize (cols, n);
+      multiply (_w[l].view().transposed(), delta.view(), s.delta.view());
+      // the relu derivative: the outputs that were clamped pass nothing.
+      float *prev_delta = s.outputs[l - 1].data();
+      const float *back = s.delta.data();
+      for (int i = 0; i < cols * n; i++)
+        prev_delta[i] = prev_delta[i] > 0 ? back[i] : 0;
+    }
+}
+
+/**
+ * reduce the shards gradients of a slice of every parameter tensor, and
+ * update the slice
+ * @param slice the slice index
+ * @param slices the slices number
+ * @param shards the number of shards of the step
+ */
+void MlpTrainer::update_slice (int slice, int slices, int shards)
+{
+  float lr = _opt.learning_rate;
+  float correction1 = 1, correction2 = 1;
+  if (_opt.optimizer == OPTIMIZER_ADAM)
+    {
+      correction1 = 1 - std::pow (_opt.beta1, (float) _step);
+      correction2 = 1 - std::pow (_opt.beta2, (float) _step);
+    }
+
+  for (std::size_t l = 0; l < _w.size(); l++)
+    for (int tensor = 0; tensor < 2; tensor++)
+      {
+        Matrix &param_mat = tensor == 0 ? _w[l] : _b[l];
+        float *param = param_mat.data();
+        float *m = (tensor == 0 ? _m_w[l] : _m_b[l]).data();
+        float *v = (tensor == 0 ? _v_w[l] : _v_b[l]).data();
+        long size = (long) param_mat.get_rows() * param_mat.get_cols();
+        long begin = size * slice / slices, end = size * (slice + 1) / slices;
+        for (long i = begin; i < end; i++)
+          {
+            float g = 0;
+            for (int s = 0; s < shards; s++)
+              g += (tensor == 0 ? _shards[s].grad_w[l]
+                                : _shards[s].grad_b[l]).data()[i];
+            if (_opt.optimizer == OPTIMIZER_SGD)
+              {
+                m[i] = _opt.momentum * m[i] + g;
+                param[i] -= lr * m[i];
+              }
+            else
+              {
+                m[i] = _opt.beta1 * m[i] + (1 - _opt.beta1) * g;
+                v[i] = _opt.beta2 * v[i] + (1 - _opt.beta2) * g * g;
+                param[i] -= lr * (m[i] / correction1)
+                            / (std::sqrt (v[i] / correction2)
+                               + _opt.epsilon);
+              }
+          }
+      }
+}
+
+/**
+ * train over all the images once, in a random order
+ * @param images the training images, an image vector per row
+ * @param labels the digit of every image
+ * @return the epoch measures
+ */
+EpochStats MlpTrainer::train_epoch (const Matrix &images,
+                                    const std::vector<unsigned int> &labels)
+{
+  int n = images.get_rows();
+  if (images.get_cols() != _w.front().get_cols()
+      || labels.size() != (std::size_t) n || n == 0)
+    {
+      std::cerr << INVALID_TRAINING_SET << std::endl;
+      exit (EXIT_FAILURE);
+    }
+
+  std::vector<int> order (n);
+  for (int i = 0; i < n; i++)
+    order[i] = i;
+  std::shuffle (order.begin(), order.end(), _rng);
+
+  double loss = 0;
+  long correct = 0;
+  int workers = (int) _shards.size();
+  std::vector<std::future<void>> done;
+  for (int start = 0; start < n; start += _opt.batch_size)
+    {
+      int batch = std::min (_opt.batch_size, n - start);
+      int shards = std::min (workers, batch);
+      for (int s = 0; s < shards; s++)
+        {
+          int begin = start + batch * s / shards;
+          int end = start + batch * (s + 1) / shards;
+          done.push_back (_pool.submit ([this, &images, &labels, &order, s,
+                                         begin, end, batch] () {
+              shard_gradients (_shards[s], images, labels,
+                               order.data() + begin, end - begin, batch);
+          }));
+        }
+      for (std::future<void> &f : done)
+        f.get();
+      done.clear();
+      for (int s = 0; s < shards; s++)
+        {
+          loss += _shards[s].loss;
+          correct += _shards[s].correct;
+        }
+
+      _step++;
+      for (int slice = 0; slice < workers; slice++)
+        done.push_back (_pool.submit ([this, slice, workers, shards] () {
+            update_slice (slice, workers, shards);
+        }));
+      for (std::future<void> &f : done)
+        f.get();
+      done.clear();
+    }
+  return {loss / n, (double) correct / n};
+}
+
+/**
+ * @return a network of the current parameters (copied)
+ */
+MlpNetwork MlpTrainer::network () const
+{
+  std::vector<SharedMatrix> weights, biases;
+  std::vector<ActivationType> activations;
+  for (std::size_t l = 0; l < _w.size(); l++)
+    {
+      weights.push_back (std::make_shared<const Matrix> (_w[l]));
+      biases.push_back (std::make_shared<const Matrix> (_b[l]));
+      activations.push_back (l + 1 < _w.size() ? RELU : SOFTMAX);
+    }
+  return MlpNetwork (weights, biases, activations);
+}
+
+/**
+ * write the parameters as raw float32 files dir/w1.. and dir/b1..
+ * @param dir the output directory
+ * @return false if a file could not be written
+ */
+bool MlpTrainer::save (const std::string &dir) const
+{
+  for (std::size_t l = 0; l < _w.size(); l++)
+    {
+      std::string idx = std::to_string (l + 1);
+      std::ofstream w_file (dir + WEIGHTS_FILE_PREFIX + idx,
+                            std::ios::out | std::ios::binary
+                            | std::ios::trunc);
+      std::ofstream b_file (dir + BIAS_FILE_PREFIX + idx,
+                            std::ios::out | std::ios::binary
+                            | std::ios::trunc);
+      if (!write_binary_file (w_file, _w[l])
+          || !write_binary_file (b_file, _b[l]))
+        return false;
+    }
+  return true;
+}
@@ -0,0 +1,174 @@
+// MlpTrainer.h
+
+#ifndef MLPTRAINER_H
+#define MLPTRAINER_H
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "MlpNetwork.h"
+#include "ThreadPool.h"
+
+/**
+ * @enum OptimizerType
+ * @brief The parameters update rule of a training step.
+ */
+enum OptimizerType
+{
+    OPTIMIZER_SGD,  // stochastic gradient descent, with momentum
+    OPTIMIZER_ADAM  // Adam, bias corrected moments
+};
+
+/**
+ * @struct TrainOptions
+ * @brief The hyper-parameters of a training.
+ */
+struct TrainOptions
+{
+    OptimizerType optimizer;
+    float learning_rate;
+    float momentum;         // SGD
+    float beta1, beta2;     // Adam
+    float epsilon;          // Adam
+    int batch_size;
+    unsigned int seed;      // the initialization and the shuffles
+};
+
+/**
+ * @return the default hyper-parameters: Adam at 1e-3, minibatches of 64
+ */
+TrainOptions default_train_options ();
+
+/**
+ * @struct EpochStats
+ * @brief The measures of a training epoch, over the minibatches as trained
+ *        (every image is measured before the step it takes part in).
+ */
+struct EpochStats
+{
+    double loss;        // mean cross-entropy
+    double accuracy;    // fraction of correctly classified images
+};
+
+/**
+ * Trains a network of relu layers and a last softmax layer, by minibatch
+ * backpropagation of the cross-entropy loss.
+ *
+ * Every minibatch is split into column shards, one per worker thread. A
+ * worker runs the forward and backward passes of its shard as batched
+ * matrix products (the gemm kernel), into its own gradient buffers. The
+ * gradients are then reduced without locks: every worker owns a slice of
+ * every parameter tensor, sums the shards gradients over it, and updates
+ * it. Two pool barriers per step, no lock on the gradients.
+ */
+class MlpTrainer
+{
+/**
+ * @struct ShardScratch
+ * @brief The buffers of a single shard, on their own cache lines.
+ */
+  struct alignas(64) ShardScratch
+  {
+    Matrix x;                       // input x shard_size
+    std::vector<Matrix> outputs;    // per layer, then its delta
+    Matrix delta;
+    std::vector<Matrix> grad_w, grad_b;
+    double loss;
+    int correct;
+  };
+
+  std::vector<Matrix> _w, _b;
+  // the optimizer state: SGD velocity / Adam first moment, Adam second
+  // moment.
+  std::vector<Matrix> _m_w, _m_b, _v_w, _v_b;
+  TrainOptions _opt;
+  long _step;
+  std::mt19937 _rng;
+  std::vector<ShardScratch> _shards;
+  ThreadPool _pool;
+
+/**
+ * allocate the optimizer state and shard buffers of the parameters
+ */
+  void init_state ();
+
+/**
+ * forward and backward passes of a shard of a minibatch
+ * @param s the shard buffers
+ * @param images the training images, an image per row
+ * @param labels the digit of every image
+ * @param order the images indices of the shard
+ * @param n the shard size
+ * @param batch_size the whole minibatch size, the gradients scale
+ */
+  void shard_gradients (ShardScratch &s, const Matrix &images,
+                        const std::vector<unsigned int> &labels,
+                        const int *order, int n, int batch_size);
+
+/**
+ * reduce the shards gradients of a slice of every parameter tensor, and
+ * update the slice
+ * @param slice the slice index
+ * @param slices the slices number
+ * @param shards the number of shards of the step
+ */
+  void update_slice (int slice, int slices, int shards);
+
+ public:
+/**
+ * the MlpTrainer constructor, of a new network (He initialized weights,
+ * zero biases)
+ * @param sizes the input size, then the output size of every layer
+ * @param threads the worker threads number, at least 1
+ * @param opt the hyper-parameters
+ */
+  MlpTrainer (const std::vector<int> &sizes, int threads,
+              const TrainOptions &opt);
+
+/**
+ * the MlpTrainer constructor, continuing from existing parameters (copied)
+ * exits (code == 1) if the layers do not chain.
+ * @param weights the weight matrices, one per layer
+ * @param biases the bias matrices, one per layer
+ * @param threads the worker threads number, at least 1
+ * @param opt the hyper-parameters
+ */
+  MlpTrainer (const std::vector<SharedMatrix> &weights,
+              const std::vector<SharedMatrix> &biases, int threads,
+              const TrainOptions &opt);
+
+/**
+ * train over all the images once, in a random order
+ * exits (code == 1) if the images are not of the network input size, or
+ * the labels number does not match.
+ * @param images the training images, an image vector per row
+ * @param labels the digit of every image
+ * @return the epoch measures
+ */
+  EpochStats train_epoch (const Matrix &images,
+                          const std::vector<unsigned int> &labels);
+
+/**
+ * @return a network of the current parameters (copied)
+ */
+  MlpNetwork network () const;
+
+/**
+ * write the parameters as raw float32 files dir/w1.. and dir/b1.., the
+ * format of the parameter files the program loads (and packs)
+ * @param dir the output directory
+ * @return false if a file could not be written
+ */
+  bool save (const std::string &dir) const;
+
+/**
+ * @return the worker threads number
+ */
+  int get_threads () const
+  {
+    return _pool.size();
+  }
+};
+
+#endif //MLPTRAINER_H
@@ -0,0 +1,251 @@
+#include "ModelFile.h"
+
+#include <cstring>
+#include <fstream>
+#include <utility>
+
+#define MODEL_NOT_OPEN_ERROR "Error: model file could not be mapped: "
+#define MODEL_BAD_HEADER_ERROR "Error: not a model file, or unsupported " \
+                               "version: "
+#define MODEL_BAD_TABLE_ERROR "Error: model tensors table out of the file " \
+                              "bounds: "
+#define MODEL_BAD_TENSOR_ERROR "Error: model tensor out of bounds or " \
+                               "misaligned: "
+#define MODEL_BAD_CHECKSUM_ERROR "Error: model checksum mismatch, the file " \
+                                 "is corrupted: "
+
+/**
+ * round a byte offset up to the model alignment
+ */
+static uint64_t align_up (uint64_t offset)
+{
+  return (offset + MODEL_ALIGNMENT - 1) / MODEL_ALIGNMENT * MODEL_ALIGNMENT;
+}
+
+/**
+ * the size in bytes of one element of a given type
+ */
+static uint64_t dtype_size (uint32_t dtype)
+{
+  switch (dtype)
+    {
+      case MODEL_DTYPE_F32:
+        return sizeof (float);
+      case MODEL_DTYPE_I32:
+        return sizeof (int32_t);
+      default:
+        return 0;
+    }
+}
+
+/**
+ * the 64-bit FNV-1a hash of a bytes range
+ */
+uint64_t fnv1a64 (const void *data, std::size_t n_bytes, uint64_t hash)
+{
+  const unsigned char *bytes = (const unsigned char *) data;
+  for (std::size_t i = 0; i < n_bytes; i++)
+    {
+      hash ^= bytes[i];
+      hash *= 0x100000001b3ULL;
+    }
+  return hash;
+}
+
+/**
+ * ModelFile constructor, over an already validated mapping
+ * @param file the mapped model file
+ */
+ModelFile::ModelFile (std::shared_ptr<MappedFile> file)
+    : _file(std::move (file)) {}
+
+/**
+ * map and validate a model file
+ * @param path the model file path
+ * @return the model file, or nullptr if it is invalid
+ */
+std::shared_ptr<ModelFile> ModelFile::open (const std::string &path)
+{
+  std::shared_ptr<MappedFile> file = MappedFile::open (path);
+  if (!file)
+    {
+      std::cerr << MODEL_NOT_OPEN_ERROR << path << std::endl;
+      return nullptr;
+    }
+
+  const char *base = (const char *) file->data();
+  const ModelFileHeader *header = (const ModelFileHeader *) base;
+  if (file->size() < sizeof (ModelFileHeader)
+      || std::memcmp (header->magic, MODEL_MAGIC, MODEL_MAGIC_SIZE) != 0
+      || header->version != MODEL_VERSION
+      || header->file_size != file->size())
+    {
+      std::cerr << MODEL_BAD_HEADER_ERROR << path << std::endl;
+      return nullptr;
+    }
+
+  uint64_t table_end = sizeof (ModelFileHeader)
+                       + (uint64_t) header->tensor_count
+                         * sizeof (ModelTensorEntry);
+  if (table_end > file->size())
+    {
+      std::cerr << MODEL_BAD_TABLE_ERROR << path << std::endl;
+      return nullptr;
+    }
+
+  const ModelTensorEntry *entries =
+      (const ModelTensorEntry *) (base + sizeof (ModelFileHeader));
+  for (uint32_t i = 0; i < header->tensor_count; i++)
+    {
+      const ModelTensorEntry &e = entries[i];
+      uint64_t elem_size = dtype_size (e.dtype);
+      if (elem_size == 0 || e.rows == 0 || e.cols == 0
+          || e.n_bytes != (uint64_t) e.rows * e.cols * elem_size
+          || e.offset % MODEL_ALIGNMENT != 0 || e.offset < table_end
+          || e.offset > file->size() || file->size() - e.offset < e.n_bytes
+          || e.name[MODEL_TENSOR_NAME_SIZE - 1] != '\0')
+        {
+          std::cerr << MODEL_BAD_TENSOR_ERROR << path << std::endl;
+          return nullptr;
+        }
+    }
+
+  if (fnv1a64 (base + sizeof (ModelFileHeader),
+               file->size() - sizeof (ModelFileHeader)) != header->checksum)
+    {
+      std::cerr << MODEL_BAD_CHECKSUM_ERROR << path << std::endl;
+      return nullptr;
+    }
+  return std::shared_ptr<ModelFile> (new ModelFile (file));
+}
+
+/**
+ * @return the file header
+ */
+const ModelFileHeader &ModelFile::header () const
+{
+  return *(const ModelFileHeader *) _file->data();
+}
+
+/**
+ * @return the number of tensors in the file
+ */
+int ModelFile::tensor_count () const
+{
+  return (int) header().tensor_count;
+}
+
+/**
+ * @param i the tensor index, in [0, tensor_count())
+ * @return the i'th tensor descriptor
+ */
+const ModelTensorEntry &ModelFile::entry (int i) const
+{
+  const char *base = (const char *) _file->data();
+  return ((const ModelTensorEntry *) (base + sizeof (ModelFileHeader)))[i];
+}
+
+/**
+ * find a tensor by its name
+ * @param name the tensor name
+ * @return the tensor descriptor, or nullptr if there is no such tensor
+ */
+const ModelTensorEntry *ModelFile::find (const std::string &name) const
+{
+  for (int i = 0; i < tensor_count(); i++)
+    if (name == entry (i).name)
+      return &entry (i);
+  return nullptr;
+}
+
+/**
+ * get a float32 tensor as a read-only matrix, without copying it
+ * @param name the tensor name
+ * @return the tensor, or nullptr if there is no such float32 tensor
+ */
+SharedMatrix ModelFile::tensor (const std::string &name) const
+{
+  const ModelTensorEntry *e = find (name);
+  if (!e || e->dtype != MODEL_DTYPE_F32)
+    return nullptr;
+  return map_matrix (_file, e->offset, (int) e->rows, (int) e->cols);
+}
+
+/**
+ * get an int32 tensor, without copying it
+ * @param name the tensor name
+ * @return the first element inside the mapping, or nullptr if there is no
+ *         such int32 tensor
+ */
+const int32_t *ModelFile::int_tensor (const std::string &name) const
+{
+  const ModelTensorEntry *e = find (name);
+  if (!e || e->dtype != MODEL_DTYPE_I32)
+    return nullptr;
+  return (const int32_t *) ((const char *) _file->data() + e->offset);
+}
+
+/**
+ * @param name the tensor name
+ * @param mat the matrix, referenced until the tensor is written
+ * @return a float32 tensor of a matrix
+ */
+ModelTensor matrix_tensor (const std::string &name, const Matrix &mat)
+{
+  return {name, MODEL_DTYPE_F32, mat.get_rows(), mat.get_cols(), mat.data()};
+}
+
+/**
+ * write tensors into a new model file
+ * @param path the model file path
+ * @param tensors the tensors to write, in table order
+ * @return true on success, false if the file could not be written
+ */
+bool write_model_file (const std::string &path,
+                       const std::vector<ModelTensor> &tensors)
+{
+  // layout: header, table, then every payload on an aligned offset.
+  std::vector<ModelTensorEntry> entries (tensors.size());
+  uint64_t offset = align_up (sizeof (ModelFileHeader)
+                              + tensors.size() * sizeof (ModelTensorEntry));
+  for (std::size_t i = 0; i < tensors.size(); i++)
+    {
+      const ModelTensor &t = tensors[i];
+      ModelTensorEntry &e = entries[i];
+      std::memset (&e, 0, sizeof (e));
+      if (t.name.size() >= MODEL_TENSOR_NAME_SIZE || dtype_size (t.dtype) == 0
+          || t.rows <= 0 || t.cols <= 0)
+        return false;
+      std::memcpy (e.name, t.name.c_str(), t.name.size());
+      e.dtype = t.dtype;
+      e.rows = (uint32_t) t.rows;
+      e.cols = (uint32_t) t.cols;
+      e.n_bytes = (uint64_t) e.rows * e.cols * dtype_size (t.dtype);
+      e.offset = offset;
+      offset = align_up (offset + e.n_bytes);
+    }
+
+  std::vector<char> buf (offset, 0);
+  for (std::size_t i = 0; i < tensors.size(); i++)
+    std::memcpy (&buf[entries[i].offset], tensors[i].data,
+                 entries[i].n_bytes);
+  if (!entries.empty())
+    std::memcpy (&buf[sizeof (ModelFileHeader)], entries.data(),
+                 entries.size() * sizeof (ModelTensorEntry));
+
+  ModelFileHeader header;
+  std::memset (&header, 0, sizeof (header));
+  std::memcpy (header.magic, MODEL_MAGIC, MODEL_MAGIC_SIZE);
+  header.version = MODEL_VERSION;
+  header.tensor_count = (uint32_t) tensors.size();
+  header.file_size = buf.size();
+  header.checksum = fnv1a64 (buf.data() + sizeof (ModelFileHeader),
+                             buf.size() - sizeof (ModelFileHeader));
+  std::memcpy (buf.data(), &header, sizeof (header));
+
+  std::ofstream os (path, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!os.is_open())
+    return false;
+  os.write (buf.data(), (std::streamsize) buf.size());
+  return (bool) os;
+}
@@ -0,0 +1,176 @@
+// ModelFile.h
+
+#ifndef MODELFILE_H
+#define MODELFILE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "Matrix.h"
+
+/**
+ * The packed model container: a single little-endian file holding all the
+ * network tensors.
+ *
+ *   [ModelFileHeader][ModelTensorEntry x tensor_count][pad][tensor][pad]...
+ *
+ * Every tensor payload starts on a MODEL_ALIGNMENT boundary, so once the file
+ * is mapped the tensors are used in place, with aligned SIMD loads. The
+ * checksum (64-bit FNV-1a) covers every byte after the header.
+ */
+
+#define MODEL_MAGIC "MLPMODEL"
+#define MODEL_MAGIC_SIZE 8
+#define MODEL_VERSION 1
+#define MODEL_ALIGNMENT 64
+#define MODEL_TENSOR_NAME_SIZE 16
+
+/**
+ * @enum ModelDType
+ * @brief The element type of a stored tensor.
+ */
+enum ModelDType
+{
+    MODEL_DTYPE_F32 = 0,
+    MODEL_DTYPE_I32 = 1
+};
+
+/**
+ * @struct ModelFileHeader
+ * @brief The first bytes of a model file.
+ */
+struct ModelFileHeader
+{
+    char magic[MODEL_MAGIC_SIZE];
+    uint32_t version;
+    uint32_t tensor_count;
+    uint64_t file_size;
+    uint64_t checksum;
+    uint8_t reserved[32];
+};
+
+/**
+ * @struct ModelTensorEntry
+ * @brief A tensor descriptor of the model file tensors table.
+ */
+struct ModelTensorEntry
+{
+    char name[MODEL_TENSOR_NAME_SIZE];
+    uint32_t dtype;
+    uint32_t rows, cols;
+    uint32_t reserved0;
+    uint64_t offset;
+    uint64_t n_bytes;
+    uint8_t reserved[16];
+};
+
+static_assert (sizeof (ModelFileHeader) == MODEL_ALIGNMENT,
+               "model header must keep the table aligned");
+static_assert (sizeof (ModelTensorEntry) == MODEL_ALIGNMENT,
+               "model table entries must keep the table aligned");
+
+/**
+ * @struct ModelTensor
+ * @brief A named tensor to write to a model file: rows x cols elements of
+ *        dtype, row by row.
+ */
+struct ModelTensor
+{
+    std::string name;
+    uint32_t dtype;
+    int rows, cols;
+    const void *data;
+};
+
+/**
+ * @param name the tensor name
+ * @param mat the matrix, referenced until the tensor is written
+ * @return a float32 tensor of a matrix
+ */
+ModelTensor matrix_tensor (const std::string &name, const Matrix &mat);
+
+/**
+ * A model file mapped read-only. The tensors are exposed as matrices pointing
+ * straight into the mapping.
+ */
+class ModelFile
+{
+  std::shared_ptr<MappedFile> _file;
+
+/**
+ * ModelFile constructor, over an already validated mapping
+ * @param file the mapped model file
+ */
+  explicit ModelFile (std::shared_ptr<MappedFile> file);
+
+ public:
+/**
+ * map and validate a model file: magic, version, table and payload bounds,
+ * alignment and checksum. the reason of a failure is printed to stderr.
+ * @param path the model file path
+ * @return the model file, or nullptr if it is invalid
+ */
+  static std::shared_ptr<ModelFile> open (const std::string &path);
+
+/**
+ * @return the file header
+ */
+  const ModelFileHeader &header () const;
+
+/**
+ * @return the number of tensors in the file
+ */
+  int tensor_count () const;
+
+/**
+ * @param i the tensor index, in [0, tensor_count())
+ * @return the i'th tensor descriptor
+ */
+  const ModelTensorEntry &entry (int i) const;
+
+/**
+ * find a tensor by its name
+ * @param name the tensor name
+ * @return the tensor descriptor, or nullptr if there is no such tensor
+ */
+  const ModelTensorEntry *find (const std::string &name) const;
+
+/**
+ * get a float32 tensor as a read-only matrix, without copying it
+ * @param name the tensor name
+ * @return the tensor, or nullptr if there is no such float32 tensor
+ */
+  SharedMatrix tensor (const std::string &name) const;
+
+/**
+ * get an int32 tensor, without copying it
+ * @param name the tensor name
+ * @return the first element inside the mapping (rows * cols of them, as in
+ *         find(name)), or nullptr if there is no such int32 tensor
+ */
+  const int32_t *int_tensor (const std::string &name) const;
+};
+
+/**
+ * the 64-bit FNV-1a hash of a bytes range
+ * @param data the first byte
+ * @param n_bytes the range size
+ * @param hash the hash of the preceding bytes, to hash a range in parts
+ * @return the hash value
+ */
+uint64_t fnv1a64 (const void *data, std::size_t n_bytes,
+                  uint64_t hash = 0xcbf29ce484222325ULL);
+
+/**
+ * write tensors into a new model file
+ * @param path the model file path
+ * @param tensors the tensors to write, in table order
+ * @return true on success, false if the file could not be written
+ */
+bool write_model_file (const std::string &path,
+                       const std::vector<ModelTensor> &tensors);
+
+#endif //MODELFILE_H
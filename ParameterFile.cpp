@@ -0,0 +1,35 @@
+#include <cstdlib>
+#include <iostream>
+
+#include "MappedFile.h"
+#include "ParameterFile.h"
+
+#define ERROR_INVALID_PARAMETER "Error: invalid Parameters file for layer: "
+#define WEIGHTS_FILE_PREFIX "/w"
+#define BIAS_FILE_PREFIX "/b"
+
+/**
+ * Maps the raw parameter files of the digits network in a directory.
+ * Exits (code == 1) upon failures.
+ * @param dir - the parameters directory
+ * @param weights - the weights matrices
+ * @param biases - the biases matrices
+ */
+void loadParameterFiles(const std::string &dir,
+    SharedMatrix weights[MLP_SIZE], SharedMatrix biases[MLP_SIZE])
+{
+    for(int i = 0; i < MLP_SIZE; i++)
+    {
+        std::string idx = std::to_string(i + 1);
+        weights[i] = map_matrix_file(dir + WEIGHTS_FILE_PREFIX + idx,
+                                     weights_dims[i].rows,
+                                     weights_dims[i].cols);
+        biases[i] = map_matrix_file(dir + BIAS_FILE_PREFIX + idx,
+                                    bias_dims[i].rows, bias_dims[i].cols);
+        if(!(weights[i] && biases[i]))
+        {
+            std::cerr << ERROR_INVALID_PARAMETER << (i + 1) << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+}
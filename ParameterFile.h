@@ -0,0 +1,22 @@
+// ParameterFile.h
+
+#ifndef PARAMETERFILE_H
+#define PARAMETERFILE_H
+
+#include <string>
+
+#include "MlpNetwork.h"
+
+/**
+ * Maps the raw float32 parameter files of the digits network in a
+ * directory, dir/w1..w4 and dir/b1..b4 of the weights_dims and bias_dims
+ * shapes, read-only (map_matrix_file): nothing is copied.
+ * Exits (code == 1) upon failures.
+ * @param dir - the parameters directory
+ * @param weights - weights[i] is the i'th layer weights matrix
+ * @param biases - biases[i] is the i'th layer bias vector
+ */
+void loadParameterFiles(const std::string &dir,
+    SharedMatrix weights[MLP_SIZE], SharedMatrix biases[MLP_SIZE]);
+
+#endif //PARAMETERFILE_H
@@ -0,0 +1,86 @@
+#include "QuantizedDense.h"
+#include "Kernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define INT8_MAX_VALUE 127
+#define INVALID_INPUT_SIZE "Error: QuantizedDense input must be a vector of " \
+                           "#weights cols size.\n"
+
+/**
+ * the int8 buffers of the calling thread. they only grow, so in steady state
+ * the layers do not allocate.
+ */
+static thread_local std::vector<int8_t> quantized_input;
+static thread_local std::vector<int32_t> accumulators;
+
+/**
+ * the QuantizedDense constructor, quantizes a float layer
+ * @param dense the float layer
+ * @param input_max the largest absolute input value expected by the layer
+ * @param non_negative_input whether the layer inputs are never negative
+ */
+QuantizedDense::QuantizedDense (const Dense &dense, float input_max,
+                                bool non_negative_input)
+    : _rows(dense.get_output_size()), _cols(dense.get_input_size()),
+      _w((std::size_t) _rows * _cols), _w_scales(_rows),
+      _bias(std::make_shared<const Matrix> (dense.get_bias())),
+      _act(dense.get_activation()),
+      _in_scale(input_max > 0 ? input_max / INT8_MAX_VALUE : 1),
+      _non_negative_input(non_negative_input)
+{
+  const HalfMatrix *half = dense.get_half_weights();
+  Matrix widened = half ? half->to_matrix() : Matrix();
+  const float *w = half ? widened.data() : dense.get_weights().data();
+  for (int i = 0; i < _rows; i++)
+    {
+      float row_max = 0;
+      for (int j = 0; j < _cols; j++)
+        row_max = std::max (row_max, std::fabs (w[i * _cols + j]));
+      _w_scales[i] = row_max > 0 ? row_max / INT8_MAX_VALUE : 1;
+
+      quantize_s8 (w + i * _cols, 1 / _w_scales[i], &_w[i * _cols], _cols,
+                   false);
+    }
+}
+
+/**
+ * the quantized Dense execution: out = act(w * m + bias)
+ * @param m a given input vector
+ * @param out the output vector, resized to (#weights rows x 1)
+ */
+void QuantizedDense::forward (const Matrix &m, Matrix &out) const
+{
+  if (m.get_rows() * m.get_cols() != _cols)
+    {
+      std::cerr << INVALID_INPUT_SIZE << std::endl;
+      exit (EXIT_FAILURE);
+    }
+  if ((int) quantized_input.size() < _cols)
+    quantized_input.resize (_cols);
+  if ((int) accumulators.size() < _rows)
+    accumulators.resize (_rows);
+
+  quantize_s8 (m.data(), 1 / _in_scale, quantized_input.data(), _cols,
+               _non_negative_input);
+  if (_non_negative_input)
+    gemv_u8s8 (_w.data(), _cols, (const uint8_t *) quantized_input.data(),
+               accumulators.data(), _rows, _cols);
+  else
+    gemv_s8 (_w.data(), _cols, quantized_input.data(), accumulators.data(),
+             _rows, _cols);
+
+  out.resize (_rows, 1);
+  float *y = out.data();
+  const float *bias = _bias->data();
+  bool relu = _act.get_activation_type() == RELU;
+  for (int i = 0; i < _rows; i++)
+    {
+      float val = (float) accumulators[i] * (_w_scales[i] * _in_scale)
+                  + bias[i];
+      y[i] = (relu && val < 0) ? 0 : val;
+    }
+  if (_act.get_activation_type() == SOFTMAX)
+    Activation::softmax_inplace (out);
+}
@@ -0,0 +1,64 @@
+// QuantizedDense.h
+
+#ifndef QUANTIZEDDENSE_H
+#define QUANTIZEDDENSE_H
+
+#include <cstdint>
+#include <vector>
+
+#include "Dense.h"
+
+/**
+ * An int8 copy of a Dense layer. The weights are quantized per row:
+ * w(i,j) ~= w_q(i,j) * w_scale[i], and the layer input is quantized with one
+ * calibrated scale: x(j) ~= x_q(j) * in_scale. The products are accumulated
+ * in int32 and scaled back to float before the bias and the activation.
+ */
+class QuantizedDense
+{
+  int _rows, _cols;
+  std::vector<int8_t> _w;
+  std::vector<float> _w_scales;
+  SharedMatrix _bias;
+  Activation _act;
+  float _in_scale;
+  bool _non_negative_input;
+
+ public:
+/**
+ * the QuantizedDense constructor, quantizes a float layer
+ * @param dense the float layer
+ * @param input_max the largest absolute input value expected by the layer,
+ *        as measured by calibration
+ * @param non_negative_input whether the layer inputs are never negative
+ *        (images pixels, relu outputs) - such inputs use the faster unsigned
+ *        int8 kernel, and negative values are clamped to 0
+ */
+  QuantizedDense (const Dense &dense, float input_max,
+                  bool non_negative_input);
+
+/**
+ * the quantized Dense execution: out = act(w * m + bias)
+ * @param m a given input vector
+ * @param out the output vector, resized to (#weights rows x 1)
+ */
+  void forward (const Matrix &m, Matrix &out) const;
+
+/**
+ * @return the input quantization scale
+ */
+  float get_input_scale () const
+  {
+    return _in_scale;
+  }
+
+/**
+ * @return the number of bytes of the quantized weights and their scales
+ */
+  std::size_t weights_bytes () const
+  {
+    return _w.size() * sizeof (int8_t) + _w_scales.size() * sizeof (float);
+  }
+};
+
+#endif //QUANTIZEDDENSE_H
@@ -0,0 +1,106 @@
+#include "QuantizedMlp.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define EMPTY_CALIBRATION "Error: int8 calibration needs at least one " \
+                          "image.\n"
+
+/**
+ * the per-thread workspace of the operator() calls
+ */
+static thread_local MlpWorkspace thread_workspace;
+
+/**
+ * the largest absolute value of a matrix
+ */
+static float max_abs (const Matrix &m)
+{
+  float result = 0;
+  for (int i = 0; i < m.get_rows() * m.get_cols(); i++)
+    result = std::max (result, std::fabs (m.data()[i]));
+  return result;
+}
+
+/**
+ * the smallest value of a matrix
+ */
+static float min_value (const Matrix &m)
+{
+  float result = m.data()[0];
+  for (int i = 1; i < m.get_rows() * m.get_cols(); i++)
+    result = std::min (result, m.data()[i]);
+  return result;
+}
+
+/**
+ * the QuantizedMlp constructor, quantizes and calibrates a float network
+ * @param mlp the float network
+ * @param calibration_images sample inputs, of img_dims size each
+ */
+QuantizedMlp::QuantizedMlp (const MlpNetwork &mlp,
+                            const std::vector<Matrix> &calibration_images)
+{
+  if (calibration_images.empty())
+    {
+      std::cerr << EMPTY_CALIBRATION << std::endl;
+      exit (EXIT_FAILURE);
+    }
+
+  const std::vector<Dense> &layers = mlp.get_layers();
+  std::vector<float> input_max (layers.size(), 0);
+  std::vector<float> input_min (layers.size(), 0);
+  Matrix in, out;
+  for (const Matrix &img : calibration_images)
+    {
+      in = img;
+      in.vectorize();
+      for (std::size_t i = 0; i < layers.size(); i++)
+        {
+          input_max[i] = std::max (input_max[i], max_abs (in));
+          input_min[i] = std::min (input_min[i], min_value (in));
+          layers[i].forward (in, out);
+          std::swap (in, out);
+        }
+    }
+
+  _layers.reserve (layers.size());
+  for (std::size_t i = 0; i < layers.size(); i++)
+    _layers.emplace_back (layers[i], input_max[i], input_min[i] >= 0);
+}
+
+/**
+ * the QuantizedMlp operator, compute the quantized network on the given
+ * Matrix
+ * @param m the input matrix
+ * @return a digit struct, contain the values and its distributions
+ */
+digit QuantizedMlp::operator() (const Matrix &m) const
+{
+  MlpWorkspace &ws = thread_workspace;
+  if (ws.layer_outputs.size() < _layers.size())
+    {
+      // the workspace outlives the request: never from a request arena.
+      ScopedMatrixAllocator workspace_alloc (pool_allocator());
+      ws.layer_outputs.resize (_layers.size());
+    }
+
+  const Matrix *in = &m;
+  for (std::size_t i = 0; i < _layers.size(); i++)
+    {
+      _layers[i].forward (*in, ws.layer_outputs[i]);
+      in = &ws.layer_outputs[i];
+    }
+  return MlpNetwork::column_argmax (*in, 0);
+}
+
+/**
+ * @return the number of bytes of the quantized weights of all the layers
+ */
+std::size_t QuantizedMlp::weights_bytes () const
+{
+  std::size_t bytes = 0;
+  for (const QuantizedDense &layer : _layers)
+    bytes += layer.weights_bytes();
+  return bytes;
+}
@@ -0,0 +1,44 @@
+// QuantizedMlp.h
+
+#ifndef QUANTIZEDMLP_H
+#define QUANTIZEDMLP_H
+
+#include <vector>
+
+#include "MlpNetwork.h"
+#include "QuantizedDense.h"
+
+/**
+ * An int8 quantized copy of a MlpNetwork. The input scale of every layer is
+ * calibrated by running the float network on sample images.
+ */
+class QuantizedMlp
+{
+  std::vector<QuantizedDense> _layers;
+
+ public:
+/**
+ * the QuantizedMlp constructor, quantizes and calibrates a float network
+ * @param mlp the float network
+ * @param calibration_images sample inputs, of img_dims size each. the
+ *        largest absolute input of every layer over them sets the layer
+ *        input scale
+ */
+  QuantizedMlp (const MlpNetwork &mlp,
+                const std::vector<Matrix> &calibration_images);
+
+/**
+ * the QuantizedMlp operator, compute the quantized network on the given
+ * Matrix. may be called from many threads at once.
+ * @param m the input matrix
+ * @return a digit struct, contain the values and its distributions
+ */
+  digit operator() (const Matrix &m) const;
+
+/**
+ * @return the number of bytes of the quantized weights of all the layers
+ */
+  std::size_t weights_bytes () const;
+};
+
+#endif //QUANTIZEDMLP_H
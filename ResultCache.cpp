@@ -0,0 +1,252 @@
+#include "ResultCache.h"
+
+#include <algorithm>
+#include <cstring>
+
+#define XXH_PRIME1 11400714785074694791ULL
+#define XXH_PRIME2 14029467366897019727ULL
+#define XXH_PRIME3 1609587929392839161ULL
+#define XXH_PRIME4 9650029242287828579ULL
+#define XXH_PRIME5 2870177450012600261ULL
+#define XXH_STRIPE_FLOATS 8   // 32 bytes: a 64 bits lane per accumulator
+
+/**
+ * @param x a value
+ * @param r a rotation, in (0, 64)
+ * @return x rotated left by r bits
+ */
+static inline uint64_t rotl64 (uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+/**
+ * mix a 64 bits lane into an XXH64 accumulator
+ */
+static inline uint64_t xxh_round (uint64_t acc, uint64_t lane)
+{
+  acc += lane * XXH_PRIME2;
+  return rotl64 (acc, 31) * XXH_PRIME1;
+}
+
+/**
+ * merge an accumulator into the XXH64 hash of the stripes
+ */
+static inline uint64_t xxh_merge (uint64_t h, uint64_t acc)
+{
+  h ^= xxh_round (0, acc);
+  return h * XXH_PRIME1 + XXH_PRIME4;
+}
+
+/**
+ * @return the bits of a float
+ */
+static inline uint32_t float_bits (float f)
+{
+  uint32_t bits;
+  std::memcpy (&bits, &f, sizeof (bits));
+  return bits;
+}
+
+/**
+ * @return the little-endian 64 bits lane of two consecutive floats
+ */
+static inline uint64_t float_lane (const float *x, long stride)
+{
+  return (uint64_t) float_bits (x[0])
+         | (uint64_t) float_bits (x[stride]) << 32;
+}
+
+/**
+ * the ResultCache constructor
+ * @param capacity the entries number, split over the shards
+ * @param shards the shards number
+ */
+ResultCache::ResultCache (std::size_t capacity, int shards)
+    : _shards(std::max<std::size_t> (
+          std::min<std::size_t> (std::max (shards, 1), capacity), 1)),
+      _capacity(std::max<std::size_t> (capacity, 1))
+{
+  // the shards number is at most the capacity: every shard holds one entry
+  // at least.
+  std::size_t base = _capacity / _shards.size();
+  std::size_t extra = _capacity % _shards.size();
+  for (std::size_t i = 0; i < _shards.size(); i++)
+    {
+      Shard &s = _shards[i];
+      s.capacity = base + (i < extra ? 1 : 0);
+      s.index.reserve (s.capacity);
+      s.entries.reserve (s.capacity);
+    }
+}
+
+/**
+ * a 64 bits hash of a vector of floats: the XXH64 (seed 0) of their bytes
+ * @param x the first element
+ * @param n the elements number
+ * @param stride the distance between two consecutive elements
+ * @return the hash
+ */
+uint64_t ResultCache::hash (const float *x, int n, int stride)
+{
+  const long s = stride;
+  int i = 0;
+  uint64_t h;
+  if (n >= XXH_STRIPE_FLOATS)
+    {
+      uint64_t v1 = XXH_PRIME1 + XXH_PRIME2, v2 = XXH_PRIME2, v3 = 0;
+      uint64_t v4 = 0 - XXH_PRIME1;
+      for (; i + XXH_STRIPE_FLOATS <= n; i += XXH_STRIPE_FLOATS)
+        {
+          const float *p = x + i * s;
+          v1 = xxh_round (v1, float_lane (p, s));
+          v2 = xxh_round (v2, float_lane (p + 2 * s, s));
+          v3 = xxh_round (v3, float_lane (p + 4 * s, s));
+          v4 = xxh_round (v4, float_lane (p + 6 * s, s));
+        }
+      h = rotl64 (v1, 1) + rotl64 (v2, 7) + rotl64 (v3, 12)
+          + rotl64 (v4, 18);
+      h = xxh_merge (h, v1);
+      h = xxh_merge (h, v2);
+      h = xxh_merge (h, v3);
+      h = xxh_merge (h, v4);
+    }
+  else
+    h = XXH_PRIME5;
+
+  h += (uint64_t) n * sizeof (float);
+  for (; i + 2 <= n; i += 2)
+    {
+      h ^= xxh_round (0, float_lane (x + i * s, s));
+      h = rotl64 (h, 27) * XXH_PRIME1 + XXH_PRIME4;
+    }
+  if (i < n)
+    {
+      h ^= (uint64_t) float_bits (x[i * s]) * XXH_PRIME1;
+      h = rotl64 (h, 23) * XXH_PRIME2 + XXH_PRIME3;
+    }
+
+  h ^= h >> 33;
+  h *= XXH_PRIME2;
+  h ^= h >> 29;
+  h *= XXH_PRIME3;
+  h ^= h >> 32;
+  return h;
+}
+
+/**
+ * unlink an entry from the recency list of its shard
+ * @param s the shard
+ * @param i the entry index
+ */
+void ResultCache::unlink (Shard &s, int i)
+{
+  Entry &e = s.entries[i];
+  if (e.prev >= 0)
+    s.entries[e.prev].next = e.next;
+  else
+    s.head = e.next;
+  if (e.next >= 0)
+    s.entries[e.next].prev = e.prev;
+  else
+    s.tail = e.prev;
+}
+
+/**
+ * link an entry at the most recently used end of its shard
+ * @param s the shard
+ * @param i the entry index
+ */
+void ResultCache::push_front (Shard &s, int i)
+{
+  Entry &e = s.entries[i];
+  e.prev = -1;
+  e.next = s.head;
+  if (s.head >= 0)
+    s.entries[s.head].prev = i;
+  s.head = i;
+  if (s.tail < 0)
+    s.tail = i;
+}
+
+/**
+ * find the result of a key, and mark it the most recently used
+ * @param key the input hash
+ * @param result the cached result, set on a hit
+ * @return whether the key was cached
+ */
+bool ResultCache::lookup (uint64_t key, digit &result)
+{
+  Shard &s = shard (key);
+  std::lock_guard<std::mutex> guard (s.lock);
+  auto it = s.index.find (key);
+  if (it == s.index.end())
+    {
+      s.misses++;
+      return false;
+    }
+  s.hits++;
+  if (s.head != it->second)
+    {
+      unlink (s, it->second);
+      push_front (s, it->second);
+    }
+  result = s.entries[it->second].result;
+  return true;
+}
+
+/**
+ * cache the result of a key, evicting the least recently used key of its
+ * shard if the shard is full
+ * @param key the input hash
+ * @param result the result of the input
+ */
+void ResultCache::insert (uint64_t key, const digit &result)
+{
+  Shard &s = shard (key);
+  std::lock_guard<std::mutex> guard (s.lock);
+  auto it = s.index.find (key);
+  if (it != s.index.end())
+    {
+      // another thread classified the same input meanwhile.
+      s.entries[it->second].result = result;
+      return;
+    }
+
+  if (s.entries.size() < s.capacity)
+    {
+      int i = (int) s.entries.size();
+      s.entries.push_back ({key, result, -1, -1});
+      s.index.emplace (key, i);
+      push_front (s, i);
+      return;
+    }
+
+  // reuse the least recently used entry, and its index node.
+  int i = s.tail;
+  unlink (s, i);
+  auto node = s.index.extract (s.entries[i].key);
+  node.key() = key;
+  s.index.insert (std::move (node));
+  s.entries[i].key = key;
+  s.entries[i].result = result;
+  push_front (s, i);
+  s.evictions++;
+}
+
+/**
+ * @return the counters, summed over the shards
+ */
+CacheStats ResultCache::stats ()
+{
+  CacheStats total = {0, 0, 0, 0};
+  for (Shard &s : _shards)
+    {
+      std::lock_guard<std::mutex> guard (s.lock);
+      total.hits += s.hits;
+      total.misses += s.misses;
+      total.evictions += s.evictions;
+      total.size += (long) s.entries.size();
+    }
+  return total;
+}
@@ -0,0 +1,149 @@
+// ResultCache.h
+
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "Digit.h"
+
+#define RESULT_CACHE_SHARDS 16
+
+/**
+ * @struct CacheStats
+ * @brief The counters of a result cache, summed over its shards.
+ * @var hits - the lookups that found their key
+ * @var misses - the lookups that did not
+ * @var evictions - the least recently used entries dropped for new ones
+ * @var size - the entries number
+ */
+struct CacheStats
+{
+    long hits;
+    long misses;
+    long evictions;
+    long size;
+};
+
+/**
+ * A bounded cache of classification results, keyed by a 64 bits hash of
+ * the input vector (hash): repeated inputs (retries, re-scanned forms) are
+ * answered without evaluating the network. Only the key is stored, not the
+ * input: two inputs of the same hash share a result, which is negligible
+ * (about n^2 / 2^65 for n distinct inputs).
+ *
+ * The keys are spread over independently locked shards, so concurrent
+ * lookups rarely contend. Every shard is a least recently used list of a
+ * fixed capacity, their sum the cache capacity: once full, an insertion
+ * reuses the entry (and the index node) of its least recently used key, so
+ * a full cache does not allocate.
+ */
+class ResultCache
+{
+/**
+ * @struct Entry
+ * @brief A cached result, linked in the recency order of its shard.
+ */
+  struct Entry
+  {
+    uint64_t key;
+    digit result;
+    int prev, next;   // entries indices, -1 at the ends
+  };
+
+/**
+ * @struct Shard
+ * @brief The entries of a keys range, on their own cache lines.
+ */
+  struct alignas(64) Shard
+  {
+    std::mutex lock;
+    std::unordered_map<uint64_t, int> index;
+    std::vector<Entry> entries;
+    std::size_t capacity = 0;   // the entries number it holds at most
+    int head = -1, tail = -1;   // the most and least recently used
+    long hits = 0, misses = 0, evictions = 0;
+  };
+
+  std::vector<Shard> _shards;
+  std::size_t _capacity;
+
+/**
+ * @param key a key
+ * @return the shard of the key
+ */
+  Shard &shard (uint64_t key)
+  {
+    // the index buckets use the low bits, the shards the high ones.
+    return _shards[(key >> 32) % _shards.size()];
+  }
+
+/**
+ * unlink an entry from the recency list of its shard
+ */
+  static void unlink (Shard &s, int i);
+
+/**
+ * link an entry at the most recently used end of its shard
+ */
+  static void push_front (Shard &s, int i);
+
+ public:
+/**
+ * the ResultCache constructor
+ * @param capacity the entries number, at least 1, split over the shards:
+ *        the first capacity % shards ones hold an extra entry
+ * @param shards the shards number, at least 1 and at most capacity
+ */
+  explicit ResultCache (std::size_t capacity,
+                        int shards = RESULT_CACHE_SHARDS);
+
+  ResultCache (const ResultCache &oth) = delete;
+  ResultCache &operator= (const ResultCache &rhs) = delete;
+
+/**
+ * a 64 bits hash of a vector of floats, of their bits: the XXH64 (seed 0)
+ * of the floats bytes, read two floats per 64 bits lane. a strided vector
+ * (e.g. a column of a batch) hashes as its contiguous copy would.
+ * @param x the first element
+ * @param n the elements number
+ * @param stride the distance between two consecutive elements
+ * @return the hash
+ */
+  static uint64_t hash (const float *x, int n, int stride = 1);
+
+/**
+ * find the result of a key, and mark it the most recently used
+ * @param key the input hash
+ * @param result the cached result, set on a hit
+ * @return whether the key was cached
+ */
+  bool lookup (uint64_t key, digit &result);
+
+/**
+ * cache the result of a key, evicting the least recently used key of its
+ * shard if the shard is full. an existing key is updated.
+ * @param key the input hash
+ * @param result the result of the input
+ */
+  void insert (uint64_t key, const digit &result);
+
+/**
+ * @return the counters, summed over the shards
+ */
+  CacheStats stats ();
+
+/**
+ * @return the entries number the cache holds at most
+ */
+  std::size_t capacity () const
+  {
+    return _capacity;
+  }
+};
+
+#endif //RESULTCACHE_H
@@ -0,0 +1,53 @@
+#include "ServerProtocol.h"
+
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <cerrno>
+
+/**
+ * read exactly n bytes of a socket
+ * @param fd the socket
+ * @param buf the bytes destination
+ * @param n the bytes number
+ * @return false if the socket was closed or failed first
+ */
+bool read_full (int fd, void *buf, std::size_t n)
+{
+  char *bytes = (char *) buf;
+  while (n > 0)
+    {
+      ssize_t got = recv (fd, bytes, n, 0);
+      if (got < 0 && errno == EINTR)
+        continue;
+      if (got <= 0)
+        return false;
+      bytes += got;
+      n -= (std::size_t) got;
+    }
+  return true;
+}
+
+/**
+ * write exactly n bytes to a socket
+ * @param fd the socket
+ * @param buf the bytes
+ * @param n the bytes number
+ * @return false if the socket was closed or failed first
+ */
+bool write_full (int fd, const void *buf, std::size_t n)
+{
+  const char *bytes = (const char *) buf;
+  while (n > 0)
+    {
+      // a peer that went away must not kill the process with SIGPIPE.
+      ssize_t sent = send (fd, bytes, n, MSG_NOSIGNAL);
+      if (sent < 0 && errno == EINTR)
+        continue;
+      if (sent <= 0)
+        return false;
+      bytes += sent;
+      n -= (std::size_t) sent;
+    }
+  return true;
+}
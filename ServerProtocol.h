@@ -0,0 +1,79 @@
+// ServerProtocol.h
+
+#ifndef SERVERPROTOCOL_H
+#define SERVERPROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * The messages of the inference server, over a Unix domain stream socket.
+ * A request is a ServerRequestHeader, followed for SERVER_OP_CLASSIFY by the
+ * image: img_dims floats (row by row). The server answers a classification
+ * with a ServerDigitReply, and a statistics request with a ServerStatsReply.
+ * The integers are in the host byte order - both ends are local.
+ */
+
+/**
+ * @enum ServerOp
+ * @brief The request kind.
+ */
+enum ServerOp
+{
+    SERVER_OP_CLASSIFY = 1,
+    SERVER_OP_STATS = 2
+};
+
+/**
+ * @struct ServerRequestHeader
+ * @brief The first bytes of a request.
+ */
+struct ServerRequestHeader
+{
+    uint32_t op;
+};
+
+/**
+ * @struct ServerDigitReply
+ * @brief The answer of a classification request.
+ */
+struct ServerDigitReply
+{
+    uint32_t value;
+    float probability;
+};
+
+/**
+ * @struct ServerStatsReply
+ * @brief The server counters. The latencies are measured from the request
+ *        arrival to its result, over the recent requests.
+ */
+struct ServerStatsReply
+{
+    uint64_t requests;
+    uint64_t batches;
+    uint32_t queue_depth;
+    uint32_t max_queue_depth;
+    float p50_us;
+    float p99_us;
+};
+
+/**
+ * read exactly n bytes of a socket
+ * @param fd the socket
+ * @param buf the bytes destination
+ * @param n the bytes number
+ * @return false if the socket was closed or failed first
+ */
+bool read_full (int fd, void *buf, std::size_t n);
+
+/**
+ * write exactly n bytes to a socket
+ * @param fd the socket
+ * @param buf the bytes
+ * @param n the bytes number
+ * @return false if the socket was closed or failed first
+ */
+bool write_full (int fd, const void *buf, std::size_t n);
+
+#endif //SERVERPROTOCOL_H
@@ -0,0 +1,57 @@
+#include "SparseMatrix.h"
+
+/**
+ * whether a block of a dense matrix holds a non zero element
+ * @param m the dense matrix
+ * @param i the block row
+ * @param col the block first column
+ */
+static bool block_nonzero (const Matrix &m, int i, int col)
+{
+  const float *row = m.data() + (std::size_t) i * m.get_cols();
+  for (int l = col; l < m.get_cols() && l < col + SPARSE_BLOCK; l++)
+    if (row[l] != 0)
+      return true;
+  return false;
+}
+
+/**
+ * SparseMatrix constructor, keeps the non zero blocks of a dense matrix
+ * @param m the dense matrix
+ */
+SparseMatrix::SparseMatrix (const Matrix &m)
+    : _rows(m.get_rows()), _cols(m.get_cols()), _row_ptr(1, 0)
+{
+  _row_ptr.reserve (_rows + 1);
+  for (int i = 0; i < _rows; i++)
+    {
+      const float *row = m.data() + (std::size_t) i * _cols;
+      for (int col = 0; col < _cols; col += SPARSE_BLOCK)
+        {
+          if (!block_nonzero (m, i, col))
+            continue;
+          _block_cols.push_back (col);
+          // a block past the last column is zero padded.
+          for (int l = col; l < col + SPARSE_BLOCK; l++)
+            _values.push_back (l < _cols ? row[l] : 0);
+        }
+      _row_ptr.push_back ((int) _block_cols.size());
+    }
+}
+
+/**
+ * the fraction of the blocks of a dense matrix that hold a non zero element
+ * @param m the dense matrix
+ * @return the blocks density, in [0, 1]
+ */
+float SparseMatrix::block_density (const Matrix &m)
+{
+  long blocks = 0, nonzero = 0;
+  for (int i = 0; i < m.get_rows(); i++)
+    for (int col = 0; col < m.get_cols(); col += SPARSE_BLOCK)
+      {
+        blocks++;
+        nonzero += block_nonzero (m, i, col);
+      }
+  return blocks ? (float) nonzero / blocks : 1;
+}
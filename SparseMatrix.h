@@ -0,0 +1,106 @@
+// SparseMatrix.h
+
+#ifndef SPARSEMATRIX_H
+#define SPARSEMATRIX_H
+
+#include <memory>
+#include <vector>
+
+#include "Kernels.h"
+#include "Matrix.h"
+
+/**
+ * A read-only block-sparse matrix (BSR of 1 x SPARSE_BLOCK blocks): every
+ * row keeps only its blocks holding a non zero element, each block a whole
+ * SIMD vector of elements, so the sparse kernels read no zero-only block and
+ * still load whole vectors. Pruned weights (see tools/prune.cpp) are zero
+ * in whole blocks.
+ */
+class SparseMatrix
+{
+  int _rows, _cols;
+  std::vector<int> _row_ptr;
+  std::vector<int> _block_cols;
+  std::vector<float> _values;
+
+ public:
+/**
+ * SparseMatrix constructor, keeps the non zero blocks of a dense matrix
+ * @param m the dense matrix
+ */
+  explicit SparseMatrix (const Matrix &m);
+
+/**
+ * the fraction of the blocks of a dense matrix that hold a non zero element
+ * (without building its sparse copy)
+ * @param m the dense matrix
+ * @return the blocks density, in [0, 1]
+ */
+  static float block_density (const Matrix &m);
+
+/**
+ * the rows field getter
+ * @return SparseMatrix rows number
+ */
+  int get_rows () const
+  {
+    return _rows;
+  }
+
+/**
+ * the cols field getter
+ * @return SparseMatrix cols number
+ */
+  int get_cols () const
+  {
+    return _cols;
+  }
+
+/**
+ * @return the number of stored blocks
+ */
+  int blocks_num () const
+  {
+    return (int) _block_cols.size();
+  }
+
+/**
+ * @return the rows + 1 block indices of the rows beginnings
+ */
+  const int *row_ptr () const
+  {
+    return _row_ptr.data();
+  }
+
+/**
+ * @return the first column of every stored block
+ */
+  const int *block_cols () const
+  {
+    return _block_cols.data();
+  }
+
+/**
+ * @return the SPARSE_BLOCK elements of every stored block
+ */
+  const float *values () const
+  {
+    return _values.data();
+  }
+
+/**
+ * @return the number of bytes of the stored blocks and indices
+ */
+  std::size_t bytes () const
+  {
+    return _values.size() * sizeof (float)
+           + (_row_ptr.size() + _block_cols.size()) * sizeof (int);
+  }
+};
+
+/**
+ * a read-only sparse matrix shared by many owners
+ */
+typedef std::shared_ptr<const SparseMatrix> SharedSparseMatrix;
+
+#endif //SPARSEMATRIX_H
@@ -0,0 +1,152 @@
+// StaticMlp.h
+
+#ifndef STATICMLP_H
+#define STATICMLP_H
+
+#include "Digit.h"
+#include "FixedDense.h"
+
+#define STATIC_MLP_INPUT_ERROR "Error: StaticMlp input size does not match " \
+                               "the network input: "
+
+/**
+ * A network of a compile-time topology: StaticMlp<784, 128, 64, 20, 10> is
+ * a 784 inputs network with relu layers of 128, 64 and 20 outputs, and a
+ * softmax layer of 10 outputs. Every layer is a FixedDense, every layer
+ * output a FixedMatrix on the stack, so an evaluation allocates nothing
+ * and checks no dimension. The products are still the out-of-line gemv
+ * kernel, called with the constant shapes: nothing is specialized per
+ * shape. It computes the same network as a MlpNetwork of the same
+ * parameters, which remains the network of a runtime topology.
+ * @tparam Dims the input size, then the output size of every layer
+ */
+template <int... Dims>
+class StaticMlp;
+
+/**
+ * the classifying operators of a StaticMlp network, of its forward
+ * @tparam Net the network
+ * @tparam In the network input size
+ * @tparam Out the network output size
+ */
+template <class Net, int In, int Out>
+class StaticMlpClassifier
+{
+ public:
+/**
+ * the StaticMlp operator, classify an input vector
+ * @param x the input
+ * @return a digit struct, contain the value and its probability
+ */
+  digit operator() (const FixedMatrix<In, 1> &x) const
+  {
+    FixedMatrix<Out, 1> out;
+    static_cast<const Net &> (*this).forward (x, out);
+    digit result = {0, out[0]};
+    for (int i = 1; i < Out; i++)
+      if (out[i] > result.probability)
+        result = {(unsigned int) i, out[i]};
+    return result;
+  }
+
+/**
+ * the StaticMlp operator, classify a dynamic matrix of the input size
+ * (copied into a fixed input vector).
+ * exits (code == 1) if m is not of the input size.
+ * @param m the input matrix, of any shape
+ * @return a digit struct, contain the value and its probability
+ */
+  digit operator() (const Matrix &m) const
+  {
+    FixedMatrix<In, 1> x;
+    if (!x.assign (m))
+      {
+        std::cerr << STATIC_MLP_INPUT_ERROR << m.get_rows() << "x"
+                  << m.get_cols() << std::endl;
+        exit (EXIT_FAILURE);
+      }
+    return (*this) (x);
+  }
+};
+
+/**
+ * the last (softmax) layer of a StaticMlp
+ */
+template <int In, int Out>
+class StaticMlp<In, Out>
+    : public StaticMlpClassifier<StaticMlp<In, Out>, In, Out>
+{
+  FixedDense<In, Out, SOFTMAX> _layer;
+
+ public:
+  static constexpr int input_size = In;
+  static constexpr int output_size = Out;
+  static constexpr int layers_num = 1;
+
+/**
+ * the StaticMlp constructor, shares the given read-only parameters.
+ * exits (code == 1) if they do not match the network shapes.
+ * @param weights array of the weight matrices, one per layer
+ * @param biases array of the bias matrices, one per layer
+ */
+  StaticMlp (const SharedMatrix weights[], const SharedMatrix biases[])
+      : _layer(weights[0], biases[0]) {}
+
+/**
+ * compute the network on an input vector
+ * @param x the input
+ * @param out the network output (the softmax probabilities)
+ */
+  void forward (const FixedMatrix<In, 1> &x, FixedMatrix<Out, 1> &out) const
+  {
+    _layer.forward (x, out);
+  }
+};
+
+/**
+ * a relu layer of a StaticMlp, followed by the rest of the network
+ */
+template <int In, int Hidden, int... Rest>
+class StaticMlp<In, Hidden, Rest...>
+    : public StaticMlpClassifier<StaticMlp<In, Hidden, Rest...>, In,
+                                 StaticMlp<Hidden, Rest...>::output_size>
+{
+  typedef StaticMlp<Hidden, Rest...> Next;
+
+  FixedDense<In, Hidden, RELU> _layer;
+  Next _next;
+
+ public:
+  static constexpr int input_size = In;
+  static constexpr int output_size = Next::output_size;
+  static constexpr int layers_num = Next::layers_num + 1;
+
+/**
+ * the StaticMlp constructor, shares the given read-only parameters.
+ * exits (code == 1) if they do not match the network shapes.
+ * @param weights array of the weight matrices, one per layer
+ * @param biases array of the bias matrices, one per layer
+ */
+  StaticMlp (const SharedMatrix weights[], const SharedMatrix biases[])
+      : _layer(weights[0], biases[0]), _next(weights + 1, biases + 1) {}
+
+/**
+ * compute the network on an input vector
+ * @param x the input
+ * @param out the network output (the softmax probabilities)
+ */
+  void forward (const FixedMatrix<In, 1> &x,
+                FixedMatrix<output_size, 1> &out) const
+  {
+    FixedMatrix<Hidden, 1> hidden;
+    _layer.forward (x, hidden);
+    _next.forward (hidden, out);
+  }
+};
+
+/**
+ * the digits network, of the img_dims / weights_dims topology
+ */
+typedef StaticMlp<784, 128, 64, 20, 10> DigitStaticMlp;
+
+#endif //STATICMLP_H
@@ -0,0 +1,215 @@
+#include "StreamPipeline.h"
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BoundedQueue.h"
+#include "ImageFile.h"
+
+#define STREAM_BATCH_SIZE 64
+#define STREAM_QUEUE_DEPTH 4
+#define INVALID_IMAGE_MSG "invalid image"
+
+/**
+ * @struct StreamBatch
+ * @brief A batch of consecutive stream images, passed along the stages.
+ */
+struct StreamBatch
+{
+    long first;                         // the stream index of the 1st image
+    std::vector<std::string> sources;   // the images paths (paths input)
+    std::vector<char> valid;            // per image: whether it was read
+    std::vector<Matrix> images;         // the valid images only
+    std::vector<digit> results;         // the valid images results
+};
+
+/**
+ * read the next image of the stream
+ * @param in the input stream
+ * @param format the input format
+ * @param batch the batch to append the image to
+ * @param img the image buffer, of img_dims size
+ * @return false at the end of the input
+ */
+static bool read_image (std::istream &in, StreamFormat format,
+                        StreamBatch &batch, Matrix &img)
+{
+  bool valid;
+  if (format == STREAM_RAW)
+    {
+      std::streamsize n_bytes = (std::streamsize) sizeof (float)
+                                * img.get_rows() * img.get_cols();
+      in.read ((char *) img.data(), n_bytes);
+      if (in.gcount() == 0)
+        return false;
+      // a truncated last record is reported, and ends the stream.
+      valid = in.gcount() == n_bytes;
+    }
+  else
+    {
+      std::string path;
+      do
+        {
+          if (!std::getline (in, path))
+            return false;
+          if (!path.empty() && path.back() == '\r')
+            path.pop_back();
+        }
+      while (path.empty());
+      valid = readFileToMatrix (path, img);
+      batch.sources.push_back (std::move (path));
+    }
+
+  batch.valid.push_back (valid);
+  if (valid)
+    batch.images.push_back (img);
+  return true;
+}
+
+/**
+ * the read stage: groups the input images into batches
+ */
+static void read_stage (std::istream &in, StreamFormat format,
+                        BoundedQueue<StreamBatch> &queue)
+{
+  Matrix img (img_dims.rows * img_dims.cols, 1);
+  long next = 0;
+  bool more = true;
+  while (more)
+    {
+      StreamBatch batch;
+      batch.first = next;
+      batch.images.reserve (STREAM_BATCH_SIZE);
+      while (batch.valid.size() < STREAM_BATCH_SIZE
+             && (more = read_image (in, format, batch, img)))
+        ;
+      next += (long) batch.valid.size();
+      if (!batch.valid.empty())
+        queue.push (std::move (batch));
+    }
+  queue.close();
+}
+
+/**
+ * the infer stage: classifies every batch in one pass
+ */
+static void infer_stage (const MlpNetwork &mlp,
+                         BoundedQueue<StreamBatch> &in,
+                         BoundedQueue<StreamBatch> &out)
+{
+  // the batch matrix classify_batch packs the images into lives as long
+  // as the call: it comes from an arena, freed in one step per batch.
+  MatrixArena arena;
+  StreamBatch batch;
+  while (in.pop (batch))
+    {
+      if (!batch.images.empty())
+        {
+          ScopedMatrixAllocator scope (arena);
+          batch.results = mlp.classify_batch (batch.images);
+        }
+      arena.reset();
+      // the images are not needed anymore, do not hold them in the queue.
+      batch.images.clear();
+      out.push (std::move (batch));
+    }
+  out.close();
+}
+
+/**
+ * append a JSON string literal to a buffer
+ */
+static void append_json_string (std::string &buf, const std::string &str)
+{
+  buf += '"';
+  for (unsigned char c : str)
+    {
+      if (c == '"' || c == '\\')
+        {
+          buf += '\\';
+          buf += (char) c;
+        }
+      else if (c < 0x20)
+        {
+          char escaped[8];
+          std::snprintf (escaped, sizeof (escaped), "\\u%04x", c);
+          buf += escaped;
+        }
+      else
+        buf += (char) c;
+    }
+  buf += '"';
+}
+
+/**
+ * append the JSON lines of a classified batch to a buffer
+ * @return the invalid images number of the batch
+ */
+static long append_batch (std::string &buf, const StreamBatch &batch)
+{
+  long invalid = 0;
+  std::size_t result = 0;
+  char num[64];
+  for (std::size_t i = 0; i < batch.valid.size(); i++)
+    {
+      std::snprintf (num, sizeof (num), "{\"index\":%ld",
+                     batch.first + (long) i);
+      buf += num;
+      if (!batch.sources.empty())
+        {
+          buf += ",\"source\":";
+          append_json_string (buf, batch.sources[i]);
+        }
+      if (batch.valid[i])
+        {
+          const digit &d = batch.results[result++];
+          std::snprintf (num, sizeof (num),
+                         ",\"digit\":%u,\"probability\":%.6g}\n", d.value,
+                         d.probability);
+          buf += num;
+        }
+      else
+        {
+          buf += ",\"error\":\"" INVALID_IMAGE_MSG "\"}\n";
+          invalid++;
+        }
+    }
+  return invalid;
+}
+
+/**
+ * classify a stream of images through the read, infer and write stages
+ * @param in the input stream
+ * @param format the input format
+ * @param out the output stream
+ * @param mlp the network
+ * @return the stream counts
+ */
+StreamStats stream_classify (std::istream &in, StreamFormat format,
+                             std::ostream &out, const MlpNetwork &mlp)
+{
+  BoundedQueue<StreamBatch> loaded (STREAM_QUEUE_DEPTH);
+  BoundedQueue<StreamBatch> classified (STREAM_QUEUE_DEPTH);
+  std::thread reader (read_stage, std::ref (in), format, std::ref (loaded));
+  std::thread inferer (infer_stage, std::cref (mlp), std::ref (loaded),
+                       std::ref (classified));
+
+  // the write stage runs on the calling thread.
+  StreamStats stats = {0, 0};
+  StreamBatch batch;
+  std::string buf;
+  while (classified.pop (batch))
+    {
+      buf.clear();
+      stats.invalid += append_batch (buf, batch);
+      stats.images += (long) batch.valid.size();
+      out.write (buf.data(), (std::streamsize) buf.size());
+    }
+  out.flush();
+
+  reader.join();
+  inferer.join();
+  return stats;
+}
@@ -0,0 +1,52 @@
+// StreamPipeline.h
+
+#ifndef STREAMPIPELINE_H
+#define STREAMPIPELINE_H
+
+#include <iostream>
+
+#include "MlpNetwork.h"
+
+/**
+ * @enum StreamFormat
+ * @brief The input format of a classification stream.
+ */
+enum StreamFormat
+{
+    STREAM_PATHS,   // an image file path per line
+    STREAM_RAW      // back to back raw images, img_dims floats each
+};
+
+/**
+ * @struct StreamStats
+ * @brief The counts of a finished classification stream.
+ * @var images - the input images number, valid or not
+ * @var invalid - the images that could not be read
+ */
+struct StreamStats
+{
+    long images;
+    long invalid;
+};
+
+/**
+ * Classifies a stream of images through three pipeline stages, each on its
+ * own thread, joined by bounded queues:
+ *   read (files or raw records, in batches) -> infer (a batch matrix-matrix
+ *   product per layer) -> write (a JSON line per image)
+ * so the input, the compute and the output overlap. The output is buffered
+ * and written once per batch, the images are not rendered. Every line is
+ *   {"index":0,"source":"images/im0","digit":5,"probability":0.99}
+ * or, for an image that could not be read,
+ *   {"index":1,"source":"missing","error":"invalid image"}
+ * ("source" is given for paths input only).
+ * @param in the input stream
+ * @param format the input format
+ * @param out the output stream
+ * @param mlp the network
+ * @return the stream counts
+ */
+StreamStats stream_classify (std::istream &in, StreamFormat format,
+                             std::ostream &out, const MlpNetwork &mlp);
+
+#endif //STREAMPIPELINE_H
@@ -0,0 +1,125 @@
+#include "ThreadPool.h"
+
+/**
+ * the pool and the index of the calling thread, if it is a pool worker
+ */
+static thread_local const ThreadPool *current_pool = nullptr;
+static thread_local int current_index = -1;
+
+/**
+ * the ThreadPool constructor, starts the worker threads
+ * @param threads the workers number, at least 1
+ */
+ThreadPool::ThreadPool (int threads)
+    : _pending(0), _next_queue(0), _stop(false)
+{
+  if (threads < 1)
+    threads = 1;
+  for (int i = 0; i < threads; i++)
+    _queues.emplace_back (new WorkerQueue);
+  for (int i = 0; i < threads; i++)
+    _threads.emplace_back (&ThreadPool::run, this, i);
+}
+
+/**
+ * the ThreadPool destructor, runs the queued tasks and joins the workers
+ */
+ThreadPool::~ThreadPool ()
+{
+  {
+    std::lock_guard<std::mutex> guard (_sleep_lock);
+    _stop = true;
+  }
+  _wake.notify_all();
+  for (std::thread &thread : _threads)
+    thread.join();
+}
+
+/**
+ * @return the index of the calling worker thread in this pool, or -1
+ */
+int ThreadPool::current_worker () const
+{
+  return current_pool == this ? current_index : -1;
+}
+
+/**
+ * queue a task, and wake a sleeping worker
+ * @param task the task to run
+ */
+void ThreadPool::push (Task task)
+{
+  int index = current_worker();
+  if (index < 0)
+    index = (int) (_next_queue++ % _queues.size());
+  {
+    std::lock_guard<std::mutex> guard (_queues[index]->lock);
+    _queues[index]->tasks.push_back (std::move (task));
+  }
+  {
+    // counted under the sleep lock, so a worker going to sleep cannot miss
+    // the wake up.
+    std::lock_guard<std::mutex> guard (_sleep_lock);
+    _pending++;
+  }
+  _wake.notify_one();
+}
+
+/**
+ * take the next task of a worker: its own newest task, or else the oldest
+ * task of another worker
+ * @param index the worker index
+ * @param task set to the taken task
+ * @return whether a task was taken
+ */
+bool ThreadPool::pop (int index, Task &task)
+{
+  {
+    WorkerQueue &own = *_queues[index];
+    std::lock_guard<std::mutex> guard (own.lock);
+    if (!own.tasks.empty())
+      {
+        task = std::move (own.tasks.back());
+        own.tasks.pop_back();
+        _pending--;
+        return true;
+      }
+  }
+  for (std::size_t i = 1; i < _queues.size(); i++)
+    {
+      WorkerQueue &victim = *_queues[(index + i) % _queues.size()];
+      std::lock_guard<std::mutex> guard (victim.lock);
+      if (!victim.tasks.empty())
+        {
+          task = std::move (victim.tasks.front());
+          victim.tasks.pop_front();
+          _pending--;
+          return true;
+        }
+    }
+  return false;
+}
+
+/**
+ * the worker thread loop
+ * @param index the worker index
+ */
+void ThreadPool::run (int index)
+{
+  current_pool = this;
+  current_index = index;
+  Task task;
+  while (true)
+    {
+      if (pop (index, task))
+        {
+          task();
+          task = nullptr;
+          continue;
+        }
+      std::unique_lock<std::mutex> guard (_sleep_lock);
+      _wake.wait (guard, [this] () { return _stop || _pending > 0; });
+      if (_stop && _pending == 0)
+        return;
+    }
+}
@@ -0,0 +1,115 @@
+// ThreadPool.h
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * A fixed pool of worker threads with work-stealing queues.
+ * Every worker owns a task deque: it runs its own tasks from the back (the
+ * most recent first, while their data is still in cache), and once it runs
+ * out of work it steals from the front of the other workers' deques.
+ * Tasks submitted by a worker go to its own deque, tasks submitted from
+ * outside the pool are spread round-robin.
+ */
+class ThreadPool
+{
+  typedef std::function<void ()> Task;
+
+/**
+ * @struct WorkerQueue
+ * @brief The task deque of a worker, on its own cache line.
+ */
+  struct alignas(64) WorkerQueue
+  {
+    std::mutex lock;
+    std::deque<Task> tasks;
+  };
+
+  std::vector<std::unique_ptr<WorkerQueue>> _queues;
+  std::vector<std::thread> _threads;
+  std::mutex _sleep_lock;
+  std::condition_variable _wake;
+  std::atomic<long> _pending;
+  std::atomic<unsigned> _next_queue;
+  bool _stop;
+
+/**
+ * queue a task, and wake a sleeping worker
+ * @param task the task to run
+ */
+  void push (Task task);
+
+/**
+ * take the next task of a worker: its own newest task, or else the oldest
+ * task of another worker
+ * @param index the worker index
+ * @param task set to the taken task
+ * @return whether a task was taken
+ */
+  bool pop (int index, Task &task);
+
+/**
+ * the worker thread loop
+ * @param index the worker index
+ */
+  void run (int index);
+
+ public:
+/**
+ * the ThreadPool constructor, starts the worker threads
+ * @param threads the workers number, at least 1
+ */
+  explicit ThreadPool (int threads);
+
+/**
+ * the ThreadPool destructor, runs the queued tasks and joins the workers
+ */
+  ~ThreadPool ();
+
+  ThreadPool (const ThreadPool &) = delete;
+  ThreadPool &operator= (const ThreadPool &) = delete;
+
+/**
+ * @return the workers number
+ */
+  int size () const
+  {
+    return (int) _threads.size();
+  }
+
+/**
+ * @return the index of the calling worker thread in this pool, or -1 if the
+ *         caller is not one of its workers
+ */
+  int current_worker () const;
+
+/**
+ * run a callable on the pool
+ * @param f the callable, taking no arguments
+ * @return a future of the callable result
+ */
+  template <typename F>
+  std::future<typename std::invoke_result<F>::type> submit (F f)
+  {
+    typedef typename std::invoke_result<F>::type R;
+    // std::function needs a copyable callable, packaged_task is move-only.
+    std::shared_ptr<std::packaged_task<R ()>> task =
+        std::make_shared<std::packaged_task<R ()>> (std::move (f));
+    std::future<R> result = task->get_future();
+    push ([task] () { (*task)(); });
+    return result;
+  }
+};
+
+#endif //THREADPOOL_H
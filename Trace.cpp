@@ -0,0 +1,304 @@
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#define TRACE_MAX_EVENTS_PER_THREAD (1 << 20)
+#define NS_PER_US 1000.0
+#define NS_PER_MS 1000000.0
+
+std::atomic<bool> trace_on (false);
+
+/**
+ * @struct TraceTimer
+ * @brief The aggregate of a timer, in a single thread.
+ */
+struct TraceTimer
+{
+    std::string name;
+    long calls;
+    int64_t total_ns;
+    int64_t max_ns;
+};
+
+/**
+ * @struct TraceCounter
+ * @brief The total of a counter, in a single thread.
+ */
+struct TraceCounter
+{
+    std::string name;
+    long total;
+};
+
+/**
+ * @struct TraceEvent
+ * @brief A timed event, of a timer of the same thread.
+ */
+struct TraceEvent
+{
+    uint32_t timer;
+    int64_t start_ns;
+    int64_t duration_ns;
+};
+
+/**
+ * @struct ThreadTrace
+ * @brief The records of a single thread. Only its thread writes them; the
+ *        lock is contended by the exports only.
+ */
+struct ThreadTrace
+{
+    std::mutex lock;
+    int tid;
+    std::vector<TraceTimer> timers;
+    std::vector<TraceCounter> counters;
+    std::vector<TraceEvent> events;
+    long dropped_events;
+};
+
+/**
+ * the records of every thread that recorded, kept after the threads end
+ */
+static std::mutex registry_lock;
+static std::vector<std::shared_ptr<ThreadTrace>> registry;
+
+/**
+ * the steady clock origin of the timestamps
+ */
+static const std::chrono::steady_clock::time_point trace_epoch =
+    std::chrono::steady_clock::now();
+
+/**
+ * @return the records of the calling thread, registered on first use
+ */
+static ThreadTrace &this_thread_trace ()
+{
+  static thread_local std::shared_ptr<ThreadTrace> trace;
+  if (!trace)
+    {
+      trace = std::make_shared<ThreadTrace> ();
+      trace->dropped_events = 0;
+      std::lock_guard<std::mutex> guard (registry_lock);
+      trace->tid = (int) registry.size();
+      registry.push_back (trace);
+    }
+  return *trace;
+}
+
+/**
+ * find the entry of a name, or add it
+ * @param entries the timers or counters of a thread
+ * @param name the name
+ * @return the entry index
+ */
+template <typename Entry>
+static std::size_t find_entry (std::vector<Entry> &entries, const char *name)
+{
+  for (std::size_t i = 0; i < entries.size(); i++)
+    if (entries[i].name == name)
+      return i;
+  Entry entry = Entry();
+  entry.name = name;
+  entries.push_back (entry);
+  return entries.size() - 1;
+}
+
+/**
+ * turn the recording on or off, for all the threads
+ * @param on whether to record
+ */
+void trace_enable (bool on)
+{
+  trace_on.store (on);
+}
+
+/**
+ * @return nanoseconds since the process start, on a steady clock
+ */
+int64_t trace_now_ns ()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds> (
+      std::chrono::steady_clock::now() - trace_epoch).count();
+}
+
+/**
+ * record a timed event of the calling thread
+ * @param name the timer name
+ * @param start_ns the event start, from trace_now_ns()
+ * @param duration_ns the event duration
+ */
+void trace_record (const char *name, int64_t start_ns, int64_t duration_ns)
+{
+  ThreadTrace &trace = this_thread_trace();
+  std::lock_guard<std::mutex> guard (trace.lock);
+  std::size_t idx = find_entry (trace.timers, name);
+  TraceTimer &timer = trace.timers[idx];
+  timer.calls++;
+  timer.total_ns += duration_ns;
+  timer.max_ns = std::max (timer.max_ns, duration_ns);
+  // the aggregates stay exact once the events buffer is full.
+  if (trace.events.size() < TRACE_MAX_EVENTS_PER_THREAD)
+    trace.events.push_back ({(uint32_t) idx, start_ns, duration_ns});
+  else
+    trace.dropped_events++;
+}
+
+/**
+ * add to a counter of the calling thread (when the recording is on)
+ * @param name the counter name
+ * @param n the amount to add
+ */
+void trace_count (const char *name, long n)
+{
+  if (!trace_on.load (std::memory_order_relaxed))
+    return;
+  ThreadTrace &trace = this_thread_trace();
+  std::lock_guard<std::mutex> guard (trace.lock);
+  trace.counters[find_entry (trace.counters, name)].total += n;
+}
+
+/**
+ * @return a copy of the registered thread records list
+ */
+static std::vector<std::shared_ptr<ThreadTrace>> all_threads ()
+{
+  std::lock_guard<std::mutex> guard (registry_lock);
+  return registry;
+}
+
+/**
+ * append a JSON string literal to a stream
+ */
+static void write_json_string (std::ostream &os, const std::string &str)
+{
+  os << '"';
+  for (char c : str)
+    {
+      if (c == '"' || c == '\\')
+        os << '\\';
+      os << c;
+    }
+  os << '"';
+}
+
+/**
+ * write the recorded events and counters of all the threads as Chrome
+ * trace-event JSON
+ * @param path the output path
+ * @return false if the file could not be written
+ */
+bool trace_write_chrome (const std::string &path)
+{
+  std::ofstream os (path);
+  if (!os.is_open())
+    return false;
+
+  char num[64];
+  const char *sep = "\n";
+  int64_t end_ns = trace_now_ns();
+  os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  for (const std::shared_ptr<ThreadTrace> &trace : all_threads())
+    {
+      std::lock_guard<std::mutex> guard (trace->lock);
+      os << sep << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+         << "\"tid\":" << trace->tid << ",\"args\":{\"name\":\"thread "
+         << trace->tid << "\"}}";
+      sep = ",\n";
+      for (const TraceEvent &e : trace->events)
+        {
+          os << sep << "{\"name\":";
+          write_json_string (os, trace->timers[e.timer].name);
+          std::snprintf (num, sizeof (num), "%.3f,\"dur\":%.3f",
+                         e.start_ns / NS_PER_US, e.duration_ns / NS_PER_US);
+          os << ",\"cat\":\"mlp\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+             << trace->tid << ",\"ts\":" << num << "}";
+        }
+      // a counter is shown by its final value, at the end of the trace.
+      for (const TraceCounter &c : trace->counters)
+        {
+          std::snprintf (num, sizeof (num), "%.3f", end_ns / NS_PER_US);
+          os << sep << "{\"name\":";
+          write_json_string (os, c.name);
+          os << ",\"cat\":\"mlp\",\"ph\":\"C\",\"pid\":1,\"tid\":"
+             << trace->tid << ",\"ts\":" << num << ",\"args\":{\"value\":"
+             << c.total << "}}";
+        }
+    }
+  os << "\n]}\n";
+  return (bool) os;
+}
+
+/**
+ * print a summary table of the timers and of the counters
+ * @param os the output stream
+ */
+void trace_print_summary (std::ostream &os)
+{
+  std::vector<TraceTimer> timers;
+  std::vector<int> timer_threads;
+  std::vector<TraceCounter> counters;
+  long dropped = 0;
+  for (const std::shared_ptr<ThreadTrace> &trace : all_threads())
+    {
+      std::lock_guard<std::mutex> guard (trace->lock);
+      dropped += trace->dropped_events;
+      for (const TraceTimer &t : trace->timers)
+        {
+          std::size_t i = find_entry (timers, t.name.c_str());
+          if (i == timer_threads.size())
+            timer_threads.push_back (0);
+          timers[i].calls += t.calls;
+          timers[i].total_ns += t.total_ns;
+          timers[i].max_ns = std::max (timers[i].max_ns, t.max_ns);
+          timer_threads[i]++;
+        }
+      for (const TraceCounter &c : trace->counters)
+        counters[find_entry (counters, c.name.c_str())].total += c.total;
+    }
+
+  std::vector<std::size_t> order (timers.size());
+  for (std::size_t i = 0; i < order.size(); i++)
+    order[i] = i;
+  std::sort (order.begin(), order.end(), [&timers] (std::size_t a,
+                                                    std::size_t b) {
+      return timers[a].total_ns > timers[b].total_ns;
+  });
+
+  char line[160];
+  std::snprintf (line, sizeof (line), "%-24s %10s %12s %12s %12s %8s\n",
+                 "timer", "calls", "total ms", "mean us", "max us",
+                 "threads");
+  os << line;
+  for (std::size_t i : order)
+    {
+      const TraceTimer &t = timers[i];
+      std::snprintf (line, sizeof (line),
+                     "%-24s %10ld %12.3f %12.3f %12.3f %8d\n",
+                     t.name.c_str(), t.calls, t.total_ns / NS_PER_MS,
+                     t.total_ns / NS_PER_US / (double) t.calls,
+                     t.max_ns / NS_PER_US, timer_threads[i]);
+      os << line;
+    }
+  if (!counters.empty())
+    {
+      std::snprintf (line, sizeof (line), "%-24s %10s\n", "counter",
+                     "total");
+      os << line;
+    }
+  for (const TraceCounter &c : counters)
+    {
+      std::snprintf (line, sizeof (line), "%-24s %10ld\n", c.name.c_str(),
+                     c.total);
+      os << line;
+    }
+  if (dropped > 0)
+    os << "(" << dropped << " events beyond the buffers are in the "
+       << "totals only)" << std::endl;
+}
@@ -0,0 +1,115 @@
+// Trace.h
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+/**
+ * Low overhead instrumentation: scoped timers and counters.
+ *
+ *   TRACE_SCOPE("read_image");     // times the rest of the enclosing block
+ *   TRACE_COUNT("images", n);      // adds n to a counter
+ *
+ * Every thread aggregates its own timers and counters (and keeps the timed
+ * events), so recording takes no shared lock. Nothing is recorded until
+ * trace_enable() is called - a disabled scope costs a relaxed atomic load.
+ * Building with -DMLP_NO_TRACE removes the instrumentation entirely: the
+ * macros expand to nothing, and their arguments are not evaluated.
+ *
+ * The names are copied on their first record, so any string lives long
+ * enough.
+ */
+
+#ifndef MLP_NO_TRACE
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) \
+    TraceScope TRACE_CONCAT(trace_scope_, __LINE__) (name)
+#define TRACE_COUNT(name, n) trace_count (name, n)
+#else
+#define TRACE_SCOPE(name) ((void) 0)
+#define TRACE_COUNT(name, n) ((void) 0)
+#endif
+
+/**
+ * whether the recording is on
+ */
+extern std::atomic<bool> trace_on;
+
+/**
+ * turn the recording on or off, for all the threads
+ * @param on whether to record
+ */
+void trace_enable (bool on);
+
+/**
+ * @return nanoseconds since the process start, on a steady clock
+ */
+int64_t trace_now_ns ();
+
+/**
+ * record a timed event of the calling thread
+ * @param name the timer name
+ * @param start_ns the event start, from trace_now_ns()
+ * @param duration_ns the event duration
+ */
+void trace_record (const char *name, int64_t start_ns, int64_t duration_ns);
+
+/**
+ * add to a counter of the calling thread (when the recording is on)
+ * @param name the counter name
+ * @param n the amount to add
+ */
+void trace_count (const char *name, long n);
+
+/**
+ * write the recorded events and counters of all the threads as Chrome
+ * trace-event JSON (chrome://tracing, Perfetto)
+ * @param path the output path
+ * @return false if the file could not be written
+ */
+bool trace_write_chrome (const std::string &path);
+
+/**
+ * print a summary table of the timers (merged over the threads: calls,
+ * total, mean and max time) and of the counters
+ * @param os the output stream
+ */
+void trace_print_summary (std::ostream &os);
+
+/**
+ * Times its own lifetime into a timer of the calling thread.
+ */
+class TraceScope
+{
+  const char *_name;
+  int64_t _start;
+
+ public:
+/**
+ * the TraceScope constructor, starts timing if the recording is on
+ * @param name the timer name
+ */
+  explicit TraceScope (const char *name)
+      : _name(name),
+        _start(trace_on.load (std::memory_order_relaxed) ? trace_now_ns ()
+                                                         : -1) {}
+
+/**
+ * the TraceScope destructor, records the timed event
+ */
+  ~TraceScope ()
+  {
+    if (_start >= 0)
+      trace_record (_name, _start, trace_now_ns () - _start);
+  }
+
+  TraceScope (const TraceScope &oth) = delete;
+  TraceScope &operator= (const TraceScope &rhs) = delete;
+};
+
+#endif //TRACE_H
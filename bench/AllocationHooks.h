@@ -0,0 +1,66 @@
+// AllocationHooks.h - replaces the global operator new/delete of a program
+// with ones that count the allocations. Include it from a single
+// translation unit of the program.
+
+#ifndef ALLOCATIONHOOKS_H
+#define ALLOCATIONHOOKS_H
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+/**
+ * The allocations counter: every global operator new of the process.
+ */
+static std::atomic<long> allocations(0);
+
+void *operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = std::malloc(size ? size : 1);
+    if(p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+// kept out of line, so the compiler does not pair an inlined free() with
+// the allocation of a "new" expression (a false -Wmismatched-new-delete).
+__attribute__((noinline)) void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+__attribute__((noinline)) void operator delete(void *p, std::size_t) noexcept
+{
+    operator delete(p);
+}
+
+// the aligned forms, of the Matrix storages (MatrixAllocator.h).
+void *operator new(std::size_t size, std::align_val_t align)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    std::size_t alignment = (std::size_t) align;
+    size = (size + alignment - 1) / alignment * alignment;
+    void *p = std::aligned_alloc(alignment, size ? size : alignment);
+    if(p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+__attribute__((noinline)) void operator delete(void *p,
+                                               std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+__attribute__((noinline)) void operator delete(void *p, std::size_t,
+                                               std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+#endif //ALLOCATIONHOOKS_H
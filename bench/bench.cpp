@@ -0,0 +1,482 @@
+// bench.cpp - micro and macro benchmarks of the network building blocks.
+// Run from the repository root (reads parameters/ and images/).
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Matrix.h"
+#include "Activation.h"
+#include "Dense.h"
+#include "MlpNetwork.h"
+#include "ImageFile.h"
+#include "ParameterFile.h"
+#include "ImageDecoder.h"
+#include "ResultCache.h"
+#include "Kernels.h"
+#include "StaticMlp.h"
+#include "AllocationHooks.h"
+
+#define USAGE_MSG "Usage:\n" \
+                  "\t./mlpbench [--json out.json] [--min-time seconds]\n" \
+                  "\tout.json - where to write the results as JSON\n" \
+                  "\tseconds - the time of every benchmark (default 0.2)"
+#define ERROR_INVALID_IMG "Error: invalid image path or size: "
+#define ERROR_WRITE_JSON "Error: failed to write: "
+
+#define PARAMS_DIR "parameters"
+#define IMAGES_DIR "images/"
+#define IMAGES_NUM 10
+#define BATCH_COLS 64
+#define CACHE_ENTRIES 1024
+#define CASCADE_RANK 16
+#define CASCADE_THRESHOLD 0.9f
+#define DEFAULT_MIN_SECONDS 0.2
+#define MIN_SAMPLE_NS 20000.0
+#define END_TO_END_BENCH "mlp_network/images"
+#define JSON_FLAG "--json"
+#define MIN_TIME_FLAG "--min-time"
+
+/**
+ * Keeps the compiler from dropping a computation whose result is unused.
+ * @param p the result
+ */
+static inline void keep(const void *p)
+{
+    asm volatile("" : : "g"(p) : "memory");
+}
+
+/**
+ * @struct BenchResult
+ * @brief The measures of a single benchmark.
+ */
+struct BenchResult
+{
+    std::string name;
+    long ops;
+    double nsPerOp;
+    double p50Ns, p90Ns, p99Ns;
+    double opsPerSec;
+    double allocsPerOp;
+};
+
+/**
+ * A percentile of sorted values.
+ * @param sorted the values, ascending
+ * @param p the percentile, in [0, 1]
+ * @return the value
+ */
+double percentile(const std::vector<double> &sorted, double p)
+{
+    return sorted[(std::size_t) (p * (double) (sorted.size() - 1) + 0.5)];
+}
+
+/**
+ * Runs an operation over and over for at least minSeconds.
+ * The operation is timed in samples, each of enough repetitions to last
+ * MIN_SAMPLE_NS (or of a single repetition when it lasts longer). The
+ * percentiles are of the per-op time of the samples.
+ * @param name the benchmark name
+ * @param op the operation
+ * @param minSeconds the measuring time
+ * @return the measures
+ */
+BenchResult runBench(const std::string &name, const std::function<void ()> &op,
+    double minSeconds)
+{
+    typedef std::chrono::steady_clock Clock;
+    // warm up the caches and the workspaces, and size the samples.
+    long reps = 1;
+    while(true)
+    {
+        Clock::time_point start = Clock::now();
+        for(long i = 0; i < reps; i++)
+        {
+            op();
+        }
+        double ns = std::chrono::duration<double, std::nano>(
+            Clock::now() - start).count();
+        if(ns >= MIN_SAMPLE_NS)
+        {
+            break;
+        }
+        reps *= 2;
+    }
+
+    std::vector<double> samples;
+    long ops = 0;
+    long allocs = 0;
+    Clock::time_point begin = Clock::now();
+    double totalNs = 0;
+    while(totalNs < minSeconds * 1e9)
+    {
+        // counted around the operations only, not the samples bookkeeping.
+        long allocsBefore = allocations.load();
+        Clock::time_point start = Clock::now();
+        for(long i = 0; i < reps; i++)
+        {
+            op();
+        }
+        Clock::time_point end = Clock::now();
+        allocs += allocations.load() - allocsBefore;
+        samples.push_back(std::chrono::duration<double, std::nano>(
+            end - start).count() / (double) reps);
+        ops += reps;
+        totalNs = std::chrono::duration<double, std::nano>(end - begin)
+            .count();
+    }
+
+    std::sort(samples.begin(), samples.end());
+    BenchResult result;
+    result.name = name;
+    result.ops = ops;
+    result.nsPerOp = totalNs / (double) ops;
+    result.p50Ns = percentile(samples, 0.50);
+    result.p90Ns = percentile(samples, 0.90);
+    result.p99Ns = percentile(samples, 0.99);
+    result.opsPerSec = 1e9 / result.nsPerOp;
+    result.allocsPerOp = (double) allocs / (double) ops;
+    return result;
+}
+
+/**
+ * Loads images/im0..im9 as input vectors.
+ * Exits (code == 1) upon failures.
+ * @return the images
+ */
+std::vector<Matrix> loadImages()
+{
+    std::vector<Matrix> images;
+    for(int i = 0; i < IMAGES_NUM; i++)
+    {
+        std::string path = IMAGES_DIR "im" + std::to_string(i);
+        Matrix img(img_dims.rows * img_dims.cols, 1);
+        if(!readFileToMatrix(path, img))
+        {
+            std::cerr << ERROR_INVALID_IMG << path << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        images.push_back(img);
+    }
+    return images;
+}
+
+/**
+ * A matrix of the given shape with deterministic values in [-1, 1].
+ */
+Matrix filledMatrix(int rows, int cols)
+{
+    Matrix m(rows, cols);
+    for(int i = 0; i < rows * cols; i++)
+    {
+        m[i] = (float) ((i * 7919) % 2001 - 1000) / 1000.0f;
+    }
+    return m;
+}
+
+/**
+ * Runs all the benchmarks.
+ * @param minSeconds the measuring time of every benchmark
+ * @return the measures, in run order
+ */
+std::vector<BenchResult> runAll(double minSeconds)
+{
+    SharedMatrix weights[MLP_SIZE];
+    SharedMatrix biases[MLP_SIZE];
+    loadParameterFiles(PARAMS_DIR, weights, biases);
+    std::vector<Matrix> images = loadImages();
+    MlpNetwork mlp(weights, biases);
+    std::vector<BenchResult> results;
+
+    for(int l = 0; l < MLP_SIZE; l++)
+    {
+        const Matrix &w = *weights[l];
+        std::string shape = std::to_string(w.get_rows()) + "x" +
+                            std::to_string(w.get_cols());
+        Matrix vec = filledMatrix(w.get_cols(), 1);
+        Matrix batch = filledMatrix(w.get_cols(), BATCH_COLS);
+        Matrix other = filledMatrix(w.get_rows(), w.get_cols());
+        Matrix acc = w;
+        Matrix trans = w;
+
+        results.push_back(runBench("matrix_mul_vec/" + shape, [&]()
+        {
+            Matrix r = w * vec;
+            keep(r.data());
+        }, minSeconds));
+        results.push_back(runBench("matrix_mul_batch" +
+                                   std::to_string(BATCH_COLS) + "/" + shape,
+                                   [&]()
+        {
+            Matrix r = w * batch;
+            keep(r.data());
+        }, minSeconds));
+        results.push_back(runBench("matrix_dot/" + shape, [&]()
+        {
+            Matrix r = w.dot(other);
+            keep(r.data());
+        }, minSeconds));
+        results.push_back(runBench("matrix_transpose/" + shape, [&]()
+        {
+            trans.transpose();
+            keep(trans.data());
+        }, minSeconds));
+        results.push_back(runBench("matrix_norm/" + shape, [&]()
+        {
+            float n = w.norm();
+            keep(&n);
+        }, minSeconds));
+        results.push_back(runBench("matrix_add_assign/" + shape, [&]()
+        {
+            acc += other;
+            keep(acc.data());
+        }, minSeconds));
+    }
+
+    Matrix in = images[0];
+    for(int l = 0; l < MLP_SIZE; l++)
+    {
+        const Dense &layer = mlp.get_layers()[l];
+        std::string name = "layer" + std::to_string(l + 1);
+        Matrix out;
+        results.push_back(runBench("dense/" + name, [&]()
+        {
+            Matrix r = layer(in);
+            keep(r.data());
+        }, minSeconds));
+        results.push_back(runBench("dense_forward/" + name, [&]()
+        {
+            layer.forward(in, out);
+            keep(out.data());
+        }, minSeconds));
+        layer.forward(in, out);
+        in = out;
+    }
+
+    Activation relu(RELU);
+    Activation softmax(SOFTMAX);
+    Matrix hidden = filledMatrix(weights_dims[0].rows, 1);
+    Matrix logits = filledMatrix(weights_dims[MLP_SIZE - 1].rows, 1);
+    Matrix scratch;
+    results.push_back(runBench("activation_relu/" +
+                               std::to_string(hidden.get_rows()), [&]()
+    {
+        Matrix r = relu(hidden);
+        keep(r.data());
+    }, minSeconds));
+    results.push_back(runBench("activation_relu_inplace/" +
+                               std::to_string(hidden.get_rows()), [&]()
+    {
+        scratch = hidden;
+        relu.apply_inplace(scratch);
+        keep(scratch.data());
+    }, minSeconds));
+    results.push_back(runBench("activation_softmax/" +
+                               std::to_string(logits.get_rows()), [&]()
+    {
+        Matrix r = softmax(logits);
+        keep(r.data());
+    }, minSeconds));
+
+    for(int side : {img_dims.rows, 4 * img_dims.rows})
+    {
+        std::string header = "P5\n" + std::to_string(side) + " " +
+            std::to_string(side) + "\n255\n";
+        std::vector<uint8_t> pgm(header.begin(), header.end());
+        for(int i = 0; i < side * side; i++)
+        {
+            pgm.push_back((uint8_t) ((i * 7919) % 256));
+        }
+        Matrix img(img_dims.rows, img_dims.cols);
+        results.push_back(runBench("image_decode_pgm/" +
+                                   std::to_string(side) + "x" +
+                                   std::to_string(side), [&]()
+        {
+            GrayImage gray;
+            decode_pgm(pgm.data(), pgm.size(), gray);
+            normalize_resize(gray, img.data(), img_dims.rows,
+                             img_dims.cols);
+            keep(img.data());
+        }, minSeconds));
+    }
+
+    std::size_t next = 0;
+    results.push_back(runBench(END_TO_END_BENCH, [&]()
+    {
+        digit d = mlp(images[next]);
+        keep(&d);
+        next = (next + 1) % images.size();
+    }, minSeconds));
+    next = 0;
+    results.push_back(runBench("mlp_classify/images", [&]()
+    {
+        unsigned int value = mlp.classify(images[next]);
+        keep(&value);
+        next = (next + 1) % images.size();
+    }, minSeconds));
+    next = 0;
+    results.push_back(runBench("mlp_top3/images", [&]()
+    {
+        std::vector<digit> ranked = mlp.top_k(images[next], 3);
+        keep(ranked.data());
+        next = (next + 1) % images.size();
+    }, minSeconds));
+
+    // repeated images, answered by the result cache after the first pass.
+    MlpNetwork cachedMlp = mlp;
+    cachedMlp.set_result_cache(std::make_shared<ResultCache>(CACHE_ENTRIES));
+    next = 0;
+    results.push_back(runBench("mlp_cached/images", [&]()
+    {
+        digit d = cachedMlp(images[next]);
+        keep(&d);
+        next = (next + 1) % images.size();
+    }, minSeconds));
+
+    // a rank-approximated pass first, the network on its unsure images.
+    MlpNetwork cascadeMlp = mlp;
+    cascadeMlp.set_cascade(mlp.low_rank(CASCADE_RANK), CASCADE_THRESHOLD);
+    next = 0;
+    results.push_back(runBench("mlp_cascade/images", [&]()
+    {
+        digit d = cascadeMlp(images[next]);
+        keep(&d);
+        next = (next + 1) % images.size();
+    }, minSeconds));
+
+    // the same network, of a compile-time topology.
+    DigitStaticMlp staticMlp(weights, biases);
+    std::vector<FixedMatrix<DigitStaticMlp::input_size, 1>> fixedImages(
+        images.size());
+    for(std::size_t i = 0; i < images.size(); i++)
+    {
+        fixedImages[i].assign(images[i]);
+    }
+    next = 0;
+    results.push_back(runBench("static_mlp/images", [&]()
+    {
+        digit d = staticMlp(fixedImages[next]);
+        keep(&d);
+        next = (next + 1) % fixedImages.size();
+    }, minSeconds));
+    return results;
+}
+
+/**
+ * @param results the measures
+ * @return the end-to-end network throughput, in images per second
+ */
+double imagesPerSec(const std::vector<BenchResult> &results)
+{
+    for(const BenchResult &r : results)
+    {
+        if(r.name == END_TO_END_BENCH)
+        {
+            return r.opsPerSec;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Prints the measures as a table.
+ * @param results the measures
+ */
+void printTable(const std::vector<BenchResult> &results)
+{
+    std::printf("%-32s %12s %12s %12s %12s %14s %10s\n", "benchmark",
+                "ns/op", "p50 ns", "p90 ns", "p99 ns", "ops/sec",
+                "allocs/op");
+    for(const BenchResult &r : results)
+    {
+        std::printf("%-32s %12.1f %12.1f %12.1f %12.1f %14.0f %10.2f\n",
+                    r.name.c_str(), r.nsPerOp, r.p50Ns, r.p90Ns, r.p99Ns,
+                    r.opsPerSec, r.allocsPerOp);
+    }
+    std::printf("images/sec: %.0f\n", imagesPerSec(results));
+}
+
+/**
+ * Writes the measures as JSON.
+ * Exits (code == 1) if the file can not be written.
+ * @param path the output path
+ * @param results the measures
+ */
+void writeJson(const std::string &path,
+    const std::vector<BenchResult> &results)
+{
+    std::ofstream os(path);
+    if(!os.is_open())
+    {
+        std::cerr << ERROR_WRITE_JSON << path << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    char line[512];
+    std::snprintf(line, sizeof(line), "%.3f", imagesPerSec(results));
+    os << "{\n  \"isa\": \"" << kernels_isa() << "\",\n"
+       << "  \"images_per_sec\": " << line << ",\n"
+       << "  \"benchmarks\": [\n";
+    for(std::size_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult &r = results[i];
+        std::snprintf(line, sizeof(line),
+                      "    {\"name\": \"%s\", \"ops\": %ld, "
+                      "\"ns_per_op\": %.3f, \"p50_ns\": %.3f, "
+                      "\"p90_ns\": %.3f, \"p99_ns\": %.3f, "
+                      "\"ops_per_sec\": %.3f, \"allocs_per_op\": %.4f}%s\n",
+                      r.name.c_str(), r.ops, r.nsPerOp, r.p50Ns, r.p90Ns,
+                      r.p99Ns, r.opsPerSec, r.allocsPerOp,
+                      i + 1 < results.size() ? "," : "");
+        os << line;
+    }
+    os << "  ]\n}\n";
+    if(!os)
+    {
+        std::cerr << ERROR_WRITE_JSON << path << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Benchmarks main
+ * @param argc count of args
+ * @param argv args values
+ * @return program exit status code
+ */
+int main(int argc, char **argv)
+{
+    std::string jsonPath;
+    double minSeconds = DEFAULT_MIN_SECONDS;
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg(argv[i]);
+        if(arg == JSON_FLAG && i + 1 < argc)
+        {
+            jsonPath = argv[++i];
+        }
+        else if(arg == MIN_TIME_FLAG && i + 1 < argc)
+        {
+            minSeconds = std::atof(argv[++i]);
+        }
+        else
+        {
+            std::cout << USAGE_MSG << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<BenchResult> results = runAll(minSeconds);
+    std::printf("isa: %s\n", kernels_isa());
+    printTable(results);
+    if(!jsonPath.empty())
+    {
+        writeJson(jsonPath, results);
+    }
+    return EXIT_SUCCESS;
+}
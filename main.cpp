@@ -1,19 +1,104 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
 #include <fstream>
+#include <functional>
+#include <iomanip>
+#include <thread>
 
 #include "Matrix.h"
 #include "Activation.h"
 #include "Dense.h"
 #include "MlpNetwork.h"
+#include "MappedFile.h"
+#include "ModelFile.h"
+#include "QuantizedMlp.h"
+#include "ImageFile.h"
+#include "InferenceEngine.h"
+#include "StreamPipeline.h"
+#include "IdxDataset.h"
+#include "InferenceServer.h"
+#include "InferenceClient.h"
+#include "ResultCache.h"
+#include "Trace.h"
 
 #define QUIT "q"
 #define INSERT_IMAGE_PATH "Please insert image path:"
 #define ERROR_INAVLID_PARAMETER "Error: invalid Parameters file for layer: "
 #define ERROR_INVALID_INPUT "Error: Failed to retrieve input. Exiting.."
 #define ERROR_INVALID_IMG "Error: invalid image path or size: "
+#define ERROR_INVALID_MODEL "Error: invalid model file: "
+#define ERROR_INVALID_TOPOLOGY "Error: invalid model topology: "
+#define ERROR_WRITE_MODEL "Error: failed to write model file: "
+#define MODEL_WRITTEN "Model written to: "
 #define USAGE_MSG "Usage:\n" \
-                  "\t./mlpnetwork w1 w2 w3 w4 b1 b2 b3 b4\n" \
+                  "\t./mlpnetwork [--weights fp16|bf16] " \
+                  "w1 w2 w3 w4 b1 b2 b3 b4\n" \
+                  "\t./mlpnetwork [--weights fp16|bf16] model\n" \
+                  "\t./mlpnetwork --pack model w1 .. wN b1 .. bN\n" \
+                  "\t./mlpnetwork --int8 model images_dir\n" \
+                  "\t./mlpnetwork --int8-report model images_dir\n" \
+                  "\t./mlpnetwork --scaling model images_dir\n" \
+                  "\t./mlpnetwork [--weights fp16|bf16] --stream model " \
+                  "[paths_file]\n" \
+                  "\t./mlpnetwork [--weights fp16|bf16] --stream-raw model " \
+                  "[records_file]\n" \
+                  "\t./mlpnetwork [--weights fp16|bf16] --serve model " \
+                  "socket [max_batch max_delay_us]\n" \
+                  "\t./mlpnetwork --client socket images_dir connections\n" \
+                  "\t./mlpnetwork [--weights fp16|bf16] --eval model " \
+                  "images_idx labels_idx\n" \
+                  "\t./mlpnetwork [--weights fp16|bf16] --cascade-report " \
+                  "model images_dir\n" \
                   "\twi - the i'th layer's weights\n" \
-                  "\tbi - the i'th layer's biases"
+                  "\tbi - the i'th layer's biases\n" \
+                  "\tmodel - a packed model file, written by --pack\n" \
+                  "\timages_dir - images to calibrate the int8 network by, " \
+                  "or to measure by\n" \
+                  "\tpaths_file - image paths, a path per line (default: " \
+                  "stdin)\n" \
+                  "\trecords_file - raw images, back to back (default: " \
+                  "stdin)\n" \
+                  "\tsocket - the server Unix domain socket path\n" \
+                  "\timages_idx, labels_idx - IDX (MNIST format) images " \
+                  "and their labels\n" \
+                  "\t--weights - store the weights in half precision\n" \
+                  "\t--trace out.json - may precede any form: record the " \
+                  "timings, and at\n" \
+                  "\t\texit write them to out.json (Chrome trace-event " \
+                  "format) and\n" \
+                  "\t\ta summary to stderr\n" \
+                  "\t--cache entries - may precede any form: answer " \
+                  "repeated images from a\n" \
+                  "\t\tcache of the last entries results, and at exit " \
+                  "print its counters\n" \
+                  "\t\tto stderr\n" \
+                  "\t--cascade threshold[:rank] - may precede any form: " \
+                  "classify by the network\n" \
+                  "\t\tof a rank-approximated first layer (default rank " \
+                  "16) first, and by\n" \
+                  "\t\tthe full network only below the threshold " \
+                  "probability, and at exit\n" \
+                  "\t\tprint the escalated fraction to stderr"
+#define ERROR_INVALID_STREAM "Error: failed to open input file: "
+#define ERROR_INVALID_COUNT "Error: invalid count, must be a positive " \
+                            "integer: "
+#define ERROR_SERVER_LISTEN "Error: failed to listen on socket: "
+#define ERROR_SERVER_CONNECT "Error: failed to reach the server at: "
+#define ERROR_WRITE_TRACE "Error: failed to write trace file: "
+#define ERROR_NO_IMAGES "Error: no valid images in: "
+#define ERROR_INVALID_IDX "Error: invalid IDX file: "
+#define ERROR_EVAL_MISMATCH "Error: the IDX images must match the network " \
+                            "input size, a label per image."
+#define ERROR_INVALID_CASCADE "Error: invalid cascade, must be " \
+                              "threshold[:rank], a threshold in [0, 1]: "
+#define ERROR_INVALID_PRECISION "Error: invalid weights precision, must be " \
+                                "fp16/bf16: "
 
 
 #define ARGS_START_IDX 1
@@ -21,6 +106,67 @@
 #define WEIGHTS_START_IDX ARGS_START_IDX
 #define BIAS_START_IDX (ARGS_START_IDX + MLP_SIZE)
 
+#define MODEL_ARGS_COUNT (ARGS_START_IDX + 1)
+#define PACK_FLAG "--pack"
+#define PACK_ARGS_SHIFT 2
+#define PACK_PATHS_IDX (PACK_ARGS_SHIFT + 1)
+#define WEIGHTS_TENSOR_PREFIX "w"
+#define BIAS_TENSOR_PREFIX "b"
+#define TOPOLOGY_TENSOR "topology"
+#define TOPOLOGY_COLS 3
+#define TOPOLOGY_INPUTS_COL 0
+#define TOPOLOGY_OUTPUTS_COL 1
+#define TOPOLOGY_ACTIVATION_COL 2
+#define DIGITS_NUM 10
+
+#define MODE_FLAG_IDX ARGS_START_IDX
+#define MODE_MODEL_IDX (MODE_FLAG_IDX + 1)
+#define MODE_DIR_IDX (MODE_MODEL_IDX + 1)
+#define MODE_DIR_ARGS_COUNT (MODE_DIR_IDX + 1)
+#define INT8_FLAG "--int8"
+#define INT8_REPORT_FLAG "--int8-report"
+#define THROUGHPUT_MIN_SECONDS 0.5
+#define SCALING_FLAG "--scaling"
+#define STREAM_FLAG "--stream"
+#define STREAM_RAW_FLAG "--stream-raw"
+#define STREAM_FILE_IDX MODE_DIR_IDX
+#define SERVE_FLAG "--serve"
+#define SERVE_SOCKET_IDX MODE_DIR_IDX
+#define SERVE_MAX_BATCH_IDX (SERVE_SOCKET_IDX + 1)
+#define SERVE_MAX_DELAY_IDX (SERVE_MAX_BATCH_IDX + 1)
+#define SERVE_ARGS_COUNT (SERVE_SOCKET_IDX + 1)
+#define SERVE_BATCH_ARGS_COUNT (SERVE_MAX_DELAY_IDX + 1)
+#define SERVE_DEFAULT_MAX_BATCH 32
+#define SERVE_DEFAULT_MAX_DELAY_US 200
+#define EVAL_FLAG "--eval"
+#define EVAL_IMAGES_IDX MODE_DIR_IDX
+#define EVAL_LABELS_IDX (EVAL_IMAGES_IDX + 1)
+#define EVAL_ARGS_COUNT (EVAL_LABELS_IDX + 1)
+#define CLIENT_FLAG "--client"
+#define CLIENT_SOCKET_IDX (MODE_FLAG_IDX + 1)
+#define CLIENT_DIR_IDX (CLIENT_SOCKET_IDX + 1)
+#define CLIENT_CONNECTIONS_IDX (CLIENT_DIR_IDX + 1)
+#define CLIENT_ARGS_COUNT (CLIENT_CONNECTIONS_IDX + 1)
+#define WEIGHTS_FLAG "--weights"
+#define TRACE_FLAG "--trace"
+#define CACHE_FLAG "--cache"
+#define CASCADE_FLAG "--cascade"
+#define CASCADE_REPORT_FLAG "--cascade-report"
+#define CASCADE_DEFAULT_RANK 16
+#define OPTION_ARGS 2
+#define PRECISION_F16_NAME "fp16"
+#define PRECISION_BF16_NAME "bf16"
+
+/**
+ * A digit classifier: a network evaluation on a single image.
+ */
+typedef std::function<digit (const Matrix &)> Classifier;
+
+/**
+ * A batch classifier: classifies all the given images.
+ */
+typedef std::function<void (const std::vector<Matrix> &)> BatchClassifier;
+
 
 
 
@@ -33,67 +179,215 @@ void usage()
 }
 
 /**
- * Given a binary file path and a matrix,
- * reads the content of the file into the matrix.
- * file must match matrix in size in order to read successfully.
- * @param filePath - path of the binary file to read
- * @param mat -  matrix to read the file into.
- * @return boolean status
- *          true - success
- *          false - failure
+ * Loads MLP parameters from weights & biases paths
+ * to Weights[] and Biases[].
+ * The files are memory mapped read-only, the matrices point straight into
+ * the mappings - nothing is copied, and the pages are shared with any other
+ * process mapping the same files.
+ * Exits (code == 1) upon failures.
+ * @param paths array of programs arguments, expected to be mlp parameters
+ *        path.
+ * @param weights array of matrix, weigths[i] is the i'th layer weights matrix
+ * @param biases array of matrix, biases[i] is the i'th layer bias matrix
+ *          (which is actually a vector)
  */
-bool readFileToMatrix(const std::string &filePath, Matrix &mat)
+void loadParameters(char *paths[ARGS_COUNT], SharedMatrix weights[MLP_SIZE],
+    SharedMatrix biases[MLP_SIZE])
 {
-    std::ifstream is;
-    is.open(filePath, std::ios::in | std::ios::binary | std::ios::ate);
-    if(!is.is_open())
+    TRACE_SCOPE("load_parameters");
+    for(int i = 0; i < MLP_SIZE; i++)
     {
-        return false;
+        std::string weightsPath(paths[WEIGHTS_START_IDX + i]);
+        std::string biasPath(paths[BIAS_START_IDX + i]);
+
+        weights[i] = map_matrix_file(weightsPath, weights_dims[i].rows,
+                                     weights_dims[i].cols);
+        biases[i] = map_matrix_file(biasPath, bias_dims[i].rows,
+                                    bias_dims[i].cols);
+        if(!(weights[i] && biases[i]))
+        {
+            std::cerr << ERROR_INAVLID_PARAMETER << (i + 1) << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
     }
+}
 
-    long int matByteSize = (long int) mat.get_cols () * mat.get_rows ()  *
-        sizeof(float);
-    if(is.tellg() != matByteSize)
+/**
+ * Checks that layers chain from an image to the 10 digits, each layer of a
+ * (#weights rows x 1) bias.
+ * Exits (code == 1) upon failures.
+ * @param weights the layers weights
+ * @param biases the layers biases
+ */
+void checkLayers(const std::vector<SharedMatrix> &weights,
+    const std::vector<SharedMatrix> &biases)
+{
+    int inputSize = img_dims.rows * img_dims.cols;
+    for(std::size_t i = 0; i < weights.size(); i++)
+    {
+        if(!(weights[i] && biases[i]) ||
+           weights[i]->get_cols() != inputSize ||
+           biases[i]->get_rows() != weights[i]->get_rows() ||
+           biases[i]->get_cols() != 1)
+        {
+            std::cerr << ERROR_INAVLID_PARAMETER << (i + 1) << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        inputSize = weights[i]->get_rows();
+    }
+    if(weights.empty() || inputSize != DIGITS_NUM)
     {
-        is.close();
-        return false;
+        std::cerr << ERROR_INAVLID_PARAMETER << weights.size() << std::endl;
+        exit(EXIT_FAILURE);
     }
-
-    is.seekg(0, std::ios_base::beg);
-    read_binary_file (is, mat);
-    is.close();
-    return true;
 }
 
 /**
- * Loads MLP parameters from weights & biases paths
- * to Weights[] and Biases[].
+ * Loads a network from a packed model file: tensors "w1".."wN" and
+ * "b1".."bN", and the int32 "topology" tensor - a row per layer of its
+ * inputs, outputs and activation. A file without a topology holds relu
+ * layers and a last softmax layer, as many as its consecutive weights.
+ * Every layer picks its kernels for its own shape.
  * Exits (code == 1) upon failures.
- * @param paths array of programs arguments, expected to be mlp parameters
- *        path.
- * @param weights array of matrix, weigths[i] is the i'th layer weights matrix
- * @param biases array of matrix, biases[i] is the i'th layer bias matrix
- *          (which is actually a vector)
+ * @param path the model file path
+ * @param precision the weights storage precision
+ * @return the network
  */
-void loadParameters(char *paths[ARGS_COUNT], Matrix weights[MLP_SIZE],
-    Matrix biases[MLP_SIZE])
+MlpNetwork loadModel(const std::string &path,
+    WeightsPrecision precision = PRECISION_F32)
 {
-    for(int i = 0; i < MLP_SIZE; i++)
+    TRACE_SCOPE("load_parameters");
+    std::shared_ptr<ModelFile> model = ModelFile::open(path);
+    if(!model)
     {
-        weights[i] = Matrix(weights_dims[i].rows, weights_dims[i].cols);
-        biases[i] = Matrix(bias_dims[i].rows, bias_dims[i].cols);
+        std::cerr << ERROR_INVALID_MODEL << path << std::endl;
+        exit(EXIT_FAILURE);
+    }
 
-        std::string weightsPath(paths[WEIGHTS_START_IDX + i]);
-        std::string biasPath(paths[BIAS_START_IDX + i]);
+    const ModelTensorEntry *topologyEntry = model->find(TOPOLOGY_TENSOR);
+    const int32_t *topology = model->int_tensor(TOPOLOGY_TENSOR);
+    int layers = 0;
+    if(topologyEntry != nullptr)
+    {
+        if(topology == nullptr || topologyEntry->cols != TOPOLOGY_COLS)
+        {
+            std::cerr << ERROR_INVALID_TOPOLOGY << path << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        layers = (int) topologyEntry->rows;
+    }
+    else
+    {
+        while(model->find(WEIGHTS_TENSOR_PREFIX + std::to_string(layers + 1)))
+        {
+            layers++;
+        }
+    }
 
-        if(!(readFileToMatrix(weightsPath, weights[i]) &&
-           readFileToMatrix(biasPath, biases[i])))
+    std::vector<SharedMatrix> weights, biases;
+    std::vector<ActivationType> activations;
+    for(int i = 0; i < layers; i++)
+    {
+        weights.push_back(model->tensor(WEIGHTS_TENSOR_PREFIX +
+                                        std::to_string(i + 1)));
+        biases.push_back(model->tensor(BIAS_TENSOR_PREFIX +
+                                       std::to_string(i + 1)));
+        activations.push_back(i < layers - 1 ? RELU : SOFTMAX);
+        if(topology == nullptr)
+        {
+            continue;
+        }
+        const int32_t *spec = topology + i * TOPOLOGY_COLS;
+        if(!weights[i] ||
+           spec[TOPOLOGY_INPUTS_COL] != weights[i]->get_cols() ||
+           spec[TOPOLOGY_OUTPUTS_COL] != weights[i]->get_rows() ||
+           (spec[TOPOLOGY_ACTIVATION_COL] != RELU &&
+            spec[TOPOLOGY_ACTIVATION_COL] != SOFTMAX))
+        {
+            std::cerr << ERROR_INVALID_TOPOLOGY << path << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        activations[i] = (ActivationType) spec[TOPOLOGY_ACTIVATION_COL];
+    }
+    checkLayers(weights, biases);
+    return MlpNetwork(weights, biases, activations, precision);
+}
+
+/**
+ * Maps a raw layer parameters pair. The layer shape is taken from the file
+ * sizes: the bias file holds a float per output, the weights file a row of
+ * floats per output.
+ * @param weightsPath the layer weights file path
+ * @param biasPath the layer bias file path
+ * @param weights the mapped weights, or nullptr upon failure
+ * @param bias the mapped bias, or nullptr upon failure
+ */
+void mapLayerFiles(const std::string &weightsPath, const std::string &biasPath,
+    SharedMatrix &weights, SharedMatrix &bias)
+{
+    std::shared_ptr<MappedFile> biasFile = MappedFile::open(biasPath);
+    std::shared_ptr<MappedFile> weightsFile = MappedFile::open(weightsPath);
+    if(!(biasFile && weightsFile))
+    {
+        return;
+    }
+    std::size_t rowBytes = biasFile->size();
+    int rows = (int) (rowBytes / sizeof(float));
+    if(rows == 0 || rowBytes % sizeof(float) != 0 ||
+       weightsFile->size() % rowBytes != 0)
+    {
+        return;
+    }
+    bias = map_matrix(biasFile, 0, rows, 1);
+    weights = map_matrix(weightsFile, 0, rows,
+                         (int) (weightsFile->size() / rowBytes));
+}
+
+/**
+ * Packs raw MLP parameters files into a single model file, of a network of
+ * relu layers and a last softmax layer. The layers shapes are taken from
+ * the files sizes, and written along as the model topology.
+ * Exits (code == 1) upon failures.
+ * @param modelPath the model file path to write
+ * @param paths the layers weights files paths, then their biases files
+ *        paths
+ * @param layers the number of layers
+ */
+void packModel(const std::string &modelPath, char **paths, int layers)
+{
+    std::vector<SharedMatrix> weights(layers), biases(layers);
+    std::vector<int32_t> topology;
+    for(int i = 0; i < layers; i++)
+    {
+        mapLayerFiles(paths[i], paths[layers + i], weights[i], biases[i]);
+        if(!(weights[i] && biases[i]))
         {
             std::cerr << ERROR_INAVLID_PARAMETER << (i + 1) << std::endl;
             exit(EXIT_FAILURE);
         }
+        topology.push_back(weights[i]->get_cols());
+        topology.push_back(weights[i]->get_rows());
+        topology.push_back(i < layers - 1 ? RELU : SOFTMAX);
+    }
+    checkLayers(weights, biases);
 
+    std::vector<ModelTensor> tensors;
+    for(int i = 0; i < layers; i++)
+    {
+        tensors.push_back(matrix_tensor(WEIGHTS_TENSOR_PREFIX +
+                                        std::to_string(i + 1), *weights[i]));
+        tensors.push_back(matrix_tensor(BIAS_TENSOR_PREFIX +
+                                        std::to_string(i + 1), *biases[i]));
+    }
+    tensors.push_back({TOPOLOGY_TENSOR, MODEL_DTYPE_I32, layers,
+                       TOPOLOGY_COLS, topology.data()});
+    if(!write_model_file(modelPath, tensors))
+    {
+        std::cerr << ERROR_WRITE_MODEL << modelPath << std::endl;
+        exit(EXIT_FAILURE);
     }
+    std::cout << MODEL_WRITTEN << modelPath << std::endl;
 }
 
 /**
@@ -104,11 +398,12 @@ void loadParameters(char *paths[ARGS_COUNT], Matrix weights[MLP_SIZE],
  *                  print image & netowrk prediction
  *             }
  * Exits (code == 1) on fatal errors: unable to read user input path.
- * @param mlp MlpNetwork to use in order to predict img.
+ * @param mlp network evaluation to use in order to predict img.
  */
-void mlpCli(MlpNetwork &mlp)
+void mlpCli(const Classifier &mlp)
 {
     Matrix img(img_dims.rows, img_dims.cols);
+    Matrix imgVec;
     std::string imgPath;
 
     std::cout << INSERT_IMAGE_PATH << std::endl;
@@ -123,8 +418,9 @@ void mlpCli(MlpNetwork &mlp)
     {
         if(readFileToMatrix(imgPath, img))
         {
-            Matrix imgVec = img;
+            imgVec = img;
             digit output = mlp(imgVec.vectorize());
+            TRACE_SCOPE("print_result");
             std::cout << "Image processed:" << std::endl
                       << img << std::endl;
             std::cout << "Mlp result: " << output.value <<
@@ -145,6 +441,579 @@ void mlpCli(MlpNetwork &mlp)
     }
 }
 
+/**
+ * Loads every valid image file of a directory, in file names order, as
+ * input vectors. Files that are not images (see readFileToMatrix) are
+ * skipped.
+ * Exits (code == 1) if there are no valid images.
+ * @param dirPath the images directory
+ * @return the images, each vectorized
+ */
+std::vector<Matrix> loadImagesDir(const std::string &dirPath)
+{
+    std::vector<std::string> paths;
+    std::error_code error;
+    for(const auto &entry :
+        std::filesystem::directory_iterator(dirPath, error))
+    {
+        if(entry.is_regular_file())
+        {
+            paths.push_back(entry.path().string());
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+
+    std::vector<Matrix> images;
+    Matrix img(img_dims.rows, img_dims.cols);
+    for(const std::string &path : paths)
+    {
+        if(readFileToMatrix(path, img))
+        {
+            images.push_back(img);
+            images.back().vectorize();
+        }
+    }
+    if(images.empty())
+    {
+        std::cerr << ERROR_NO_IMAGES << dirPath << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return images;
+}
+
+/**
+ * Measures the throughput of a batch classifier, by classifying the images
+ * over and over for at least THROUGHPUT_MIN_SECONDS.
+ * @param classifyAll the batch classifier
+ * @param images input vectors
+ * @return classified images per second
+ */
+double measureThroughput(const BatchClassifier &classifyAll,
+    const std::vector<Matrix> &images)
+{
+    auto start = std::chrono::steady_clock::now();
+    long count = 0;
+    double seconds = 0;
+    while(seconds < THROUGHPUT_MIN_SECONDS)
+    {
+        classifyAll(images);
+        count += (long) images.size();
+        seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+    return count / seconds;
+}
+
+/**
+ * Measures the throughput of a classifier, by classifying the images one by
+ * one.
+ * @param classify the classifier
+ * @param images input vectors
+ * @return classified images per second
+ */
+double measureThroughput(const Classifier &classify,
+    const std::vector<Matrix> &images)
+{
+    return measureThroughput(BatchClassifier(
+        [&classify](const std::vector<Matrix> &batch)
+        {
+            for(const Matrix &img : batch)
+            {
+                classify(img);
+            }
+        }), images);
+}
+
+/**
+ * Prints a comparison of the float32 network and its int8 quantization on
+ * the same images: agreement of the predicted digits, probabilities
+ * difference, weights size and throughput.
+ * @param mlp the float32 network
+ * @param quantized the int8 network
+ * @param images input vectors
+ */
+void int8Report(const MlpNetwork &mlp, const QuantizedMlp &quantized,
+    const std::vector<Matrix> &images)
+{
+    std::size_t floatBytes = 0;
+    for(const Dense &layer : mlp.get_layers())
+    {
+        floatBytes += layer.weights_bytes();
+    }
+
+    int agree = 0;
+    double probDiff = 0;
+    for(const Matrix &img : images)
+    {
+        digit floatDigit = mlp(img);
+        digit int8Digit = quantized(img);
+        agree += floatDigit.value == int8Digit.value;
+        probDiff += std::fabs(floatDigit.probability -
+                              int8Digit.probability);
+    }
+
+    double floatRate = measureThroughput(
+        [&mlp](const Matrix &m) { return mlp(m); }, images);
+    double int8Rate = measureThroughput(
+        [&quantized](const Matrix &m) { return quantized(m); }, images);
+
+    std::cout << "images: " << images.size() << std::endl;
+    std::cout << "float32: weights " << floatBytes << " bytes, "
+              << floatRate << " images/sec" << std::endl;
+    std::cout << "int8:    weights " << quantized.weights_bytes()
+              << " bytes, " << int8Rate << " images/sec ("
+              << int8Rate / floatRate << "x)" << std::endl;
+    std::cout << "agreement with float32: " << agree << "/" << images.size()
+              << ", mean probability difference: "
+              << probDiff / images.size() << std::endl;
+}
+
+/**
+ * Prints, for a few ranks and thresholds, the cascade of the rank
+ * approximated network and the given one on the given images: the
+ * fraction escalated to the full network, the agreement with it, and the
+ * combined throughput - to tune the cascade by.
+ * @param mlp the full network
+ * @param images the images to measure by
+ */
+void cascadeReport(const MlpNetwork &mlp, const std::vector<Matrix> &images)
+{
+    std::vector<unsigned int> reference;
+    for(const Matrix &img : images)
+    {
+        reference.push_back(mlp(img).value);
+    }
+    double fullRate = measureThroughput(
+        [&mlp](const Matrix &m) { return mlp(m); }, images);
+    std::cout << "images: " << images.size() << ", full network: "
+              << fullRate << " images/sec" << std::endl;
+    std::cout << std::setw(6) << "rank" << std::setw(11) << "threshold"
+              << std::setw(11) << "escalated" << std::setw(11) << "agreement"
+              << std::setw(12) << "images/sec" << std::setw(9) << "speedup"
+              << std::endl;
+
+    const Dense &first = mlp.get_layers().front();
+    int maxRank = std::min(first.get_input_size(), first.get_output_size());
+    for(int rank : {8, 16, 32, 64})
+    {
+        if(rank > maxRank)
+        {
+            break;
+        }
+        MlpNetwork cheap = mlp.low_rank(rank);
+        for(float threshold : {0.5f, 0.8f, 0.9f, 0.99f})
+        {
+            MlpNetwork cascade = mlp;
+            cascade.set_result_cache(nullptr);
+            cascade.set_cascade(cheap, threshold);
+            int agree = 0;
+            for(std::size_t i = 0; i < images.size(); i++)
+            {
+                agree += cascade(images[i]).value == reference[i];
+            }
+            CascadeStats stats = cascade.get_cascade_stats();
+            double rate = measureThroughput(
+                [&cascade](const Matrix &m) { return cascade(m); }, images);
+            std::cout << std::setw(6) << rank << std::setw(11) << threshold
+                      << std::setw(10) << std::fixed << std::setprecision(1)
+                      << 100.0 * stats.escalated / stats.images << "%"
+                      << std::setw(10) << 100.0 * agree / images.size()
+                      << "%" << std::setw(12) << std::setprecision(0)
+                      << rate << std::setw(8) << std::setprecision(2)
+                      << rate / fullRate << "x" << std::endl;
+            std::cout.unsetf(std::ios::floatfield);
+            std::cout << std::setprecision(6);
+        }
+    }
+}
+
+/**
+ * Prints the throughput of the inference engine over the images at 1, 2,
+ * 4 ... threads, up to the number of hardware threads.
+ * @param mlp the network
+ * @param images input vectors
+ */
+void scalingReport(const MlpNetwork &mlp, const std::vector<Matrix> &images)
+{
+    int maxThreads = std::max(1, (int) std::thread::hardware_concurrency());
+    std::vector<int> counts;
+    for(int threads = 1; threads < maxThreads; threads *= 2)
+    {
+        counts.push_back(threads);
+    }
+    counts.push_back(maxThreads);
+
+    std::cout << "images: " << images.size() << std::endl;
+    double singleRate = 0;
+    for(int threads : counts)
+    {
+        InferenceEngine engine(mlp, threads);
+        double rate = measureThroughput(BatchClassifier(
+            [&engine](const std::vector<Matrix> &batch)
+            { engine.classify_all(batch); }), images);
+        if(threads == 1)
+        {
+            singleRate = rate;
+        }
+        std::cout << "threads " << threads << ": " << rate
+                  << " images/sec (" << rate / singleRate << "x)"
+                  << std::endl;
+    }
+}
+
+/**
+ * Classifies a stream of images non-interactively, as JSON lines on stdout.
+ * The counts and throughput are printed to stderr.
+ * Exits (code == 1) if the input file can not be opened.
+ * @param mlp the network
+ * @param format the input format
+ * @param inputPath the input file, or nullptr to read stdin
+ */
+void streamMode(const MlpNetwork &mlp, StreamFormat format,
+    const char *inputPath)
+{
+    std::ifstream file;
+    if(inputPath != nullptr)
+    {
+        file.open(inputPath, std::ios::in | std::ios::binary);
+        if(!file.is_open())
+        {
+            std::cerr << ERROR_INVALID_STREAM << inputPath << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+    std::istream &in = inputPath != nullptr ? file : std::cin;
+
+    // results are written in whole buffers, never tied to the input.
+    std::ios::sync_with_stdio(false);
+    std::cin.tie(nullptr);
+    auto start = std::chrono::steady_clock::now();
+    StreamStats stats = stream_classify(in, format, std::cout, mlp);
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    std::cerr << "images: " << stats.images << ", invalid: " << stats.invalid
+              << ", " << stats.images / seconds << " images/sec" << std::endl;
+}
+
+/**
+ * Classifies a labeled IDX images set on all the hardware threads, and
+ * prints the accuracy, the confusion matrix (a row per label, a col per
+ * predicted digit) and the throughput.
+ * Exits (code == 1) if a file is invalid, or the set does not suit the
+ * network.
+ * @param mlp the network
+ * @param imagesPath the IDX images file
+ * @param labelsPath the IDX labels file
+ */
+void evalMode(const MlpNetwork &mlp, const std::string &imagesPath,
+    const std::string &labelsPath)
+{
+    std::shared_ptr<IdxImages> images = IdxImages::open(imagesPath);
+    std::shared_ptr<IdxLabels> labels = IdxLabels::open(labelsPath);
+    if(!images || !labels)
+    {
+        std::cerr << ERROR_INVALID_IDX << (images ? labelsPath : imagesPath)
+                  << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if(images->image_size() != mlp.get_input_size() ||
+       images->size() != labels->size())
+    {
+        std::cerr << ERROR_EVAL_MISMATCH << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    int threads = std::max(1, (int) std::thread::hardware_concurrency());
+    InferenceEngine engine(mlp, threads);
+    auto start = std::chrono::steady_clock::now();
+    EvalStats stats = engine.evaluate(*images, *labels);
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "images: " << stats.images << ", threads: "
+              << engine.get_threads() << std::endl;
+    std::cout << "accuracy: " << 100.0 * stats.correct / stats.images
+              << "% (" << stats.correct << "/" << stats.images << ")"
+              << std::endl;
+    std::cout << "confusion (rows: label, cols: predicted):" << std::endl;
+    std::cout << "     ";
+    for(int c = 0; c < stats.classes; c++)
+    {
+        std::cout << std::setw(7) << c;
+    }
+    std::cout << std::endl;
+    for(int label = 0; label < stats.classes; label++)
+    {
+        std::cout << std::setw(5) << label;
+        for(int c = 0; c < stats.classes; c++)
+        {
+            std::cout << std::setw(7)
+                      << stats.confusion[label * stats.classes + c];
+        }
+        std::cout << std::endl;
+    }
+    std::cout << stats.images / seconds << " images/sec" << std::endl;
+}
+
+/**
+ * Parses a positive count argument.
+ * Exits (code == 1) if it is not a positive integer.
+ * @param arg the argument
+ * @return the count
+ */
+int parseCount(const char *arg)
+{
+    char *end = nullptr;
+    long count = std::strtol(arg, &end, 10);
+    if(end == arg || *end != '\0' || count <= 0 || count > INT_MAX)
+    {
+        std::cerr << ERROR_INVALID_COUNT << arg << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return (int) count;
+}
+
+/**
+ * Connects to an inference server.
+ * Exits (code == 1) if the server can not be reached.
+ * @param socketPath the server socket path
+ * @return the connected client
+ */
+std::shared_ptr<InferenceClient> connectServer(const std::string &socketPath)
+{
+    std::shared_ptr<InferenceClient> client =
+        InferenceClient::connect(socketPath);
+    if(!client)
+    {
+        std::cerr << ERROR_SERVER_CONNECT << socketPath << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return client;
+}
+
+/**
+ * Classifies images on a running inference server: prints the digit of
+ * every image, then loads the server from concurrent connections for at
+ * least THROUGHPUT_MIN_SECONDS, and prints the throughput and the server
+ * counters.
+ * Exits (code == 1) if the server can not be reached.
+ * @param socketPath the server socket path
+ * @param images input vectors
+ * @param connections the concurrent connections number
+ */
+void clientMode(const std::string &socketPath,
+    const std::vector<Matrix> &images, int connections)
+{
+    std::shared_ptr<InferenceClient> client = connectServer(socketPath);
+    for(std::size_t i = 0; i < images.size(); i++)
+    {
+        digit output;
+        if(!client->classify(images[i], output))
+        {
+            std::cerr << ERROR_SERVER_CONNECT << socketPath << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        std::cout << "image " << i << ": " << output.value
+                  << " at probability: " << output.probability << "\n";
+    }
+
+    std::vector<std::shared_ptr<InferenceClient>> clients;
+    for(int i = 0; i < connections; i++)
+    {
+        clients.push_back(connectServer(socketPath));
+    }
+    std::atomic<long> count(0);
+    std::atomic<bool> failed(false);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for(int i = 0; i < connections; i++)
+    {
+        threads.emplace_back([&, i]()
+        {
+            digit output;
+            while(!failed && std::chrono::steady_clock::now() - start <
+                  std::chrono::duration<double>(THROUGHPUT_MIN_SECONDS))
+            {
+                for(const Matrix &img : images)
+                {
+                    if(!clients[i]->classify(img, output))
+                    {
+                        failed = true;
+                        return;
+                    }
+                }
+                count += (long) images.size();
+            }
+        });
+    }
+    for(std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    ServerStatsReply stats;
+    if(failed || !client->stats(stats))
+    {
+        std::cerr << ERROR_SERVER_CONNECT << socketPath << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    std::cout << "connections " << connections << ": " << count / seconds
+              << " images/sec" << std::endl;
+    std::cout << "server: " << stats.requests << " requests in "
+              << stats.batches << " batches (mean batch "
+              << (double) stats.requests / std::max<uint64_t>(stats.batches, 1)
+              << "), queue depth " << stats.queue_depth << " (max "
+              << stats.max_queue_depth << "), latency p50 " << stats.p50_us
+              << " us, p99 " << stats.p99_us << " us" << std::endl;
+}
+
+/**
+ * Parses a weights precision name.
+ * Exits (code == 1) on an unknown name.
+ * @param name fp16 or bf16
+ * @return the weights precision
+ */
+WeightsPrecision parsePrecision(const std::string &name)
+{
+    if(name == PRECISION_F16_NAME)
+    {
+        return PRECISION_F16;
+    }
+    if(name == PRECISION_BF16_NAME)
+    {
+        return PRECISION_BF16;
+    }
+    std::cerr << ERROR_INVALID_PRECISION << name << std::endl;
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * The result cache of the classifications, when caching.
+ */
+static std::shared_ptr<ResultCache> resultCache;
+
+/**
+ * Prints the result cache counters to stderr. Runs at the program exit.
+ */
+void printCacheStats()
+{
+    CacheStats stats = resultCache->stats();
+    long lookups = stats.hits + stats.misses;
+    std::cerr << "cache: " << stats.hits << " hits, " << stats.misses
+              << " misses (hit rate "
+              << (lookups ? 100.0 * stats.hits / lookups : 0.0) << "%), "
+              << stats.evictions << " evictions, " << stats.size << "/"
+              << resultCache->capacity() << " entries" << std::endl;
+}
+
+/**
+ * Puts the result cache, if any, in front of a classifier.
+ * @param classify the classifier
+ * @return the cached classifier
+ */
+Classifier cachedClassifier(const Classifier &classify)
+{
+    if(!resultCache)
+    {
+        return classify;
+    }
+    return [classify](const Matrix &m)
+    {
+        uint64_t key = ResultCache::hash(m.data(),
+                                         m.get_rows() * m.get_cols());
+        digit result;
+        if(!resultCache->lookup(key, result))
+        {
+            result = classify(m);
+            resultCache->insert(key, result);
+        }
+        return result;
+    };
+}
+
+/**
+ * The cascade of the configured networks, when cascading: a copy of the
+ * first one, sharing the counters of all of them.
+ */
+static std::unique_ptr<MlpNetwork> cascadeNetwork;
+static float cascadeThreshold = -1;
+static int cascadeRank = CASCADE_DEFAULT_RANK;
+
+/**
+ * Parses a --cascade argument, threshold[:rank].
+ * Exits (code == 1) upon an invalid argument.
+ * @param arg the argument
+ */
+void parseCascade(const std::string &arg)
+{
+    std::size_t colon = arg.find(':');
+    char *end = nullptr;
+    std::string threshold = arg.substr(0, colon);
+    cascadeThreshold = std::strtof(threshold.c_str(), &end);
+    if(threshold.empty() || *end != '\0' || !(cascadeThreshold >= 0) ||
+       cascadeThreshold > 1)
+    {
+        std::cerr << ERROR_INVALID_CASCADE << arg << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if(colon != std::string::npos)
+    {
+        cascadeRank = parseCount(arg.c_str() + colon + 1);
+    }
+}
+
+/**
+ * Prints the cascade counters to stderr. Runs at the program exit.
+ */
+void printCascadeStats()
+{
+    if(!cascadeNetwork)
+    {
+        return;
+    }
+    CascadeStats stats = cascadeNetwork->get_cascade_stats();
+    std::cerr << "cascade: " << stats.escalated << "/" << stats.images
+              << " escalated ("
+              << (stats.images ? 100.0 * stats.escalated / stats.images : 0.0)
+              << "%)" << std::endl;
+}
+
+/**
+ * Puts the result cache and the cascade, if any, in front of a network.
+ * @param mlp the network to configure
+ */
+void configureNetwork(MlpNetwork &mlp)
+{
+    mlp.set_result_cache(resultCache);
+    if(cascadeThreshold >= 0)
+    {
+        mlp.set_cascade(mlp.low_rank(cascadeRank), cascadeThreshold);
+        cascadeNetwork.reset(new MlpNetwork(mlp));
+        std::atexit(printCascadeStats);
+    }
+}
+
+/**
+ * The output path of the recorded timings, when tracing.
+ */
+static std::string traceOutputPath;
+
+/**
+ * Writes the recorded timings to traceOutputPath, and their summary to
+ * stderr. Runs at the program exit.
+ */
+void writeTrace()
+{
+    trace_enable(false);
+    if(!trace_write_chrome(traceOutputPath))
+    {
+        std::cerr << ERROR_WRITE_TRACE << traceOutputPath << std::endl;
+    }
+    trace_print_summary(std::cerr);
+}
+
 /**
  * Program's main
  * @param argc count of args
@@ -153,18 +1022,145 @@ void mlpCli(MlpNetwork &mlp)
  */
 int main(int argc, char **argv)
 {
-    if(argc != ARGS_COUNT)
+    WeightsPrecision precision = PRECISION_F32;
+    while(argc > OPTION_ARGS && (std::string(argv[1]) == WEIGHTS_FLAG ||
+                                 std::string(argv[1]) == TRACE_FLAG ||
+                                 std::string(argv[1]) == CACHE_FLAG ||
+                                 std::string(argv[1]) == CASCADE_FLAG))
+    {
+        if(std::string(argv[1]) == WEIGHTS_FLAG)
+        {
+            precision = parsePrecision(argv[OPTION_ARGS]);
+        }
+        else if(std::string(argv[1]) == CASCADE_FLAG)
+        {
+            parseCascade(argv[OPTION_ARGS]);
+        }
+        else if(std::string(argv[1]) == CACHE_FLAG)
+        {
+            resultCache = std::make_shared<ResultCache>(
+                parseCount(argv[OPTION_ARGS]));
+            std::atexit(printCacheStats);
+        }
+        else
+        {
+            traceOutputPath = argv[OPTION_ARGS];
+            trace_enable(true);
+            std::atexit(writeTrace);
+        }
+        // consume the option, the program name takes its place.
+        argv[OPTION_ARGS] = argv[0];
+        argv += OPTION_ARGS;
+        argc -= OPTION_ARGS;
+    }
+
+    if(argc > PACK_PATHS_IDX && (argc - PACK_PATHS_IDX) % 2 == 0 &&
+       std::string(argv[1]) == PACK_FLAG)
+    {
+        packModel(argv[PACK_ARGS_SHIFT], argv + PACK_PATHS_IDX,
+                  (argc - PACK_PATHS_IDX) / 2);
+        return EXIT_SUCCESS;
+    }
+    if(argc == MODE_DIR_ARGS_COUNT &&
+       (std::string(argv[MODE_FLAG_IDX]) == INT8_FLAG ||
+        std::string(argv[MODE_FLAG_IDX]) == INT8_REPORT_FLAG))
+    {
+        MlpNetwork mlp = loadModel(argv[MODE_MODEL_IDX]);
+        std::vector<Matrix> images = loadImagesDir(argv[MODE_DIR_IDX]);
+        QuantizedMlp quantized(mlp, images);
+        if(std::string(argv[MODE_FLAG_IDX]) == INT8_REPORT_FLAG)
+        {
+            int8Report(mlp, quantized, images);
+        }
+        else
+        {
+            mlpCli(cachedClassifier([&quantized](const Matrix &m)
+            {
+                return quantized(m);
+            }));
+        }
+        return EXIT_SUCCESS;
+    }
+    if(argc == MODE_DIR_ARGS_COUNT &&
+       std::string(argv[MODE_FLAG_IDX]) == CASCADE_REPORT_FLAG)
+    {
+        MlpNetwork mlp = loadModel(argv[MODE_MODEL_IDX], precision);
+        cascadeReport(mlp, loadImagesDir(argv[MODE_DIR_IDX]));
+        return EXIT_SUCCESS;
+    }
+    if(argc == MODE_DIR_ARGS_COUNT &&
+       std::string(argv[MODE_FLAG_IDX]) == SCALING_FLAG)
+    {
+        MlpNetwork mlp = loadModel(argv[MODE_MODEL_IDX], precision);
+        scalingReport(mlp, loadImagesDir(argv[MODE_DIR_IDX]));
+        return EXIT_SUCCESS;
+    }
+    if((argc == MODE_DIR_ARGS_COUNT || argc == MODE_DIR_ARGS_COUNT - 1) &&
+       (std::string(argv[MODE_FLAG_IDX]) == STREAM_FLAG ||
+        std::string(argv[MODE_FLAG_IDX]) == STREAM_RAW_FLAG))
+    {
+        MlpNetwork mlp = loadModel(argv[MODE_MODEL_IDX], precision);
+        configureNetwork(mlp);
+        StreamFormat format = std::string(argv[MODE_FLAG_IDX]) == STREAM_FLAG
+                              ? STREAM_PATHS : STREAM_RAW;
+        streamMode(mlp, format, argc == MODE_DIR_ARGS_COUNT ?
+                                argv[STREAM_FILE_IDX] : nullptr);
+        return EXIT_SUCCESS;
+    }
+    if((argc == SERVE_ARGS_COUNT || argc == SERVE_BATCH_ARGS_COUNT) &&
+       std::string(argv[MODE_FLAG_IDX]) == SERVE_FLAG)
+    {
+        int maxBatch = SERVE_DEFAULT_MAX_BATCH;
+        int maxDelay = SERVE_DEFAULT_MAX_DELAY_US;
+        if(argc == SERVE_BATCH_ARGS_COUNT)
+        {
+            maxBatch = parseCount(argv[SERVE_MAX_BATCH_IDX]);
+            maxDelay = parseCount(argv[SERVE_MAX_DELAY_IDX]);
+        }
+        MlpNetwork mlp = loadModel(argv[MODE_MODEL_IDX], precision);
+        configureNetwork(mlp);
+        InferenceServer server(mlp, maxBatch, maxDelay);
+        server.run(argv[SERVE_SOCKET_IDX]);
+        std::cerr << ERROR_SERVER_LISTEN << argv[SERVE_SOCKET_IDX]
+                  << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if(argc == EVAL_ARGS_COUNT &&
+       std::string(argv[MODE_FLAG_IDX]) == EVAL_FLAG)
+    {
+        MlpNetwork mlp = loadModel(argv[MODE_MODEL_IDX], precision);
+        configureNetwork(mlp);
+        evalMode(mlp, argv[EVAL_IMAGES_IDX], argv[EVAL_LABELS_IDX]);
+        return EXIT_SUCCESS;
+    }
+    if(argc == CLIENT_ARGS_COUNT &&
+       std::string(argv[MODE_FLAG_IDX]) == CLIENT_FLAG)
+    {
+        int connections = parseCount(argv[CLIENT_CONNECTIONS_IDX]);
+        clientMode(argv[CLIENT_SOCKET_IDX],
+                   loadImagesDir(argv[CLIENT_DIR_IDX]), connections);
+        return EXIT_SUCCESS;
+    }
+    if(argc != ARGS_COUNT && argc != MODEL_ARGS_COUNT)
     {
         usage();
         exit(EXIT_FAILURE);
     }
 
-    Matrix weights[MLP_SIZE];
-    Matrix biases[MLP_SIZE];
-    loadParameters(argv, weights, biases);
+    if(argc == MODEL_ARGS_COUNT)
+    {
+        MlpNetwork mlp = loadModel(argv[ARGS_START_IDX], precision);
+        configureNetwork(mlp);
+        mlpCli([&mlp](const Matrix &m) { return mlp(m); });
+        return EXIT_SUCCESS;
+    }
 
-    MlpNetwork mlp(weights, biases);
-    mlpCli(mlp);
+    SharedMatrix weights[MLP_SIZE];
+    SharedMatrix biases[MLP_SIZE];
+    loadParameters(argv, weights, biases);
+    MlpNetwork mlp(weights, biases, precision);
+    configureNetwork(mlp);
+    mlpCli([&mlp](const Matrix &m) { return mlp(m); });
     return EXIT_SUCCESS;
 }
 
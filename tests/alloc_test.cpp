@@ -0,0 +1,136 @@
+// alloc_test.cpp - checks that a steady-state inference does not allocate.
+// Run from the repository root (reads parameters/ and images/).
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Matrix.h"
+#include "MlpNetwork.h"
+#include "ImageFile.h"
+#include "ParameterFile.h"
+#include "bench/AllocationHooks.h"
+
+#define ERROR_INVALID_IMG "Error: invalid image path or size: "
+#define ERROR_ALLOCATIONS "FAIL: steady-state calls allocated: "
+#define ERROR_CASCADE "FAIL: the cascade escalated all or none of the " \
+                      "images: "
+#define PASSED_MSG "PASS: no allocations in "
+
+#define PARAMS_DIR "parameters"
+#define IMAGES_DIR "images/"
+#define IMAGES_NUM 10
+#define WARMUP_ROUNDS 2
+#define INFERENCES 1000
+#define CASCADE_RANK 8
+#define CASCADE_THRESHOLD 0.99f     // keeps some cheap results, not all
+
+/**
+ * Counts the heap allocations of steady-state calls of an operation: the
+ * first WARMUP_ROUNDS * IMAGES_NUM calls size the workspaces, the next
+ * INFERENCES calls are counted.
+ * @param op the operation, of the call index
+ * @return the allocations of the counted calls
+ */
+template <class Op>
+long steadyAllocations(Op op)
+{
+    for(int i = 0; i < WARMUP_ROUNDS * IMAGES_NUM; i++)
+    {
+        op(i);
+    }
+    long before = allocations.load();
+    for(int i = 0; i < INFERENCES; i++)
+    {
+        op(i);
+    }
+    return allocations.load() - before;
+}
+
+/**
+ * Prints the result of a case.
+ * @param name the case name
+ * @param allocated its allocations
+ * @return whether it did not allocate
+ */
+bool report(const std::string &name, long allocated)
+{
+    if(allocated != 0)
+    {
+        std::cerr << ERROR_ALLOCATIONS << name << ": " << allocated
+                  << " in " << INFERENCES << std::endl;
+        return false;
+    }
+    std::cout << PASSED_MSG << INFERENCES << " " << name << std::endl;
+    return true;
+}
+
+int main()
+{
+    SharedMatrix weights[MLP_SIZE];
+    SharedMatrix biases[MLP_SIZE];
+    loadParameterFiles(PARAMS_DIR, weights, biases);
+    MlpNetwork mlp(weights, biases);
+    MlpNetwork cascade = mlp;
+    cascade.set_cascade(mlp.low_rank(CASCADE_RANK), CASCADE_THRESHOLD);
+
+    int imgSize = img_dims.rows * img_dims.cols;
+    std::vector<Matrix> images;
+    Matrix batch(imgSize, IMAGES_NUM);
+    for(int i = 0; i < IMAGES_NUM; i++)
+    {
+        std::string path = IMAGES_DIR "im" + std::to_string(i);
+        Matrix img(imgSize, 1);
+        if(!readFileToMatrix(path, img))
+        {
+            std::cerr << ERROR_INVALID_IMG << path << std::endl;
+            return EXIT_FAILURE;
+        }
+        for(int r = 0; r < imgSize; r++)
+        {
+            batch(r, i) = img[r];
+        }
+        images.push_back(img);
+    }
+
+    MlpWorkspace ws;
+    std::vector<digit> digits;
+    unsigned int checksum = 0;
+    bool passed = true;
+    passed &= report("operator() and classify on a workspace",
+        steadyAllocations([&](int i)
+        {
+            const Matrix &img = images[i % IMAGES_NUM];
+            checksum += mlp(img, ws).value + mlp.classify(img, ws);
+        }));
+    passed &= report("operator() on the thread workspace",
+        steadyAllocations([&](int i)
+        {
+            checksum += mlp(images[i % IMAGES_NUM]).value;
+        }));
+    passed &= report("classify_batch of a fixed batch size",
+        steadyAllocations([&](int)
+        {
+            mlp.classify_batch(batch, digits);
+            checksum += digits[0].value;
+        }));
+    passed &= report("cascade operator() and classify_batch",
+        steadyAllocations([&](int i)
+        {
+            checksum += cascade(images[i % IMAGES_NUM]).value;
+            cascade.classify_batch(batch, digits);
+            checksum += digits[0].value;
+        }));
+
+    // the cascade case covers both paths: kept and escalated images.
+    CascadeStats stats = cascade.get_cascade_stats();
+    if(stats.escalated == 0 || stats.escalated == stats.images)
+    {
+        std::cerr << ERROR_CASCADE << stats.escalated << "/" << stats.images
+                  << std::endl;
+        passed = false;
+    }
+    std::cout << "checksum " << checksum << std::endl;
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,117 @@
+// stream_test.cpp - checks the streaming mode of a cascaded, cached network
+// against its direct classifications. Run from the repository root (reads
+// parameters/ and images/); build it with -fsanitize=address as well, to
+// catch a workspace that outlives its storage.
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Matrix.h"
+#include "MlpNetwork.h"
+#include "ImageFile.h"
+#include "ParameterFile.h"
+#include "ResultCache.h"
+#include "StreamPipeline.h"
+
+#define ERROR_INVALID_IMG "Error: invalid image path or size: "
+#define ERROR_MISMATCH "FAIL: a streamed result differs from the direct " \
+                       "one: "
+#define ERROR_COUNTS "FAIL: unexpected stream counts: "
+#define PASSED_MSG "PASS: streamed results match in "
+
+#define PARAMS_DIR "parameters"
+#define IMAGES_DIR "images/"
+#define IMAGES_NUM 10
+#define ROUNDS 40           // of the images, several stream batches each
+#define STREAMS 4           // a new pipeline, and so new threads, each
+#define CACHE_ENTRIES 4     // fewer than the images: hits and evictions
+#define CASCADE_RANK 8
+#define CASCADE_THRESHOLD 0.9999f   // escalates most of every batch
+#define DIGIT_FIELD "\"digit\":"
+#define SOURCE_FIELD "\"source\":\"" IMAGES_DIR "im"
+
+int main()
+{
+    SharedMatrix weights[MLP_SIZE];
+    SharedMatrix biases[MLP_SIZE];
+    loadParameterFiles(PARAMS_DIR, weights, biases);
+    MlpNetwork mlp(weights, biases);
+    MlpNetwork cheap = mlp.low_rank(CASCADE_RANK);
+
+    // the direct results of the same cascade, uncached.
+    MlpNetwork direct = mlp;
+    direct.set_cascade(cheap, CASCADE_THRESHOLD);
+    std::vector<unsigned int> expected;
+    for(int i = 0; i < IMAGES_NUM; i++)
+    {
+        std::string path = IMAGES_DIR "im" + std::to_string(i);
+        Matrix img(img_dims.rows * img_dims.cols, 1);
+        if(!readFileToMatrix(path, img))
+        {
+            std::cerr << ERROR_INVALID_IMG << path << std::endl;
+            return EXIT_FAILURE;
+        }
+        expected.push_back(direct(img).value);
+    }
+
+    MlpNetwork streamed = mlp;
+    streamed.set_result_cache(std::make_shared<ResultCache>(CACHE_ENTRIES));
+    streamed.set_cascade(cheap, CASCADE_THRESHOLD);
+    std::string paths;
+    for(int r = 0; r < ROUNDS; r++)
+    {
+        for(int i = 0; i < IMAGES_NUM; i++)
+        {
+            paths += IMAGES_DIR "im" + std::to_string(i) + "\n";
+        }
+    }
+
+    long lines = 0;
+    for(int s = 0; s < STREAMS; s++)
+    {
+        std::istringstream in(paths);
+        std::ostringstream out;
+        StreamStats stats = stream_classify(in, STREAM_PATHS, out, streamed);
+        if(stats.images != (long) ROUNDS * IMAGES_NUM || stats.invalid != 0)
+        {
+            std::cerr << ERROR_COUNTS << stats.images << " images, "
+                      << stats.invalid << " invalid" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        std::istringstream results(out.str());
+        std::string line;
+        while(std::getline(results, line))
+        {
+            std::size_t source = line.find(SOURCE_FIELD);
+            std::size_t digit = line.find(DIGIT_FIELD);
+            if(source == std::string::npos || digit == std::string::npos)
+            {
+                std::cerr << ERROR_MISMATCH << line << std::endl;
+                return EXIT_FAILURE;
+            }
+            int image = std::atoi(line.c_str() + source +
+                                  sizeof(SOURCE_FIELD) - 1);
+            unsigned int value = (unsigned int) std::atoi(
+                line.c_str() + digit + sizeof(DIGIT_FIELD) - 1);
+            if(image < 0 || image >= IMAGES_NUM || value != expected[image])
+            {
+                std::cerr << ERROR_MISMATCH << line << std::endl;
+                return EXIT_FAILURE;
+            }
+            lines++;
+        }
+    }
+    if(lines != (long) STREAMS * ROUNDS * IMAGES_NUM)
+    {
+        std::cerr << ERROR_COUNTS << lines << " result lines" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << PASSED_MSG << STREAMS << " streams of "
+              << ROUNDS * IMAGES_NUM << " images" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,290 @@
+// prune.cpp - magnitude pruning of the network weights, offline.
+// Prunes the raw parameter files into block-sparse ones (see SparseMatrix.h)
+// and reports the accuracy of both networks on a labeled set of images.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Matrix.h"
+#include "Dense.h"
+#include "MlpNetwork.h"
+#include "ImageFile.h"
+#include "ParameterFile.h"
+#include "Kernels.h"
+#include "SparseMatrix.h"
+
+#define USAGE_MSG "Usage:\n" \
+                  "\t./mlpprune params_dir out_dir sparsity labels_file\n" \
+                  "\tparams_dir - the raw parameter files w1..w4 b1..b4\n" \
+                  "\tout_dir - where to write the pruned parameter files\n" \
+                  "\tsparsity - the fraction of the weight blocks to zero " \
+                  "in every hidden\n" \
+                  "\t\tlayer, in [0, 1)\n" \
+                  "\tlabels_file - a line per image: its path and its digit"
+#define ERROR_INVALID_SPARSITY "Error: invalid sparsity, must be in [0, 1): "
+#define ERROR_INVALID_LABELS "Error: invalid labels file: "
+#define ERROR_INVALID_IMG "Error: invalid image path or size: "
+#define ERROR_WRITE_PARAMETER "Error: failed to write: "
+
+#define PARAMS_DIR_IDX 1
+#define OUT_DIR_IDX 2
+#define SPARSITY_IDX 3
+#define LABELS_IDX 4
+#define ARGS_COUNT 5
+#define WEIGHTS_FILE_PREFIX "/w"
+#define BIAS_FILE_PREFIX "/b"
+#define DIGITS_NUM 10
+#define THROUGHPUT_MIN_SECONDS 0.5
+
+/**
+ * @struct LabeledImage
+ * @brief An input vector and its known digit.
+ */
+struct LabeledImage
+{
+    Matrix image;
+    unsigned int label;
+};
+
+/**
+ * Writes a matrix as a raw float32 parameter file.
+ * Exits (code == 1) upon failures.
+ * @param path the file path
+ * @param m the matrix
+ */
+void writeParameter(const std::string &path, const Matrix &m)
+{
+    std::ofstream os(path, std::ios::out | std::ios::binary |
+                           std::ios::trunc);
+    os.write((const char *) m.data(), (std::streamsize) (sizeof(float) *
+             m.get_rows() * m.get_cols()));
+    if(!os)
+    {
+        std::cerr << ERROR_WRITE_PARAMETER << path << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Zeroes the smallest blocks of a weight matrix, by the sum of the
+ * absolute values of their elements. The blocks are those of SparseMatrix,
+ * so the pruned matrix is stored by its non zero blocks only.
+ * @param w the weight matrix, pruned in place
+ * @param sparsity the fraction of the blocks to zero
+ */
+void pruneBlocks(Matrix &w, double sparsity)
+{
+    std::vector<float> norms;
+    for(int i = 0; i < w.get_rows(); i++)
+    {
+        for(int col = 0; col < w.get_cols(); col += SPARSE_BLOCK)
+        {
+            float norm = 0;
+            for(int l = col; l < std::min(w.get_cols(), col + SPARSE_BLOCK);
+                l++)
+            {
+                norm += std::fabs(w(i, l));
+            }
+            norms.push_back(norm);
+        }
+    }
+
+    std::size_t pruned = (std::size_t) (sparsity * (double) norms.size());
+    if(pruned == 0)
+    {
+        return;
+    }
+    std::vector<float> sorted = norms;
+    std::nth_element(sorted.begin(), sorted.begin() + (pruned - 1),
+                     sorted.end());
+    float threshold = sorted[pruned - 1];
+
+    // ties at the threshold are pruned in order, up to the target count.
+    std::size_t block = 0;
+    for(int i = 0; i < w.get_rows(); i++)
+    {
+        for(int col = 0; col < w.get_cols(); col += SPARSE_BLOCK, block++)
+        {
+            if(pruned == 0 || norms[block] > threshold)
+            {
+                continue;
+            }
+            pruned--;
+            for(int l = col; l < std::min(w.get_cols(), col + SPARSE_BLOCK);
+                l++)
+            {
+                w(i, l) = 0;
+            }
+        }
+    }
+}
+
+/**
+ * Loads the labeled images: a line per image, its path and its digit.
+ * Exits (code == 1) upon failures, or if there are no images.
+ * @param path the labels file path
+ * @return the images
+ */
+std::vector<LabeledImage> loadLabeledImages(const std::string &path)
+{
+    std::ifstream is(path);
+    if(!is.is_open())
+    {
+        std::cerr << ERROR_INVALID_LABELS << path << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    std::vector<LabeledImage> images;
+    std::string line;
+    while(std::getline(is, line))
+    {
+        std::istringstream fields(line);
+        std::string imagePath;
+        int label;
+        if(!(fields >> imagePath))
+        {
+            continue;
+        }
+        if(!(fields >> label) || label < 0 || label >= DIGITS_NUM)
+        {
+            std::cerr << ERROR_INVALID_LABELS << path << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        Matrix img(img_dims.rows * img_dims.cols, 1);
+        if(!readFileToMatrix(imagePath, img))
+        {
+            std::cerr << ERROR_INVALID_IMG << imagePath << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        images.push_back({img, (unsigned int) label});
+    }
+    if(images.empty())
+    {
+        std::cerr << ERROR_INVALID_LABELS << path << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return images;
+}
+
+/**
+ * Measures the accuracy and the single image throughput of a network.
+ * @param mlp the network
+ * @param images the labeled images
+ * @param imagesPerSec the classified images per second
+ * @return the fraction of correctly classified images
+ */
+double evaluate(const MlpNetwork &mlp, const std::vector<LabeledImage> &images,
+    double &imagesPerSec)
+{
+    int correct = 0;
+    for(const LabeledImage &img : images)
+    {
+        correct += mlp(img.image).value == img.label;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    long count = 0;
+    double seconds = 0;
+    while(seconds < THROUGHPUT_MIN_SECONDS)
+    {
+        for(const LabeledImage &img : images)
+        {
+            mlp(img.image);
+        }
+        count += (long) images.size();
+        seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+    imagesPerSec = count / seconds;
+    return (double) correct / (double) images.size();
+}
+
+/**
+ * Prints the storage of every layer of a network.
+ * @param name the network name
+ * @param mlp the network
+ */
+void printLayers(const std::string &name, const MlpNetwork &mlp)
+{
+    const std::vector<Dense> &layers = mlp.get_layers();
+    for(std::size_t i = 0; i < layers.size(); i++)
+    {
+        const Dense &layer = layers[i];
+        std::cout << name << " layer " << (i + 1) << ": "
+                  << layer.get_output_size() << "x"
+                  << layer.get_input_size() << ", blocks density "
+                  << SparseMatrix::block_density(layer.get_weights()) << ", "
+                  << (layer.get_sparse_weights() ? "sparse" : "dense")
+                  << " kernels, " << layer.weights_bytes() << " bytes"
+                  << std::endl;
+    }
+}
+
+/**
+ * Program's main
+ * @param argc count of args
+ * @param argv args values
+ * @return program exit status code
+ */
+int main(int argc, char **argv)
+{
+    if(argc != ARGS_COUNT)
+    {
+        std::cout << USAGE_MSG << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    char *end = nullptr;
+    double sparsity = std::strtod(argv[SPARSITY_IDX], &end);
+    if(end == argv[SPARSITY_IDX] || *end != '\0' || !(sparsity >= 0) ||
+       sparsity >= 1)
+    {
+        std::cerr << ERROR_INVALID_SPARSITY << argv[SPARSITY_IDX]
+                  << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    SharedMatrix weights[MLP_SIZE];
+    SharedMatrix biases[MLP_SIZE];
+    loadParameterFiles(argv[PARAMS_DIR_IDX], weights, biases);
+    std::vector<LabeledImage> images = loadLabeledImages(argv[LABELS_IDX]);
+
+    // the output layer is small, and every one of its weights counts.
+    SharedMatrix pruned[MLP_SIZE];
+    std::string outDir = argv[OUT_DIR_IDX];
+    for(int i = 0; i < MLP_SIZE; i++)
+    {
+        Matrix w = *weights[i];
+        if(i < MLP_SIZE - 1)
+        {
+            pruneBlocks(w, sparsity);
+        }
+        std::string idx = std::to_string(i + 1);
+        writeParameter(outDir + WEIGHTS_FILE_PREFIX + idx, w);
+        writeParameter(outDir + BIAS_FILE_PREFIX + idx, *biases[i]);
+        pruned[i] = std::make_shared<const Matrix>(w);
+    }
+
+    MlpNetwork dense(weights, biases);
+    MlpNetwork sparse(pruned, biases);
+    printLayers("dense", dense);
+    printLayers("pruned", sparse);
+
+    double denseRate, sparseRate;
+    double denseAccuracy = evaluate(dense, images, denseRate);
+    double sparseAccuracy = evaluate(sparse, images, sparseRate);
+    std::cout << "images: " << images.size() << std::endl;
+    std::cout << "dense:  accuracy " << denseAccuracy * 100 << "%, "
+              << denseRate << " images/sec" << std::endl;
+    std::cout << "pruned: accuracy " << sparseAccuracy * 100 << "%, "
+              << sparseRate << " images/sec" << std::endl;
+    std::cout << "accuracy drop: " << (denseAccuracy - sparseAccuracy) * 100
+              << " points" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,266 @@
+// train.cpp - trains the network on a labeled images set, and writes its
+// parameter files (the raw w1.. b1.. files the program loads and packs).
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Matrix.h"
+#include "MlpNetwork.h"
+#include "MlpTrainer.h"
+#include "ImageFile.h"
+#include "ParameterFile.h"
+
+#define USAGE_MSG "Usage:\n" \
+                  "\t./mlptrain [options] labels_file out_dir\n" \
+                  "\tlabels_file - a line per image: its path and its " \
+                  "digit\n" \
+                  "\tout_dir - where to write the parameter files\n" \
+                  "options:\n" \
+                  "\t--epochs n - passes over the images (default 10)\n" \
+                  "\t--batch n - the minibatch size (default 64)\n" \
+                  "\t--lr x - the learning rate (default 0.001, or 0.01 " \
+                  "with --sgd)\n" \
+                  "\t--sgd - SGD with momentum 0.9 instead of Adam\n" \
+                  "\t--threads n - the worker threads (default: the " \
+                  "hardware threads)\n" \
+                  "\t--layers n,n,.. - the layer sizes, input first " \
+                  "(default 784,128,64,20,10)\n" \
+                  "\t--init params_dir - continue from the w1..w4 b1..b4 " \
+                  "files of params_dir\n" \
+                  "\t--test labels_file - measure the trained network on " \
+                  "other images"
+#define ERROR_INVALID_LABELS "Error: invalid labels file, or one of its " \
+                             "images: "
+#define ERROR_INVALID_OPTION "Error: invalid option value: "
+#define ERROR_WRITE_PARAMETERS "Error: failed to write parameters to: "
+#define PARAMETERS_WRITTEN "Parameters written to: "
+
+#define EPOCHS_FLAG "--epochs"
+#define BATCH_FLAG "--batch"
+#define LR_FLAG "--lr"
+#define SGD_FLAG "--sgd"
+#define THREADS_FLAG "--threads"
+#define LAYERS_FLAG "--layers"
+#define INIT_FLAG "--init"
+#define TEST_FLAG "--test"
+#define POSITIONAL_ARGS 2
+#define DEFAULT_EPOCHS 10
+#define DEFAULT_SGD_LR 0.01f
+
+/**
+ * Parses a positive integer option value.
+ * Exits (code == 1) if it is not one.
+ * @param arg the value
+ * @return the integer
+ */
+int parsePositive(const std::string &arg)
+{
+    char *end = nullptr;
+    long value = std::strtol(arg.c_str(), &end, 10);
+    if(arg.empty() || *end != '\0' || value <= 0 || value > INT_MAX)
+    {
+        std::cerr << ERROR_INVALID_OPTION << arg << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return (int) value;
+}
+
+/**
+ * Parses a layer sizes list, such as 784,128,10.
+ * Exits (code == 1) if it is malformed.
+ * @param arg the list
+ * @return the sizes
+ */
+std::vector<int> parseLayers(const std::string &arg)
+{
+    std::vector<int> sizes;
+    std::istringstream fields(arg);
+    std::string size;
+    while(std::getline(fields, size, ','))
+    {
+        sizes.push_back(parsePositive(size));
+    }
+    if(sizes.size() < 2)
+    {
+        std::cerr << ERROR_INVALID_OPTION << arg << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return sizes;
+}
+
+/**
+ * Loads a labeled images list.
+ * Exits (code == 1) upon failures.
+ * @param path the list path
+ * @param imageSize the network input size
+ * @param images the images, an image per row
+ * @param labels the digit of every image
+ */
+void loadLabeled(const std::string &path, int imageSize, Matrix &images,
+    std::vector<unsigned int> &labels)
+{
+    if(!readLabeledImages(path, imageSize, images, labels))
+    {
+        std::cerr << ERROR_INVALID_LABELS << path << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Measures the accuracy of a network.
+ * @param mlp the network
+ * @param images the images, an image per row
+ * @param labels the digit of every image
+ * @return the fraction of correctly classified images
+ */
+double accuracy(const MlpNetwork &mlp, const Matrix &images,
+    const std::vector<unsigned int> &labels)
+{
+    int imageSize = images.get_cols();
+    Matrix img(imageSize, 1);
+    long correct = 0;
+    for(int i = 0; i < images.get_rows(); i++)
+    {
+        std::copy(images.data() + (std::size_t) i * imageSize,
+                  images.data() + (std::size_t) (i + 1) * imageSize,
+                  img.data());
+        correct += mlp(img).value == labels[i];
+    }
+    return (double) correct / images.get_rows();
+}
+
+/**
+ * Program's main
+ * @param argc count of args
+ * @param argv args values
+ * @return program exit status code
+ */
+int main(int argc, char **argv)
+{
+    TrainOptions opt = default_train_options();
+    int epochs = DEFAULT_EPOCHS;
+    int threads = std::max(1, (int) std::thread::hardware_concurrency());
+    std::vector<int> sizes = {img_dims.rows * img_dims.cols};
+    for(int i = 0; i < MLP_SIZE; i++)
+    {
+        sizes.push_back(weights_dims[i].rows);
+    }
+    bool lrGiven = false;
+    std::string initDir, testPath;
+    std::vector<std::string> positional;
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if(arg == SGD_FLAG)
+        {
+            opt.optimizer = OPTIMIZER_SGD;
+        }
+        else if(arg == EPOCHS_FLAG && hasValue)
+        {
+            epochs = parsePositive(argv[++i]);
+        }
+        else if(arg == BATCH_FLAG && hasValue)
+        {
+            opt.batch_size = parsePositive(argv[++i]);
+        }
+        else if(arg == LR_FLAG && hasValue)
+        {
+            opt.learning_rate = std::strtof(argv[++i], nullptr);
+            lrGiven = true;
+            if(!(opt.learning_rate > 0))
+            {
+                std::cerr << ERROR_INVALID_OPTION << argv[i] << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if(arg == THREADS_FLAG && hasValue)
+        {
+            threads = parsePositive(argv[++i]);
+        }
+        else if(arg == LAYERS_FLAG && hasValue)
+        {
+            sizes = parseLayers(argv[++i]);
+        }
+        else if(arg == INIT_FLAG && hasValue)
+        {
+            initDir = argv[++i];
+        }
+        else if(arg == TEST_FLAG && hasValue)
+        {
+            testPath = argv[++i];
+        }
+        else
+        {
+            positional.push_back(arg);
+        }
+    }
+    if(positional.size() != POSITIONAL_ARGS)
+    {
+        std::cout << USAGE_MSG << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if(opt.optimizer == OPTIMIZER_SGD && !lrGiven)
+    {
+        opt.learning_rate = DEFAULT_SGD_LR;
+    }
+
+    std::vector<SharedMatrix> initWeights, initBiases;
+    if(!initDir.empty())
+    {
+        SharedMatrix weights[MLP_SIZE];
+        SharedMatrix biases[MLP_SIZE];
+        loadParameterFiles(initDir, weights, biases);
+        initWeights.assign(weights, weights + MLP_SIZE);
+        initBiases.assign(biases, biases + MLP_SIZE);
+    }
+    MlpTrainer trainer = initDir.empty()
+                         ? MlpTrainer(sizes, threads, opt)
+                         : MlpTrainer(initWeights, initBiases, threads, opt);
+    int imageSize = initDir.empty() ? sizes.front()
+                                    : initWeights.front()->get_cols();
+
+    Matrix images;
+    std::vector<unsigned int> labels;
+    loadLabeled(positional[0], imageSize, images, labels);
+    std::cout << "images: " << images.get_rows() << ", threads: "
+              << trainer.get_threads() << std::endl;
+
+    for(int epoch = 1; epoch <= epochs; epoch++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        EpochStats stats = trainer.train_epoch(images, labels);
+        double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+        std::cout << "epoch " << epoch << ": loss " << stats.loss
+                  << ", accuracy " << stats.accuracy * 100 << "%, "
+                  << seconds << " s, " << images.get_rows() / seconds
+                  << " images/sec" << std::endl;
+    }
+
+    if(!trainer.save(positional[1]))
+    {
+        std::cerr << ERROR_WRITE_PARAMETERS << positional[1] << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    std::cout << PARAMETERS_WRITTEN << positional[1] << std::endl;
+
+    if(!testPath.empty())
+    {
+        Matrix testImages;
+        std::vector<unsigned int> testLabels;
+        loadLabeled(testPath, imageSize, testImages, testLabels);
+        std::cout << "test accuracy: "
+                  << accuracy(trainer.network(), testImages, testLabels) * 100
+                  << "% of " << testImages.get_rows() << " images"
+                  << std::endl;
+    }
+    return EXIT_SUCCESS;
+}